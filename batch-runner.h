@@ -0,0 +1,361 @@
+/*
+ * Independent-replication batch runner for the experiment scripts.
+ *
+ * --batch="name=v1,v2;other=a,b" takes the cartesian product of command-line
+ * values, runs each point --runs times (RngRun 1..runs) and aggregates what
+ * the replications Report() into mean and 95% confidence interval per point.
+ *
+ * Every replication is a separate process: the script re-executes itself
+ * with the point's options plus --RngRun, so no simulator state (globals,
+ * singletons, the scheduler) is ever shared. Up to --jobs processes run at
+ * once, so throughput scales with the core count. A child's stdout/stderr go
+ * to /dev/null; its metrics come back as "name value" lines over a pipe.
+ *
+ * Linux only: besides fork/exec/pipe2 it re-executes /proc/self/exe.
+ */
+
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include "ns3/core-module.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <poll.h>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace ns3
+{
+
+class BatchRunner
+{
+public:
+    BatchRunner() : m_runs(10), m_jobs(0), m_out("batch-results.csv"), m_resultFd(-1) {}
+
+    void AddCommandLineOptions(CommandLine& cmd)
+    {
+        cmd.AddValue("batch", "Parameter grid \"opt=v1,v2;opt2=a,b\" to run as independent replications", m_grid);
+        cmd.AddValue("runs", "Replications (RngRun 1..runs) per grid point in batch mode", m_runs);
+        cmd.AddValue("jobs", "Parallel worker processes in batch mode (0 = one per core)", m_jobs);
+        cmd.AddValue("batchOut", "CSV file for the aggregated batch results", m_out);
+        cmd.AddValue("resultFd", "Internal: pipe a batch replication reports its metrics to", m_resultFd);
+    }
+
+    bool IsBatch(void) const { return !m_grid.empty(); }
+    bool IsReplication(void) const { return m_resultFd >= 0; }
+
+    // Replication side: metrics are buffered and sent by WriteResults().
+    void Report(const std::string& name, double value)
+    {
+        if (IsReplication()) {
+            std::ostringstream line;
+            line << std::setprecision(17) << name << ' ' << value << '\n';
+            m_report += line.str();
+        }
+    }
+
+    void WriteResults(void)
+    {
+        if (!IsReplication()) {
+            return;
+        }
+        const char* p = m_report.data();
+        size_t left = m_report.size();
+        while (left > 0) {
+            ssize_t n = write(m_resultFd, p, left);
+            if (n <= 0) {
+                break;
+            }
+            p += n;
+            left -= n;
+        }
+        close(m_resultFd);
+        m_resultFd = -1;
+    }
+
+    // Parent side: runs the whole grid and prints/writes the aggregate.
+    // Returns the process exit code.
+    int Run(int argc, char* argv[])
+    {
+        std::vector<Axis> axes = ParseGrid(m_grid);
+        std::vector<std::vector<std::string> > points(1);
+        for (const Axis& a : axes) {
+            std::vector<std::vector<std::string> > next;
+            for (const std::vector<std::string>& p : points) {
+                for (const std::string& v : a.values) {
+                    next.push_back(p);
+                    next.back().push_back(v);
+                }
+            }
+            points.swap(next);
+        }
+
+        // The children's common arguments: ours minus batch control and the
+        // options the grid sets.
+        std::vector<std::string> base;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+            bool drop = IsOption(arg, "batch") || IsOption(arg, "runs") || IsOption(arg, "jobs") ||
+                        IsOption(arg, "batchOut") || IsOption(arg, "resultFd") || IsOption(arg, "RngRun");
+            for (const Axis& a : axes) {
+                drop = drop || IsOption(arg, a.name);
+            }
+            if (!drop) {
+                base.push_back(arg);
+            }
+        }
+
+        uint32_t jobs = m_jobs > 0 ? m_jobs : std::max(1u, std::thread::hardware_concurrency());
+        uint32_t total = static_cast<uint32_t>(points.size()) * m_runs;
+        std::cout << "Batch: " << points.size() << " points x " << m_runs << " runs on " << jobs << " workers\n";
+
+        std::vector<std::map<std::string, std::vector<double> > > samples(points.size());
+        std::map<pid_t, Replication> running;
+        uint32_t next = 0;
+        uint32_t failed = 0;
+        while (next < total || !running.empty()) {
+            while (running.size() < jobs && next < total) {
+                uint32_t point = next / m_runs;
+                uint32_t run = next % m_runs + 1;
+                std::vector<std::string> args = base;
+                for (uint32_t a = 0; a < axes.size(); ++a) {
+                    args.push_back("--" + axes[a].name + "=" + points[point][a]);
+                }
+                std::ostringstream rng;
+                rng << "--RngRun=" << run;
+                args.push_back(rng.str());
+                int fd = 0;
+                pid_t pid = Spawn(argv[0], args, &fd);
+                if (pid < 0) {
+                    NS_ABORT_MSG("Batch: cannot start a replication");
+                }
+                Replication& r = running[pid];
+                r.fd = fd;
+                r.job = next++;
+            }
+
+            // Drain every report pipe as data arrives, and reap a child only
+            // once its pipe is at EOF: a child whose report does not fit the
+            // pipe buffer blocks in write() until it is read, and never exits.
+            std::vector<pollfd> fds;
+            for (const std::pair<const pid_t, Replication>& r : running) {
+                pollfd f = {r.second.fd, POLLIN, 0};
+                fds.push_back(f);
+            }
+            if (poll(fds.data(), fds.size(), -1) < 0) {
+                NS_ABORT_MSG_UNLESS(errno == EINTR, "Batch: poll failed");
+                continue;
+            }
+            std::map<pid_t, Replication>::iterator it = running.begin();
+            for (uint32_t i = 0; i < fds.size(); ++i) {
+                std::map<pid_t, Replication>::iterator r = it++;
+                if (fds[i].revents == 0 || !ReadSome(r->second)) {
+                    continue;
+                }
+                int status = 0;
+                while (waitpid(r->first, &status, 0) < 0 && errno == EINTR) {
+                }
+                uint32_t point = r->second.job / m_runs;
+                if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+                    std::istringstream in(r->second.text);
+                    std::string name;
+                    double value;
+                    while (in >> name >> value) {
+                        samples[point][name].push_back(value);
+                    }
+                } else {
+                    ++failed;
+                    std::cerr << "Batch: replication " << r->second.job % m_runs + 1 << " of point "
+                              << PointLabel(axes, points[point]) << " failed\n";
+                }
+                running.erase(r);
+            }
+        }
+
+        Aggregate(axes, points, samples);
+        return failed == 0 ? 0 : 1;
+    }
+
+private:
+    struct Replication
+    {
+        int fd;            // Read end of the child's report pipe
+        uint32_t job;
+        std::string text;  // Report received so far
+    };
+
+    struct Axis
+    {
+        std::string name;
+        std::vector<std::string> values;
+    };
+
+    static std::vector<Axis> ParseGrid(const std::string& grid)
+    {
+        std::vector<Axis> axes;
+        std::istringstream in(grid);
+        std::string item;
+        while (std::getline(in, item, ';')) {
+            size_t eq = item.find('=');
+            NS_ABORT_MSG_IF(eq == std::string::npos || eq == 0, "Batch: bad grid entry '" << item << "'");
+            Axis a;
+            a.name = item.substr(0, eq);
+            std::istringstream vals(item.substr(eq + 1));
+            std::string v;
+            while (std::getline(vals, v, ',')) {
+                a.values.push_back(v);
+            }
+            NS_ABORT_MSG_IF(a.values.empty(), "Batch: no values for " << a.name);
+            axes.push_back(a);
+        }
+        return axes;
+    }
+
+    static bool IsOption(const std::string& arg, const std::string& name)
+    {
+        std::string opt = "--" + name;
+        return arg == opt || arg.compare(0, opt.size() + 1, opt + "=") == 0;
+    }
+
+    static std::string PointLabel(const std::vector<Axis>& axes, const std::vector<std::string>& point)
+    {
+        std::string label;
+        for (uint32_t a = 0; a < axes.size(); ++a) {
+            label += (a ? " " : "") + axes[a].name + "=" + point[a];
+        }
+        return label;
+    }
+
+    pid_t Spawn(const char* argv0, const std::vector<std::string>& args, int* readFd) const
+    {
+        // Close-on-exec, so no replication inherits another's pipe (which
+        // would hold its write end open past that child's exit); the child
+        // clears the flag on the one write end it reports to
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+            return -1;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            fcntl(fds[1], F_SETFD, 0);
+            int devNull = open("/dev/null", O_WRONLY);
+            if (devNull >= 0) {
+                dup2(devNull, STDOUT_FILENO);
+                dup2(devNull, STDERR_FILENO);
+                if (devNull > STDERR_FILENO) {
+                    close(devNull);
+                }
+            }
+            std::vector<std::string> full = args;
+            std::ostringstream fdArg;
+            fdArg << "--resultFd=" << fds[1];
+            full.push_back(fdArg.str());
+            std::vector<char*> cargv;
+            cargv.push_back(const_cast<char*>(argv0));
+            for (std::string& s : full) {
+                cargv.push_back(&s[0]);
+            }
+            cargv.push_back(0);
+            execv("/proc/self/exe", cargv.data());
+            execv(argv0, cargv.data());
+            _exit(127);
+        }
+        close(fds[1]);
+        if (pid < 0) {
+            close(fds[0]);
+            return -1;
+        }
+        *readFd = fds[0];
+        return pid;
+    }
+
+    // Appends what the pipe has to the report; true (and the pipe closed)
+    // at EOF or on an error.
+    static bool ReadSome(Replication& r)
+    {
+        char buf[4096];
+        ssize_t n = read(r.fd, buf, sizeof(buf));
+        if (n > 0) {
+            r.text.append(buf, n);
+            return false;
+        }
+        if (n < 0 && errno == EINTR) {
+            return false;
+        }
+        close(r.fd);
+        return true;
+    }
+
+    // Two-sided 95% Student t quantile for n - 1 degrees of freedom.
+    static double TQuantile(uint32_t n)
+    {
+        static const double t[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+        return n < 2 ? 0.0 : (n - 1 <= 30 ? t[n - 2] : 1.96);
+    }
+
+    void Aggregate(const std::vector<Axis>& axes, const std::vector<std::vector<std::string> >& points,
+                   const std::vector<std::map<std::string, std::vector<double> > >& samples) const
+    {
+        std::ofstream csv(m_out.c_str());
+        for (const Axis& a : axes) {
+            csv << a.name << ',';
+        }
+        csv << "metric,n,mean,stddev,ci95\n";
+
+        for (uint32_t p = 0; p < points.size(); ++p) {
+            std::cout << "\n=== " << PointLabel(axes, points[p]) << " ===\n";
+            std::cout << std::left << std::setw(28) << "Metric" << std::right << std::setw(5) << "n"
+                      << std::setw(14) << "Mean" << std::setw(14) << "+/- 95% CI" << "\n";
+            for (const auto& m : samples[p]) {
+                const std::vector<double>& v = m.second;
+                uint32_t n = static_cast<uint32_t>(v.size());
+                double mean = 0;
+                for (double x : v) {
+                    mean += x;
+                }
+                mean /= n;
+                double var = 0;
+                for (double x : v) {
+                    var += (x - mean) * (x - mean);
+                }
+                double sd = n > 1 ? std::sqrt(var / (n - 1)) : 0.0;
+                double ci = TQuantile(n) * sd / std::sqrt(static_cast<double>(n));
+
+                std::cout << std::left << std::setw(28) << m.first << std::right << std::setw(5) << n
+                          << std::fixed << std::setprecision(4) << std::setw(14) << mean << std::setw(14) << ci
+                          << std::defaultfloat << "\n";
+                for (const std::string& v : points[p]) {
+                    csv << v << ',';
+                }
+                csv << m.first << ',' << n << ',' << mean << ',' << sd << ',' << ci << '\n';
+            }
+        }
+        std::cout << "\nAggregated results written to " << m_out << "\n";
+    }
+
+    std::string m_grid;
+    uint32_t m_runs;
+    uint32_t m_jobs;
+    std::string m_out;
+    int m_resultFd;
+    std::string m_report;
+};
+
+} // namespace ns3
+
+#endif /* BATCH_RUNNER_H */
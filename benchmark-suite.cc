@@ -0,0 +1,484 @@
+/*
+ * Benchmark Suite
+ * Per-packet micro benchmarks of the routing and queueing fast paths, and
+ * the three scenario scripts run at scale, with fixed inputs so that two
+ * builds (or machines) are compared on exactly the same work.
+ *
+ * Micro benchmarks, in ns per operation (median and best of --reps):
+ *   pbr.route_output       PbrRouting::RouteOutput, DSCP table hit (fast path)
+ *                          and AF11, which needs the multi-field classifier
+ *   static.route_output    Ipv4StaticRouting::RouteOutput with 10/100/1000 routes
+ *   pfifo_fast.enq_deq     PfifoFastQueueDisc Enqueue + Dequeue, 64 packets queued
+ *   scheduler.hold         Event queue RemoveNext + Insert with 1k and 100k events
+ *                          pending, for each --eventScheduler of run-stats.h
+ *                          (list excluded: linear insert)
+ *
+ * Macro benchmarks (--macro): qos-implementation, pbr-simulation-complete and
+ * router-static-routing, built next to this program (or in --scenarioDir),
+ * each run on a generated WAN of 8 x --scale branches with RngRun=1; their
+ * --statsJson output gives wall time, ns per simulated event and peak RSS.
+ * --eventSchedulers=map,heap,calendar,wheel repeats them once per event
+ * scheduler, which shows what the queue costs in a whole simulation.
+ *
+ * A "calibration" row (a fixed integer loop) gives the machine's speed, so
+ * results from different machines can be normalized. --out=FILE writes all
+ * rows as CSV behind a comment header describing the machine and build.
+ *
+ * Usage: ./ns3 run "scratch/benchmark-suite --macro --scale=4 --out=bench.csv"
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/network-module.h"
+#include "ns3/traffic-control-module.h"
+#include "pbr-routing.h"
+#include "run-stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("BenchmarkSuite");
+
+static const uint32_t N_INTERFACES = 3;
+static const uint32_t NUM_KEYS = 4096;
+
+// One result row.
+struct BenchResult
+{
+    std::string name;
+    std::string param;
+    std::string unit;
+    double median;
+    double best;
+};
+
+// Runs op() 'ops' times per repetition; returns the median ns/op, sets *best.
+template <class F>
+static double NsPerOp(F op, uint64_t ops, uint32_t reps, double* best)
+{
+    op(ops / 10 + 1); // Warm-up: caches, branch predictors, lazy allocations
+    std::vector<double> samples;
+    for (uint32_t r = 0; r < reps; ++r) {
+        auto t0 = std::chrono::steady_clock::now();
+        op(ops);
+        samples.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / ops);
+    }
+    std::sort(samples.begin(), samples.end());
+    *best = samples.front();
+    return samples[samples.size() / 2];
+}
+
+static void Print(std::vector<BenchResult>& results, const std::string& name, const std::string& param,
+                  const std::string& unit, double median, double best)
+{
+    BenchResult r = {name, param, unit, median, best};
+    results.push_back(r);
+    std::cout << std::left << std::setw(24) << name << std::setw(16) << param << std::right << std::fixed
+              << std::setprecision(median < 100 ? 2 : 0) << std::setw(14) << median << std::setw(14) << best
+              << "  " << unit << std::defaultfloat << "\n";
+}
+
+// A node with N_INTERFACES SimpleNetDevices on 10.0.<i>.1/24 for routes to point at.
+static Ptr<Node> MakeRouterNode(void)
+{
+    Ptr<Node> node = CreateObject<Node>();
+    InternetStackHelper stack;
+    stack.Install(node);
+    Ptr<SimpleChannel> channel = CreateObject<SimpleChannel>();
+    Ipv4AddressHelper address;
+    address.SetBase("10.0.1.0", "255.255.255.0");
+    for (uint32_t i = 0; i < N_INTERFACES; ++i) {
+        Ptr<SimpleNetDevice> dev = CreateObject<SimpleNetDevice>();
+        dev->SetAddress(Mac48Address::Allocate());
+        dev->SetChannel(channel);
+        node->AddDevice(dev);
+        address.Assign(NetDeviceContainer(dev));
+        address.NewNetwork();
+    }
+    return node;
+}
+
+static void BenchPbr(std::vector<BenchResult>& results, uint64_t ops, uint32_t reps, std::mt19937& rng)
+{
+    Ptr<Node> node = MakeRouterNode();
+    Ptr<PbrRouting> pbr = CreateObject<PbrRouting>();
+    PbrRule video;
+    video.dscp = PbrRouting::DSCP_VIDEO_EF;
+    pbr->AddPolicyRule(video, 1, Ipv4Address("10.0.1.2"));
+    PbrRule data;
+    data.dscp = PbrRouting::DSCP_DATA_BE;
+    pbr->AddPolicyRule(data, 2, Ipv4Address("10.0.2.2"));
+    PbrRule af11; // DSCP + destination prefix: only the classifier can decide
+    af11.dscp = 10;
+    af11.dstAddress = Ipv4Address("192.168.0.0");
+    af11.dstMask = Ipv4Mask("255.255.0.0");
+    pbr->AddPolicyRule(af11, 3, Ipv4Address("10.0.3.2"));
+    pbr->SetFallbackProtocol(CreateObject<Ipv4StaticRouting>());
+    node->GetObject<Ipv4>()->SetRoutingProtocol(pbr);
+
+    std::vector<Ipv4Header> fast(NUM_KEYS);
+    std::vector<Ipv4Header> slow(NUM_KEYS);
+    for (uint32_t i = 0; i < NUM_KEYS; ++i) {
+        fast[i].SetDestination(Ipv4Address(0xc0a80000 | (rng() & 0xffff)));
+        fast[i].SetDscp((i & 1) ? Ipv4Header::DSCP_EF : Ipv4Header::DscpDefault);
+        fast[i].SetProtocol(UdpL4Protocol::PROT_NUMBER);
+        slow[i] = fast[i];
+        slow[i].SetDscp(Ipv4Header::DSCP_AF11);
+    }
+    Ptr<Packet> packet = Create<Packet>(1000);
+    Socket::SocketErrno err;
+    volatile uint32_t found = 0;
+    auto timed = [&](const std::vector<Ipv4Header>& headers) {
+        return [&, headers](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                found = found + (pbr->RouteOutput(packet, headers[i % NUM_KEYS], 0, err) != 0 ? 1 : 0);
+            }
+        };
+    };
+    double best;
+    double median = NsPerOp(timed(fast), ops, reps, &best);
+    Print(results, "pbr.route_output", "dscp-table", "ns/pkt", median, best);
+    median = NsPerOp(timed(slow), ops, reps, &best);
+    Print(results, "pbr.route_output", "classifier", "ns/pkt", median, best);
+    pbr->Dispose();
+}
+
+static void BenchStatic(std::vector<BenchResult>& results, uint64_t ops, uint32_t reps, std::mt19937& rng)
+{
+    Ptr<Node> node = MakeRouterNode();
+    const uint32_t routeCounts[] = {10, 100, 1000};
+    for (uint32_t n : routeCounts) {
+        Ptr<Ipv4StaticRouting> rt = CreateObject<Ipv4StaticRouting>();
+        rt->SetIpv4(node->GetObject<Ipv4>());
+        std::vector<uint32_t> prefixes(n);
+        for (uint32_t i = 0; i < n; ++i) {
+            prefixes[i] = 0xac000000 | (rng() & 0x00ffff00); // 172.x.y.0/24
+            uint32_t ifIndex = 1 + i % N_INTERFACES;
+            rt->AddNetworkRouteTo(Ipv4Address(prefixes[i]), Ipv4Mask("255.255.255.0"),
+                                  Ipv4Address(0x0a000002 | (ifIndex << 8)), ifIndex);
+        }
+        // Half the keys hit a route, half miss and scan the whole table
+        std::vector<Ipv4Header> keys(NUM_KEYS);
+        for (uint32_t i = 0; i < NUM_KEYS; ++i) {
+            keys[i].SetDestination(Ipv4Address((i & 1) ? prefixes[rng() % n] | (rng() & 0xff) : 0xc6000000 | (rng() & 0xffffff)));
+        }
+        Socket::SocketErrno err;
+        volatile uint32_t found = 0;
+        double best;
+        double median = NsPerOp([&](uint64_t count) {
+            for (uint64_t i = 0; i < count; ++i) {
+                found = found + (rt->RouteOutput(Ptr<Packet>(), keys[i % NUM_KEYS], 0, err) != 0 ? 1 : 0);
+            }
+        }, std::max<uint64_t>(1000, ops / std::max<uint32_t>(1, n / 10)), reps, &best);
+        std::ostringstream param;
+        param << n << " routes";
+        Print(results, "static.route_output", param.str(), "ns/lookup", median, best);
+        rt->Dispose();
+    }
+}
+
+static void BenchPfifoFast(std::vector<BenchResult>& results, uint64_t ops, uint32_t reps)
+{
+    const uint32_t DEPTH = 64;
+    Ptr<PfifoFastQueueDisc> q = CreateObject<PfifoFastQueueDisc>();
+    q->Initialize();
+    // PfifoFast picks the band from the SocketPriorityTag (through its
+    // Priomap), not the TOS: priorities 6, 0 and 1 spread the items over
+    // bands 0, 1 and 2
+    const uint8_t priority[] = {6, 0, 1};
+    for (uint32_t i = 0; i < DEPTH; ++i) {
+        Ptr<Packet> p = Create<Packet>(1000);
+        SocketPriorityTag tag;
+        tag.SetPriority(priority[i % 3]);
+        p->AddPacketTag(tag);
+        q->Enqueue(Create<Ipv4QueueDiscItem>(p, Address(), Ipv4L3Protocol::PROT_NUMBER, Ipv4Header()));
+    }
+    double best;
+    double median = NsPerOp([&](uint64_t count) {
+        for (uint64_t i = 0; i < count; ++i) {
+            q->Enqueue(q->Dequeue()); // Same items cycle through: no allocation in the loop
+        }
+    }, ops, reps, &best);
+    Print(results, "pfifo_fast.enq_deq", "depth 64", "ns/pkt", median, best);
+    q->Dispose();
+}
+
+// Hold model: every operation removes the earliest event and schedules one
+// later, so the queue keeps 'pending' events. Delays are those of a packet
+// simulation: mostly a link or queue delay (< 100 us), some app timers (< 1 s).
+static void BenchScheduler(std::vector<BenchResult>& results, uint64_t ops, uint32_t reps, std::mt19937& rng,
+                           const std::string& name)
+{
+    const uint32_t pendingCounts[] = {1000, 100000};
+    std::vector<uint64_t> delays(NUM_KEYS);
+    for (uint32_t i = 0; i < NUM_KEYS; ++i) {
+        delays[i] = (rng() % 10 == 0) ? rng() % 1000000000 : rng() % 100000;
+    }
+    for (uint32_t pending : pendingCounts) {
+        Ptr<Scheduler> scheduler = RunStats::SchedulerFactory(name).Create<Scheduler>();
+        uint32_t uid = 0;
+        for (uint32_t i = 0; i < pending; ++i) {
+            Scheduler::Event ev = {0, {delays[i % NUM_KEYS] + i, uid++, 0}};
+            scheduler->Insert(ev);
+        }
+        double best;
+        double median = NsPerOp([&](uint64_t count) {
+            for (uint64_t i = 0; i < count; ++i) {
+                Scheduler::Event ev = scheduler->RemoveNext();
+                ev.key.m_ts += delays[i % NUM_KEYS];
+                ev.key.m_uid = uid++;
+                scheduler->Insert(ev);
+            }
+        }, ops, reps, &best);
+        std::ostringstream param;
+        param << name << ", " << pending / 1000 << "k";
+        Print(results, "scheduler.hold", param.str(), "ns/event", median, best);
+    }
+}
+
+// --- Macro benchmarks: the scenario programs as child processes ---
+
+static std::string ExeDir(void)
+{
+    char buf[4096];
+    ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+    if (n <= 0) {
+        return ".";
+    }
+    std::string path(buf, n);
+    return path.substr(0, path.rfind('/'));
+}
+
+// The executable in 'dir' whose name contains 'scenario' (build systems add
+// version/profile prefixes and suffixes), or "" if there is none.
+static std::string FindProgram(const std::string& dir, const std::string& scenario)
+{
+    DIR* d = opendir(dir.c_str());
+    if (d == 0) {
+        return "";
+    }
+    std::string found;
+    for (struct dirent* e; (e = readdir(d)) != 0;) {
+        std::string name(e->d_name);
+        std::string path = dir + "/" + name;
+        struct stat st;
+        if (name.find(scenario) != std::string::npos && name.find("benchmark") == std::string::npos &&
+            stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && (st.st_mode & S_IXUSR)) {
+            found = path;
+            break;
+        }
+    }
+    closedir(d);
+    return found;
+}
+
+// Runs the program with stdout/stderr discarded; true if it exited with 0.
+static bool RunProgram(const std::string& program, const std::vector<std::string>& args)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        if (devNull >= 0) {
+            dup2(devNull, STDOUT_FILENO);
+            dup2(devNull, STDERR_FILENO);
+        }
+        std::vector<std::string> copy = args;
+        std::vector<char*> argv;
+        argv.push_back(const_cast<char*>(program.c_str()));
+        for (std::string& s : copy) {
+            argv.push_back(&s[0]);
+        }
+        argv.push_back(0);
+        execv(program.c_str(), argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Value of a top-level numeric field of a run-stats.h JSON file.
+static double JsonNumber(const std::string& path, const std::string& key)
+{
+    std::ifstream in(path.c_str());
+    std::string line;
+    std::string quoted = "\"" + key + "\":";
+    while (std::getline(in, line)) {
+        size_t at = line.find(quoted);
+        if (at != std::string::npos) {
+            return std::atof(line.c_str() + at + quoted.size());
+        }
+    }
+    return 0;
+}
+
+static void BenchScenarios(std::vector<BenchResult>& results, const std::string& dir, uint32_t scale, uint32_t reps,
+                           const std::string& eventScheduler)
+{
+    struct Scenario
+    {
+        const char* name;
+        const char* options;
+    };
+    const Scenario scenarios[] = {
+        {"qos-implementation", "--topology=hub-spoke"},
+        {"pbr-simulation-complete", "--topology=dual-homed"},
+        {"router-static-routing", "--topology=hub-spoke --trace=off --lookups=0"},
+    };
+    std::ostringstream param;
+    param << 8 * scale << " br, " << eventScheduler;
+    std::ostringstream json;
+    json << "/tmp/benchmark-suite-" << getpid() << ".json";
+
+    for (const Scenario& s : scenarios) {
+        std::string program = FindProgram(dir, s.name);
+        if (program.empty()) {
+            std::cout << std::left << std::setw(24) << s.name << "skipped: no program in " << dir << "\n";
+            continue;
+        }
+        std::vector<std::string> args;
+        std::istringstream opts(s.options);
+        for (std::string o; opts >> o;) {
+            args.push_back(o);
+        }
+        args.push_back("--branches=" + std::to_string(8 * scale));
+        args.push_back("--RngRun=1");
+        args.push_back("--statsJson=" + json.str());
+        args.push_back("--eventScheduler=" + eventScheduler);
+
+        std::vector<double> runs;
+        std::vector<double> perEvent;
+        double setup = 0;
+        double rss = 0;
+        for (uint32_t r = 0; r < reps; ++r) {
+            if (!RunProgram(program, args)) {
+                std::cout << std::left << std::setw(24) << s.name << "failed: " << program << "\n";
+                break;
+            }
+            double run = JsonNumber(json.str(), "run_s");
+            double events = JsonNumber(json.str(), "events");
+            runs.push_back(run);
+            perEvent.push_back(events > 0 ? run * 1e9 / events : 0);
+            setup = std::max(setup, JsonNumber(json.str(), "setup_s"));
+            rss = std::max(rss, JsonNumber(json.str(), "peak_rss_kb"));
+        }
+        unlink(json.str().c_str());
+        if (runs.size() < reps) {
+            continue;
+        }
+        std::sort(runs.begin(), runs.end());
+        std::sort(perEvent.begin(), perEvent.end());
+        std::string name = std::string("macro.") + s.name;
+        Print(results, name, param.str(), "s run", runs[runs.size() / 2], runs.front());
+        Print(results, name, param.str(), "ns/event", perEvent[perEvent.size() / 2], perEvent.front());
+        Print(results, name, param.str(), "s setup (max)", setup, setup);
+        Print(results, name, param.str(), "kB peak RSS (max)", rss, rss);
+    }
+}
+
+static std::string CpuModel(void)
+{
+    std::ifstream in("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 10, "model name") == 0) {
+            return line.substr(line.find(':') + 2);
+        }
+    }
+    return "unknown";
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t ops = 2000000;
+    uint32_t reps = 5;
+    uint32_t seed = 1;
+    bool macro = false;
+    uint32_t scale = 1;
+    std::string scenarioDir;
+    std::string eventSchedulers = "map";
+    std::string out;
+
+    CommandLine cmd;
+    cmd.AddValue("ops", "Operations per repetition of each micro benchmark", ops);
+    cmd.AddValue("reps", "Repetitions per benchmark (median and best are reported)", reps);
+    cmd.AddValue("seed", "Seed for the generated keys and routes", seed);
+    cmd.AddValue("macro", "Also run the three scenario programs at --scale", macro);
+    cmd.AddValue("scale", "Macro benchmarks: 8 x scale WAN branches", scale);
+    cmd.AddValue("eventSchedulers", "Macro benchmarks: comma-separated --eventScheduler values to sweep",
+                 eventSchedulers);
+    cmd.AddValue("scenarioDir", "Directory of the scenario programs (default: this program's)", scenarioDir);
+    cmd.AddValue("out", "CSV file for the results", out);
+    cmd.Parse(argc, argv);
+    reps = std::max<uint32_t>(1, reps);
+
+    std::vector<BenchResult> results;
+    std::cout << "\n--- Benchmark Suite (" << reps << " reps, median / best) ---\n";
+    std::cout << std::left << std::setw(24) << "Benchmark" << std::setw(16) << "Parameter" << std::right
+              << std::setw(14) << "Median" << std::setw(14) << "Best" << "\n";
+
+    // Calibration: a dependent chain of integer operations, no memory traffic
+    volatile uint64_t sink = 0;
+    double best;
+    double median = NsPerOp([&](uint64_t n) {
+        uint64_t x = 88172645463325252ull;
+        for (uint64_t i = 0; i < n; ++i) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+        }
+        sink = x;
+    }, ops * 10, reps, &best);
+    Print(results, "calibration", "xorshift64", "ns/op", median, best);
+
+    std::mt19937 rng(seed);
+    BenchPbr(results, ops, reps, rng);
+    BenchStatic(results, ops, reps, rng);
+    BenchPfifoFast(results, ops, reps);
+    const char* schedulers[] = {"map", "heap", "calendar", "priority", "wheel"};
+    for (const char* name : schedulers) {
+        BenchScheduler(results, ops, reps, rng, name);
+    }
+    if (macro) {
+        std::istringstream names(eventSchedulers);
+        for (std::string name; std::getline(names, name, ',');) {
+            BenchScenarios(results, scenarioDir.empty() ? ExeDir() : scenarioDir, scale, reps, name);
+        }
+    }
+
+    if (!out.empty()) {
+        std::ofstream csv(out.c_str());
+        csv << "# cpu: " << CpuModel() << "\n"
+            << "# cores: " << std::thread::hardware_concurrency() << "\n"
+            << "# compiler: " << __VERSION__ << "\n"
+#ifdef NS3_BUILD_PROFILE_OPTIMIZED
+            << "# profile: optimized\n"
+#elif defined(NS3_BUILD_PROFILE_RELEASE)
+            << "# profile: release\n"
+#else
+            << "# profile: debug\n"
+#endif
+            << "# ops: " << ops << ", reps: " << reps << ", seed: " << seed << ", scale: " << scale
+            << ", eventSchedulers: " << eventSchedulers << "\n"
+            << "benchmark,parameter,unit,median,best\n";
+        for (const BenchResult& r : results) {
+            csv << r.name << ',' << r.param << ',' << r.unit << ',' << r.median << ',' << r.best << '\n';
+        }
+        std::cout << "\nResults written to " << out << "\n";
+    }
+    Simulator::Destroy();
+    return 0;
+}
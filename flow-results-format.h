@@ -0,0 +1,217 @@
+/*
+ * FMS2: binary per-flow, per-interval results, and a zero-copy reader.
+ *
+ * Layout (native byte order, everything 8-byte aligned):
+ *
+ *   FlowResultsHeader                      40 bytes
+ *   FlowResultsField x nFields             schema: name, type, size, offset
+ *   config text (configSize bytes)         free form, e.g. the command line
+ *   padding to headerSize (multiple of 64)
+ *   records, recordSize bytes each, to the end of the file
+ *
+ * The schema lets a reader check, field by field, that the records match the
+ * FlowResultRecord it was compiled with; records may carry extra trailing
+ * fields (recordSize > sizeof(FlowResultRecord)) and stay readable. A file
+ * cut short by a crash loses only its last partial record.
+ *
+ * FMS1 (the qos-implementation sampler's previous format: magic, record size,
+ * 56-byte records without DSCP or schema) is not accepted.
+ *
+ * No ns-3 dependency, so post-processing tools build on their own. POSIX
+ * only (mmap).
+ */
+
+#ifndef FLOW_RESULTS_FORMAT_H
+#define FLOW_RESULTS_FORMAT_H
+
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace ns3
+{
+
+// One flow over one interval: deltas of the FlowMonitor counters.
+struct FlowResultRecord
+{
+    int64_t timeNs;          // End of the interval
+    uint32_t flowId;
+    uint32_t txPackets;
+    uint32_t rxPackets;
+    uint32_t lostPackets;
+    uint64_t txBytes;
+    uint64_t rxBytes;
+    int64_t delaySumNs;
+    int64_t jitterSumNs;
+    uint8_t dscp;            // Of the flow's first packets
+    uint8_t reserved[7];
+};
+
+static_assert(sizeof(FlowResultRecord) == 64, "FlowResultRecord must stay one cache line");
+
+struct FlowResultsHeader
+{
+    char magic[4];           // "FMS2"
+    uint32_t headerSize;     // Offset of the first record
+    uint32_t recordSize;
+    uint32_t nFields;
+    uint64_t runId;          // RngRun of the replication
+    int64_t intervalNs;      // Sampling interval
+    uint32_t configSize;
+    uint32_t reserved;
+};
+
+struct FlowResultsField
+{
+    char name[20];
+    uint8_t type;            // 'i' signed or 'u' unsigned integer
+    uint8_t size;
+    uint16_t offset;
+};
+
+#define FLOW_RESULTS_FIELD(name, type) {#name, type, sizeof(FlowResultRecord::name), offsetof(FlowResultRecord, name)}
+
+// The schema FlowResultRecord is written and read with.
+inline std::vector<FlowResultsField> FlowResultsSchema(void)
+{
+    FlowResultsField fields[] = {
+        FLOW_RESULTS_FIELD(timeNs, 'i'),      FLOW_RESULTS_FIELD(flowId, 'u'),
+        FLOW_RESULTS_FIELD(txPackets, 'u'),   FLOW_RESULTS_FIELD(rxPackets, 'u'),
+        FLOW_RESULTS_FIELD(lostPackets, 'u'), FLOW_RESULTS_FIELD(txBytes, 'u'),
+        FLOW_RESULTS_FIELD(rxBytes, 'u'),     FLOW_RESULTS_FIELD(delaySumNs, 'i'),
+        FLOW_RESULTS_FIELD(jitterSumNs, 'i'), FLOW_RESULTS_FIELD(dscp, 'u')};
+    return std::vector<FlowResultsField>(fields, fields + sizeof(fields) / sizeof(fields[0]));
+}
+
+#undef FLOW_RESULTS_FIELD
+
+// Writes the file header; records follow as raw FlowResultRecords.
+inline void WriteFlowResultsHeader(std::ostream& out, uint64_t runId, int64_t intervalNs, const std::string& config)
+{
+    std::vector<FlowResultsField> schema = FlowResultsSchema();
+    FlowResultsHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, "FMS2", 4);
+    uint32_t size = sizeof(h) + schema.size() * sizeof(FlowResultsField) + config.size();
+    h.headerSize = (size + 63) / 64 * 64;
+    h.recordSize = sizeof(FlowResultRecord);
+    h.nFields = schema.size();
+    h.runId = runId;
+    h.intervalNs = intervalNs;
+    h.configSize = config.size();
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    out.write(reinterpret_cast<const char*>(schema.data()), schema.size() * sizeof(FlowResultsField));
+    out.write(config.data(), config.size());
+    std::string pad(h.headerSize - size, '\0');
+    out.write(pad.data(), pad.size());
+}
+
+// Maps an FMS2 file read-only; records are used in place.
+class FlowResultsReader
+{
+public:
+    FlowResultsReader() : m_base(0), m_size(0), m_records(0), m_stride(0), m_count(0) {}
+    ~FlowResultsReader() { Close(); }
+
+    // Returns false, with GetError() set, if the file is not a usable FMS2 file.
+    bool Open(const std::string& path)
+    {
+        Close();
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return Fail("cannot open " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(FlowResultsHeader))) {
+            close(fd);
+            return Fail(path + ": too short");
+        }
+        m_size = st.st_size;
+        void* p = mmap(0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            m_size = 0;
+            return Fail("cannot map " + path);
+        }
+        m_base = static_cast<const char*>(p);
+        madvise(p, m_size, MADV_SEQUENTIAL);
+
+        const FlowResultsHeader& h = GetHeader();
+        if (std::memcmp(h.magic, "FMS2", 4) != 0) {
+            return Fail(path + (std::memcmp(h.magic, "FMS1", 4) == 0 ? ": FMS1 file, rerun to get FMS2" : ": not an FMS2 file"));
+        }
+        if (h.headerSize > m_size || h.recordSize < sizeof(FlowResultRecord) ||
+            sizeof(h) + h.nFields * sizeof(FlowResultsField) + h.configSize > h.headerSize) {
+            return Fail(path + ": corrupt header");
+        }
+        // Every field this reader knows must be where it expects it
+        const FlowResultsField* fields = reinterpret_cast<const FlowResultsField*>(m_base + sizeof(h));
+        for (const FlowResultsField& want : FlowResultsSchema()) {
+            bool found = false;
+            for (uint32_t i = 0; i < h.nFields && !found; ++i) {
+                found = std::strncmp(fields[i].name, want.name, sizeof(want.name)) == 0 &&
+                        fields[i].type == want.type && fields[i].size == want.size && fields[i].offset == want.offset;
+            }
+            if (!found) {
+                return Fail(path + ": schema mismatch on field " + want.name);
+            }
+        }
+        m_records = m_base + h.headerSize;
+        m_stride = h.recordSize;
+        m_count = (m_size - h.headerSize) / m_stride;
+        return true;
+    }
+
+    void Close(void)
+    {
+        if (m_base != 0) {
+            munmap(const_cast<char*>(m_base), m_size);
+        }
+        m_base = 0;
+        m_size = 0;
+        m_count = 0;
+    }
+
+    const FlowResultsHeader& GetHeader(void) const { return *reinterpret_cast<const FlowResultsHeader*>(m_base); }
+
+    std::string GetConfig(void) const
+    {
+        const FlowResultsHeader& h = GetHeader();
+        return std::string(m_base + sizeof(h) + h.nFields * sizeof(FlowResultsField), h.configSize);
+    }
+
+    uint64_t GetNRecords(void) const { return m_count; }
+
+    const FlowResultRecord& GetRecord(uint64_t i) const
+    {
+        return *reinterpret_cast<const FlowResultRecord*>(m_records + i * m_stride);
+    }
+
+    const std::string& GetError(void) const { return m_error; }
+
+private:
+    bool Fail(const std::string& error)
+    {
+        Close();
+        m_error = error;
+        return false;
+    }
+
+    const char* m_base;
+    size_t m_size;
+    const char* m_records;
+    size_t m_stride;
+    uint64_t m_count;
+    std::string m_error;
+};
+
+} // namespace ns3
+
+#endif /* FLOW_RESULTS_FORMAT_H */
@@ -0,0 +1,175 @@
+/*
+ * Path-compressed binary (Patricia) trie for IPv4 longest-prefix match.
+ *
+ * Maps (prefix, length) to a 32-bit value. Every node stores its full
+ * prefix, so chains of single-child nodes never exist: a lookup only visits
+ * stored prefixes and branching points on the address's path (at most 33
+ * nodes, typically far fewer), independent of the number of prefixes. Nodes
+ * live in one vector and refer to each other by index, which keeps the
+ * structure compact (at most two nodes per prefix) and cache friendly.
+ *
+ * Erase only clears a node's value; structure is reclaimed by Clear().
+ */
+
+#ifndef IPV4_LPM_TRIE_H
+#define IPV4_LPM_TRIE_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace ns3
+{
+
+class Ipv4LpmTrie
+{
+public:
+    static constexpr uint32_t NO_MATCH = 0xffffffff;
+
+    Ipv4LpmTrie() { Clear(); }
+
+    void Clear(void)
+    {
+        m_nodes.assign(1, Node(0, 0, NO_MATCH)); // Root: 0.0.0.0/0
+        m_nPrefixes = 0;
+    }
+
+    // Sets the value for prefix/len and returns the previous one (NO_MATCH if new).
+    uint32_t Insert(uint32_t prefix, uint32_t len, uint32_t value)
+    {
+        prefix &= MaskOf(len);
+        uint32_t cur = 0;
+        for (;;) {
+            if (m_nodes[cur].len == len) {
+                uint32_t old = m_nodes[cur].value;
+                m_nodes[cur].value = value;
+                m_nPrefixes += old == NO_MATCH ? 1 : 0;
+                return old;
+            }
+            uint32_t bit = BitAt(prefix, m_nodes[cur].len);
+            uint32_t c = m_nodes[cur].child[bit];
+            if (c == 0) {
+                uint32_t leaf = NewNode(prefix, len, value);
+                m_nodes[cur].child[bit] = leaf;
+                ++m_nPrefixes;
+                return NO_MATCH;
+            }
+            uint32_t common = CommonLength(prefix, m_nodes[c].prefix, len, m_nodes[c].len);
+            if (common == m_nodes[c].len) {
+                cur = c;
+                continue;
+            }
+            // Split the edge cur -> c where the new prefix diverges
+            uint32_t mid = NewNode(prefix & MaskOf(common), common, NO_MATCH);
+            m_nodes[mid].child[BitAt(m_nodes[c].prefix, common)] = c;
+            m_nodes[cur].child[bit] = mid;
+            if (common == len) {
+                m_nodes[mid].value = value;
+            } else {
+                uint32_t leaf = NewNode(prefix, len, value);
+                m_nodes[mid].child[BitAt(prefix, common)] = leaf;
+            }
+            ++m_nPrefixes;
+            return NO_MATCH;
+        }
+    }
+
+    // Value stored for exactly prefix/len, or NO_MATCH.
+    uint32_t Find(uint32_t prefix, uint32_t len) const
+    {
+        uint32_t n = FindNode(prefix & MaskOf(len), len);
+        return n == NONE ? NO_MATCH : m_nodes[n].value;
+    }
+
+    // Removes prefix/len; returns its value, or NO_MATCH if it was absent.
+    uint32_t Erase(uint32_t prefix, uint32_t len)
+    {
+        uint32_t n = FindNode(prefix & MaskOf(len), len);
+        if (n == NONE || m_nodes[n].value == NO_MATCH) {
+            return NO_MATCH;
+        }
+        uint32_t old = m_nodes[n].value;
+        m_nodes[n].value = NO_MATCH;
+        --m_nPrefixes;
+        return old;
+    }
+
+    // Value of the longest prefix covering addr, or NO_MATCH.
+    uint32_t Lookup(uint32_t addr) const
+    {
+        uint32_t best = NO_MATCH;
+        uint32_t cur = 0;
+        for (;;) {
+            const Node& n = m_nodes[cur];
+            if (((addr ^ n.prefix) & n.mask) != 0) {
+                break;
+            }
+            if (n.value != NO_MATCH) {
+                best = n.value;
+            }
+            if (n.len == 32 || (cur = n.child[BitAt(addr, n.len)]) == 0) {
+                break;
+            }
+        }
+        return best;
+    }
+
+    uint32_t GetNPrefixes(void) const { return m_nPrefixes; }
+    uint32_t GetNNodes(void) const { return static_cast<uint32_t>(m_nodes.size()); }
+
+    static uint32_t MaskOf(uint32_t len) { return len == 0 ? 0 : 0xffffffffu << (32 - len); }
+
+private:
+    static constexpr uint32_t NONE = 0xffffffff;
+
+    struct Node
+    {
+        Node(uint32_t p, uint32_t l, uint32_t v) : prefix(p), mask(MaskOf(l)), len(l), value(v) { child[0] = child[1] = 0; }
+
+        uint32_t prefix;
+        uint32_t mask;
+        uint32_t len;
+        uint32_t value;
+        uint32_t child[2];   // 0 = none (the root is never a child)
+    };
+
+    // Bit 'pos' counted from the most significant end; pos < 32.
+    static uint32_t BitAt(uint32_t v, uint32_t pos) { return (v >> (31 - pos)) & 1; }
+
+    static uint32_t CommonLength(uint32_t a, uint32_t b, uint32_t lenA, uint32_t lenB)
+    {
+        uint32_t x = a ^ b;
+        uint32_t common = x == 0 ? 32 : static_cast<uint32_t>(__builtin_clz(x));
+        common = common < lenA ? common : lenA;
+        return common < lenB ? common : lenB;
+    }
+
+    uint32_t NewNode(uint32_t prefix, uint32_t len, uint32_t value)
+    {
+        m_nodes.push_back(Node(prefix, len, value));
+        return static_cast<uint32_t>(m_nodes.size() - 1);
+    }
+
+    uint32_t FindNode(uint32_t prefix, uint32_t len) const
+    {
+        uint32_t cur = 0;
+        for (;;) {
+            const Node& n = m_nodes[cur];
+            if (n.len > len || ((prefix ^ n.prefix) & n.mask) != 0) {
+                return NONE;
+            }
+            if (n.len == len) {
+                return cur;
+            }
+            if ((cur = n.child[BitAt(prefix, n.len)]) == 0) {
+                return NONE;
+            }
+        }
+    }
+
+    std::vector<Node> m_nodes;
+    uint32_t m_nPrefixes;
+};
+
+} // namespace ns3
+
+#endif /* IPV4_LPM_TRIE_H */
@@ -0,0 +1,174 @@
+/*
+ * Ipv4TrieRouting Benchmark
+ * Route lookups per second at 100, 10k and 500k prefixes for Ipv4TrieRouting
+ * (RouteOutput, and the bare Ipv4LpmTrie underneath it) against
+ * Ipv4StaticRouting, whose lookup scans every network route.
+ *
+ * Ipv4StaticRouting also scans its table on every insert (duplicate check),
+ * so filling it is quadratic; it is skipped above --staticMax prefixes.
+ *
+ * Usage: ./ns3 run "scratch/ipv4-trie-routing-benchmark --lookups=1000000"
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/network-module.h"
+#include "ipv4-trie-routing.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("Ipv4TrieRoutingBenchmark");
+
+static const uint32_t N_INTERFACES = 4;
+
+// Mostly /24s, as in a real table, with some shorter and longer prefixes.
+static uint32_t RandomLength(std::mt19937& rng)
+{
+    uint32_t r = rng() % 100;
+    if (r < 60) {
+        return 24;
+    } else if (r < 80) {
+        return 16 + rng() % 8;
+    } else if (r < 95) {
+        return 25 + rng() % 8;
+    }
+    return 8 + rng() % 8;
+}
+
+template <class T>
+static double TimeLookups(Ptr<T> rt, const std::vector<Ipv4Address>& keys, uint32_t lookups)
+{
+    Ipv4Header header;
+    Socket::SocketErrno err;
+    volatile uint32_t found = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < lookups; ++i) {
+        header.SetDestination(keys[i % keys.size()]);
+        found = found + (rt->RouteOutput(Ptr<Packet>(), header, 0, err) != 0 ? 1 : 0);
+    }
+    return lookups / std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t lookups = 1000000;
+    uint32_t staticMax = 10000;
+    uint32_t seed = 1;
+
+    CommandLine cmd;
+    cmd.AddValue("lookups", "Number of timed lookups per table size", lookups);
+    cmd.AddValue("staticMax", "Largest table also measured with Ipv4StaticRouting", staticMax);
+    cmd.AddValue("seed", "Seed for the prefix/address generator", seed);
+    cmd.Parse(argc, argv);
+
+    // One node with a few interfaces for the routes to point at
+    Ptr<Node> node = CreateObject<Node>();
+    InternetStackHelper stack;
+    stack.Install(node);
+    Ptr<SimpleChannel> channel = CreateObject<SimpleChannel>();
+    NetDeviceContainer devices;
+    for (uint32_t i = 0; i < N_INTERFACES; ++i) {
+        Ptr<SimpleNetDevice> dev = CreateObject<SimpleNetDevice>();
+        dev->SetAddress(Mac48Address::Allocate());
+        dev->SetChannel(channel);
+        node->AddDevice(dev);
+        devices.Add(dev);
+    }
+    Ipv4AddressHelper address;
+    address.SetBase("192.168.0.0", "255.255.255.0");
+    for (uint32_t i = 0; i < N_INTERFACES; ++i) {
+        address.Assign(NetDeviceContainer(devices.Get(i)));
+        address.NewNetwork();
+    }
+    Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
+
+    const uint32_t prefixCounts[] = {100, 10000, 500000};
+    const uint32_t NUM_KEYS = 8192;
+
+    std::cout << "\n--- IPv4 Route Lookup Benchmark (lookups/s) ---\n";
+    std::cout << std::setw(9) << "Prefixes" << std::setw(10) << "Nodes"
+              << std::setw(14) << "Trie (bare)" << std::setw(16) << "Ipv4TrieRouting"
+              << std::setw(18) << "Ipv4StaticRouting" << "\n";
+
+    for (uint32_t n : prefixCounts) {
+        std::mt19937 rng(seed);
+        bool withStatic = n <= staticMax;
+        Ptr<Ipv4TrieRouting> trie = CreateObject<Ipv4TrieRouting>();
+        trie->SetIpv4(ipv4);
+        Ptr<Ipv4StaticRouting> linear = CreateObject<Ipv4StaticRouting>();
+        if (withStatic) {
+            linear->SetIpv4(ipv4);
+        }
+        Ipv4LpmTrie bare;
+
+        std::vector<std::pair<uint32_t, uint32_t> > prefixes(n);
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t len = RandomLength(rng);
+            uint32_t prefix = rng() & Ipv4LpmTrie::MaskOf(len);
+            uint32_t ifIndex = 1 + rng() % N_INTERFACES;
+            Ipv4Address gateway(0xc0a80002 | ((ifIndex - 1) << 8)); // 192.168.x.2
+            prefixes[i] = std::make_pair(prefix, len);
+            trie->AddNetworkRouteTo(Ipv4Address(prefix), Ipv4Mask(Ipv4LpmTrie::MaskOf(len)), gateway, ifIndex);
+            if (withStatic) {
+                linear->AddNetworkRouteTo(Ipv4Address(prefix), Ipv4Mask(Ipv4LpmTrie::MaskOf(len)), gateway, ifIndex);
+            }
+            bare.Insert(prefix, len, i);
+        }
+
+        // Half the keys fall inside a known prefix, half are random.
+        std::vector<Ipv4Address> keys(NUM_KEYS);
+        for (uint32_t i = 0; i < NUM_KEYS; ++i) {
+            uint32_t a = rng();
+            if (i & 1) {
+                const std::pair<uint32_t, uint32_t>& p = prefixes[rng() % n];
+                a = p.first | (a & ~Ipv4LpmTrie::MaskOf(p.second));
+            }
+            keys[i] = Ipv4Address(a);
+        }
+
+        // Sanity check: both tables must pick the same next hop.
+        if (withStatic) {
+            Ipv4Header header;
+            Socket::SocketErrno err;
+            for (uint32_t i = 0; i < NUM_KEYS; ++i) {
+                header.SetDestination(keys[i]);
+                Ptr<Ipv4Route> a = trie->RouteOutput(Ptr<Packet>(), header, 0, err);
+                Ptr<Ipv4Route> b = linear->RouteOutput(Ptr<Packet>(), header, 0, err);
+                NS_ABORT_MSG_UNLESS((a == 0) == (b == 0) &&
+                                    (a == 0 || (a->GetGateway() == b->GetGateway() &&
+                                                a->GetOutputDevice() == b->GetOutputDevice())),
+                                    "Trie and static routing disagree on " << keys[i]);
+            }
+        }
+
+        volatile uint32_t sink = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < lookups; ++i) {
+            sink = sink + bare.Lookup(keys[i % NUM_KEYS].Get());
+        }
+        double bareRate = lookups / std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        double trieRate = TimeLookups(trie, keys, lookups);
+
+        std::cout << std::setw(9) << n << std::setw(10) << trie->GetNTrieNodes()
+                  << std::scientific << std::setprecision(2)
+                  << std::setw(14) << bareRate << std::setw(16) << trieRate;
+        if (withStatic) {
+            // The scan is much slower at large tables; time fewer lookups.
+            uint32_t linearLookups = std::max<uint32_t>(1000, lookups / std::max<uint32_t>(1, n / 10));
+            std::cout << std::setw(18) << TimeLookups(linear, keys, linearLookups);
+        } else {
+            std::cout << std::setw(18) << "-";
+        }
+        std::cout << std::defaultfloat << "\n";
+
+        trie->Dispose();
+        linear->Dispose();
+    }
+    Simulator::Destroy();
+    return 0;
+}
@@ -0,0 +1,407 @@
+/*
+ * Ipv4TrieRouting: drop-in replacement for Ipv4StaticRouting's unicast
+ * table, with longest-prefix match done by an Ipv4LpmTrie instead of a
+ * linear scan over every network route.
+ *
+ * Same route API (AddNetworkRouteTo, AddHostRouteTo, SetDefaultRoute,
+ * GetRoute/GetMetric/RemoveRoute by insertion order), same selection rules
+ * (longest mask, then lowest metric, latest route on a full tie), same
+ * connected routes from interface/address notifications and the same
+ * PrintRoutingTable layout. Multicast routes are not supported.
+ *
+ * Routes sharing a prefix are chained in metric order behind one trie entry,
+ * so the chain head is always the route to use. Lookups restricted to an
+ * output device fall back to a scan, as only the head is indexed.
+ */
+
+#ifndef IPV4_TRIE_ROUTING_H
+#define IPV4_TRIE_ROUTING_H
+
+#include "ns3/internet-module.h"
+#include "ns3/ipv4-routing-helper.h"
+#include "ns3/ipv4-routing-protocol.h"
+#include "ns3/names.h"
+#include "ipv4-lpm-trie.h"
+
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace ns3
+{
+
+class Ipv4TrieRouting : public Ipv4RoutingProtocol
+{
+public:
+    static TypeId GetTypeId(void) {
+        static TypeId tid = TypeId("ns3::Ipv4TrieRouting")
+            .SetParent<Ipv4RoutingProtocol>()
+            .SetGroupName("Internet")
+            .AddConstructor<Ipv4TrieRouting>();
+        return tid;
+    }
+
+    Ipv4TrieRouting() {}
+    virtual ~Ipv4TrieRouting() {}
+
+    // Route API, as in Ipv4StaticRouting
+    void AddNetworkRouteTo(Ipv4Address network, Ipv4Mask networkMask, Ipv4Address nextHop,
+                           uint32_t interface, uint32_t metric = 0)
+    {
+        AddRoute(Ipv4RoutingTableEntry::CreateNetworkRouteTo(network, networkMask, nextHop, interface), metric);
+    }
+    void AddNetworkRouteTo(Ipv4Address network, Ipv4Mask networkMask, uint32_t interface, uint32_t metric = 0)
+    {
+        AddRoute(Ipv4RoutingTableEntry::CreateNetworkRouteTo(network, networkMask, interface), metric);
+    }
+    void AddHostRouteTo(Ipv4Address dest, Ipv4Address nextHop, uint32_t interface, uint32_t metric = 0)
+    {
+        AddRoute(Ipv4RoutingTableEntry::CreateHostRouteTo(dest, nextHop, interface), metric);
+    }
+    void AddHostRouteTo(Ipv4Address dest, uint32_t interface, uint32_t metric = 0)
+    {
+        AddRoute(Ipv4RoutingTableEntry::CreateHostRouteTo(dest, interface), metric);
+    }
+    void SetDefaultRoute(Ipv4Address nextHop, uint32_t interface, uint32_t metric = 0)
+    {
+        AddRoute(Ipv4RoutingTableEntry::CreateDefaultRoute(nextHop, interface), metric);
+    }
+
+    uint32_t GetNRoutes(void) const { return static_cast<uint32_t>(m_order.size()); }
+    Ipv4RoutingTableEntry GetRoute(uint32_t i) const { return m_slots[m_order[i]].route; }
+    uint32_t GetMetric(uint32_t i) const { return m_slots[m_order[i]].metric; }
+
+    void RemoveRoute(uint32_t i)
+    {
+        NS_ASSERT(i < m_order.size());
+        Unlink(m_order[i]);
+        m_order.erase(m_order.begin() + i);
+    }
+
+    // Ipv4RoutingProtocol
+    virtual Ptr<Ipv4Route> RouteOutput(Ptr<Packet> p, const Ipv4Header& header, Ptr<NetDevice> oif,
+                                       Socket::SocketErrno& sockerr) override
+    {
+        Ptr<Ipv4Route> rtentry = Lookup(header.GetDestination(), oif);
+        sockerr = rtentry != 0 ? Socket::ERROR_NOTERROR : Socket::ERROR_NOROUTETOHOST;
+        return rtentry;
+    }
+
+    virtual bool RouteInput(Ptr<const Packet> p, const Ipv4Header& header, Ptr<const NetDevice> idev,
+                            UnicastForwardCallback ucb, MulticastForwardCallback mcb,
+                            LocalDeliverCallback lcb, ErrorCallback ecb) override
+    {
+        NS_ASSERT(m_ipv4 != 0 && m_ipv4->GetInterfaceForDevice(idev) >= 0);
+        uint32_t iif = m_ipv4->GetInterfaceForDevice(idev);
+        if (header.GetDestination().IsMulticast()) {
+            return false; // No multicast routes; let another protocol try
+        }
+        if (m_ipv4->IsDestinationAddress(header.GetDestination(), iif)) {
+            if (lcb.IsNull()) {
+                return false;
+            }
+            lcb(p, header, iif);
+            return true;
+        }
+        if (!m_ipv4->IsForwarding(iif)) {
+            ecb(p, header, Socket::ERROR_NOROUTETOHOST);
+            return true;
+        }
+        Ptr<Ipv4Route> rtentry = Lookup(header.GetDestination(), 0);
+        if (rtentry == 0) {
+            return false;
+        }
+        ucb(rtentry, p, header);
+        return true;
+    }
+
+    virtual void NotifyInterfaceUp(uint32_t interface) override
+    {
+        for (uint32_t j = 0; j < m_ipv4->GetNAddresses(interface); j++) {
+            Ipv4InterfaceAddress a = m_ipv4->GetAddress(interface, j);
+            if (a.GetLocal() != Ipv4Address() && a.GetMask() != Ipv4Mask() && a.GetMask() != Ipv4Mask::GetOnes()) {
+                AddNetworkRouteTo(a.GetLocal().CombineMask(a.GetMask()), a.GetMask(), interface);
+            }
+        }
+    }
+
+    virtual void NotifyInterfaceDown(uint32_t interface) override
+    {
+        RemoveIf([interface](const Ipv4RoutingTableEntry& r) { return r.GetInterface() == interface; });
+    }
+
+    virtual void NotifyAddAddress(uint32_t interface, Ipv4InterfaceAddress address) override
+    {
+        if (!m_ipv4->IsUp(interface)) {
+            return;
+        }
+        if (address.GetLocal() != Ipv4Address() && address.GetMask() != Ipv4Mask::GetOnes()) {
+            AddNetworkRouteTo(address.GetLocal().CombineMask(address.GetMask()), address.GetMask(), interface);
+        }
+    }
+
+    virtual void NotifyRemoveAddress(uint32_t interface, Ipv4InterfaceAddress address) override
+    {
+        if (!m_ipv4->IsUp(interface)) {
+            return;
+        }
+        Ipv4Address network = address.GetLocal().CombineMask(address.GetMask());
+        Ipv4Mask mask = address.GetMask();
+        RemoveIf([interface, network, mask](const Ipv4RoutingTableEntry& r) {
+            return r.GetInterface() == interface && r.IsNetwork() &&
+                   r.GetDestNetwork() == network && r.GetDestNetworkMask() == mask;
+        });
+    }
+
+    virtual void SetIpv4(Ptr<Ipv4> ipv4) override
+    {
+        NS_ASSERT(m_ipv4 == 0 && ipv4 != 0);
+        m_ipv4 = ipv4;
+        for (uint32_t i = 0; i < m_ipv4->GetNInterfaces(); i++) {
+            if (m_ipv4->IsUp(i)) {
+                NotifyInterfaceUp(i);
+            } else {
+                NotifyInterfaceDown(i);
+            }
+        }
+    }
+
+    virtual void PrintRoutingTable(Ptr<OutputStreamWrapper> stream, Time::Unit unit = Time::S) const override
+    {
+        std::ostream* os = stream->GetStream();
+        std::ios oldState(nullptr);
+        oldState.copyfmt(*os);
+        *os << std::resetiosflags(std::ios::adjustfield) << std::setiosflags(std::ios::left);
+
+        *os << "Node: " << m_ipv4->GetObject<Node>()->GetId()
+            << ", Time: " << Now().As(unit)
+            << ", Local time: " << m_ipv4->GetObject<Node>()->GetLocalTime().As(unit)
+            << ", Ipv4TrieRouting table" << std::endl;
+        if (GetNRoutes() > 0) {
+            *os << "Destination     Gateway         Genmask         Flags Metric Ref    Use Iface" << std::endl;
+            for (uint32_t j = 0; j < GetNRoutes(); j++) {
+                std::ostringstream dest, gw, mask, flags;
+                Ipv4RoutingTableEntry route = GetRoute(j);
+                dest << route.GetDest();
+                *os << std::setw(16) << dest.str();
+                gw << route.GetGateway();
+                *os << std::setw(16) << gw.str();
+                mask << route.GetDestNetworkMask();
+                *os << std::setw(16) << mask.str();
+                flags << "U";
+                if (route.IsHost()) {
+                    flags << "H";
+                } else if (route.IsGateway()) {
+                    flags << "G";
+                }
+                *os << std::setw(6) << flags.str();
+                *os << std::setw(7) << GetMetric(j);
+                *os << "-" << "      ";   // Ref count not implemented
+                *os << "-" << "   ";      // Use not implemented
+                std::string name = Names::FindName(m_ipv4->GetNetDevice(route.GetInterface()));
+                if (name != "") {
+                    *os << name;
+                } else {
+                    *os << route.GetInterface();
+                }
+                *os << std::endl;
+            }
+        }
+        *os << std::endl;
+        (*os).copyfmt(oldState);
+    }
+
+    uint32_t GetNTrieNodes(void) const { return m_trie.GetNNodes(); }
+
+protected:
+    virtual void DoDispose(void) override
+    {
+        m_slots.clear();
+        m_free.clear();
+        m_order.clear();
+        m_trie.Clear();
+        m_ipv4 = 0;
+        Ipv4RoutingProtocol::DoDispose();
+    }
+
+private:
+    static constexpr uint32_t NO_SLOT = Ipv4LpmTrie::NO_MATCH;
+
+    struct Slot
+    {
+        Ipv4RoutingTableEntry route;
+        uint32_t metric;
+        uint32_t next;       // Next route for the same prefix, in metric order
+    };
+
+    static uint32_t PrefixOf(const Ipv4RoutingTableEntry& r) { return r.GetDestNetwork().Get(); }
+    static uint32_t LengthOf(const Ipv4RoutingTableEntry& r) { return r.GetDestNetworkMask().GetPrefixLength(); }
+
+    static bool SameRoute(const Slot& s, const Ipv4RoutingTableEntry& r, uint32_t metric)
+    {
+        return s.metric == metric && s.route.GetInterface() == r.GetInterface() &&
+               s.route.GetGateway() == r.GetGateway() && s.route.GetDestNetworkMask() == r.GetDestNetworkMask();
+    }
+
+    void AddRoute(const Ipv4RoutingTableEntry& route, uint32_t metric)
+    {
+        uint32_t prefix = PrefixOf(route);
+        uint32_t len = LengthOf(route);
+        uint32_t head = m_trie.Find(prefix, len);
+
+        // Find the insertion point: before the first route with metric >= ours,
+        // so on a full tie the newest route is selected, as in Ipv4StaticRouting.
+        uint32_t prev = NO_SLOT;
+        uint32_t cur = head;
+        for (uint32_t s = head; s != NO_SLOT; s = m_slots[s].next) {
+            if (SameRoute(m_slots[s], route, metric)) {
+                return; // Already present
+            }
+        }
+        while (cur != NO_SLOT && m_slots[cur].metric < metric) {
+            prev = cur;
+            cur = m_slots[cur].next;
+        }
+
+        uint32_t slot;
+        if (!m_free.empty()) {
+            slot = m_free.back();
+            m_free.pop_back();
+        } else {
+            slot = static_cast<uint32_t>(m_slots.size());
+            m_slots.push_back(Slot());
+        }
+        m_slots[slot].route = route;
+        m_slots[slot].metric = metric;
+        m_slots[slot].next = cur;
+        if (prev == NO_SLOT) {
+            m_trie.Insert(prefix, len, slot);
+        } else {
+            m_slots[prev].next = slot;
+        }
+        m_order.push_back(slot);
+    }
+
+    // Takes a slot out of its prefix chain and frees it; m_order is the caller's.
+    void Unlink(uint32_t slot)
+    {
+        const Ipv4RoutingTableEntry& route = m_slots[slot].route;
+        uint32_t prefix = PrefixOf(route);
+        uint32_t len = LengthOf(route);
+        uint32_t head = m_trie.Find(prefix, len);
+        if (head == slot) {
+            if (m_slots[slot].next == NO_SLOT) {
+                m_trie.Erase(prefix, len);
+            } else {
+                m_trie.Insert(prefix, len, m_slots[slot].next);
+            }
+        } else {
+            uint32_t prev = head;
+            while (m_slots[prev].next != slot) {
+                prev = m_slots[prev].next;
+            }
+            m_slots[prev].next = m_slots[slot].next;
+        }
+        m_free.push_back(slot);
+    }
+
+    template <class Pred>
+    void RemoveIf(Pred pred)
+    {
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < m_order.size(); ++i) {
+            if (pred(m_slots[m_order[i]].route)) {
+                Unlink(m_order[i]);
+            } else {
+                m_order[kept++] = m_order[i];
+            }
+        }
+        m_order.resize(kept);
+    }
+
+    Ptr<Ipv4Route> Lookup(Ipv4Address dest, Ptr<NetDevice> oif) const
+    {
+        if (dest.IsLocalMulticast()) {
+            NS_ASSERT_MSG(oif, "Try to send on link-local multicast address, and no interface index is given!");
+            Ptr<Ipv4Route> rtentry = Create<Ipv4Route>();
+            rtentry->SetDestination(dest);
+            rtentry->SetGateway(Ipv4Address::GetZero());
+            rtentry->SetOutputDevice(oif);
+            rtentry->SetSource(m_ipv4->GetAddress(m_ipv4->GetInterfaceForDevice(oif), 0).GetLocal());
+            return rtentry;
+        }
+
+        uint32_t slot = m_trie.Lookup(dest.Get());
+        if (slot != NO_SLOT && oif != 0 && m_ipv4->GetNetDevice(m_slots[slot].route.GetInterface()) != oif) {
+            slot = ScanForDevice(dest, oif);
+        }
+        if (slot == NO_SLOT) {
+            return 0;
+        }
+
+        const Ipv4RoutingTableEntry& route = m_slots[slot].route;
+        uint32_t interfaceIdx = route.GetInterface();
+        Ptr<Ipv4Route> rtentry = Create<Ipv4Route>();
+        rtentry->SetDestination(route.GetDest());
+        rtentry->SetSource(m_ipv4->SourceAddressSelection(interfaceIdx, route.GetDest()));
+        rtentry->SetGateway(route.GetGateway());
+        rtentry->SetOutputDevice(m_ipv4->GetNetDevice(interfaceIdx));
+        return rtentry;
+    }
+
+    // Ipv4StaticRouting's selection restricted to routes out of 'oif'.
+    uint32_t ScanForDevice(Ipv4Address dest, Ptr<NetDevice> oif) const
+    {
+        uint32_t best = NO_SLOT;
+        int32_t longest = -1;
+        uint32_t shortestMetric = 0xffffffff;
+        for (uint32_t s : m_order) {
+            const Slot& e = m_slots[s];
+            if (!e.route.GetDestNetworkMask().IsMatch(dest, e.route.GetDestNetwork()) ||
+                m_ipv4->GetNetDevice(e.route.GetInterface()) != oif) {
+                continue;
+            }
+            int32_t len = static_cast<int32_t>(LengthOf(e.route));
+            if (len < longest) {
+                continue;
+            }
+            if (len > longest) {
+                shortestMetric = 0xffffffff;
+            }
+            longest = len;
+            if (e.metric > shortestMetric) {
+                continue;
+            }
+            shortestMetric = e.metric;
+            best = s;
+        }
+        return best;
+    }
+
+    Ptr<Ipv4> m_ipv4;
+    Ipv4LpmTrie m_trie;               // Prefix -> head slot of its chain
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_free;
+    std::vector<uint32_t> m_order;    // Slots in insertion order (GetRoute index)
+};
+
+// Installs Ipv4TrieRouting, e.g. in an Ipv4ListRoutingHelper in place of
+// Ipv4StaticRoutingHelper.
+class Ipv4TrieRoutingHelper : public Ipv4RoutingHelper
+{
+public:
+    virtual Ipv4TrieRoutingHelper* Copy(void) const override { return new Ipv4TrieRoutingHelper(*this); }
+    virtual Ptr<Ipv4RoutingProtocol> Create(Ptr<Node> node) const override
+    {
+        return CreateObject<Ipv4TrieRouting>();
+    }
+
+    Ptr<Ipv4TrieRouting> GetTrieRouting(Ptr<Ipv4> ipv4) const
+    {
+        return Ipv4RoutingHelper::GetRouting<Ipv4TrieRouting>(ipv4->GetRoutingProtocol());
+    }
+};
+
+} // namespace ns3
+
+#endif /* IPV4_TRIE_ROUTING_H */
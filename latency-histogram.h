@@ -0,0 +1,136 @@
+/*
+ * Log-bucketed (HDR-style) latency histogram.
+ *
+ * Values are nanoseconds. Each power of two is split into 16 linear
+ * sub-buckets, so any recorded value is reported within ~3% for the whole
+ * range from 1ns to centuries, using a fixed array of 976 counters.
+ * Histograms with the same layout merge by adding counters: O(buckets),
+ * regardless of how many samples went into them.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include "ns3/histogram.h"
+#include "ns3/nstime.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace ns3
+{
+
+class LatencyHistogram
+{
+public:
+    static const uint32_t SUB_BITS = 5;
+    static const uint32_t SUB_COUNT = 1u << SUB_BITS;         // Exact buckets for 0..31ns
+    static const uint32_t HALF_COUNT = SUB_COUNT / 2;         // Sub-buckets per power of two
+    static const uint32_t N_BUCKETS = SUB_COUNT + (63 - SUB_BITS + 1) * HALF_COUNT;
+
+    LatencyHistogram() : m_counts(N_BUCKETS, 0), m_total(0) {}
+
+    void Record(uint64_t valueNs, uint64_t count = 1)
+    {
+        m_counts[BucketOf(valueNs)] += count;
+        m_total += count;
+    }
+
+    void Record(Time value, uint64_t count = 1)
+    {
+        Record(value.IsNegative() ? 0 : static_cast<uint64_t>(value.GetNanoSeconds()), count);
+    }
+
+    // Adds a FlowMonitor delay/jitter histogram (linear bins, width in seconds),
+    // one bin at a time at the bin's midpoint.
+    void Record(const Histogram& h, double binWidth)
+    {
+        for (uint32_t i = 0; i < h.GetNBins(); ++i) {
+            uint32_t c = h.GetBinCount(i);
+            if (c > 0) {
+                Record(static_cast<uint64_t>((h.GetBinStart(i) + binWidth / 2) * 1e9), c);
+            }
+        }
+    }
+
+    void Merge(const LatencyHistogram& other)
+    {
+        for (uint32_t i = 0; i < N_BUCKETS; ++i) {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_total += other.m_total;
+    }
+
+    // Adds raw bucket counts (N_BUCKETS of them), e.g. GetCounts() of a
+    // histogram filled in another process.
+    void Merge(const uint64_t* counts)
+    {
+        for (uint32_t i = 0; i < N_BUCKETS; ++i) {
+            m_counts[i] += counts[i];
+            m_total += counts[i];
+        }
+    }
+
+    uint64_t GetCount(void) const { return m_total; }
+
+    // Value (ns) at quantile q in [0, 1]: the midpoint of the bucket holding
+    // the ceil(q * count)-th smallest sample. 0 for an empty histogram.
+    uint64_t GetPercentile(double q) const
+    {
+        if (m_total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(q * m_total + 0.999999);
+        rank = rank == 0 ? 1 : (rank > m_total ? m_total : rank);
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < N_BUCKETS; ++i) {
+            seen += m_counts[i];
+            if (seen >= rank) {
+                return (LowerBound(i) + UpperBound(i)) / 2;
+            }
+        }
+        return UpperBound(N_BUCKETS - 1);
+    }
+
+    double GetPercentileMs(double q) const { return GetPercentile(q) / 1e6; }
+
+    const std::vector<uint64_t>& GetCounts(void) const { return m_counts; }
+
+    static uint32_t BucketOf(uint64_t v)
+    {
+        if (v < SUB_COUNT) {
+            return static_cast<uint32_t>(v);
+        }
+        uint32_t msb = 63 - __builtin_clzll(v);
+        uint32_t shift = msb - (SUB_BITS - 1);          // Leaves v >> shift in [16, 32)
+        return SUB_COUNT + (shift - 1) * HALF_COUNT + static_cast<uint32_t>((v >> shift) - HALF_COUNT);
+    }
+
+    static uint64_t LowerBound(uint32_t bucket)
+    {
+        if (bucket < SUB_COUNT) {
+            return bucket;
+        }
+        uint32_t k = bucket - SUB_COUNT;
+        uint32_t shift = k / HALF_COUNT + 1;
+        return static_cast<uint64_t>(k % HALF_COUNT + HALF_COUNT) << shift;
+    }
+
+    static uint64_t UpperBound(uint32_t bucket)
+    {
+        if (bucket < SUB_COUNT) {
+            return bucket;
+        }
+        uint32_t k = bucket - SUB_COUNT;
+        uint32_t shift = k / HALF_COUNT + 1;
+        return ((static_cast<uint64_t>(k % HALF_COUNT + HALF_COUNT + 1) << shift) - 1);
+    }
+
+private:
+    std::vector<uint64_t> m_counts;
+    uint64_t m_total;
+};
+
+} // namespace ns3
+
+#endif /* LATENCY_HISTOGRAM_H */
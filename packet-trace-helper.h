@@ -0,0 +1,426 @@
+/*
+ * Selectable packet tracing for the point-to-point scenarios, as a cheaper
+ * alternative to PointToPointHelper::EnablePcapAll.
+ *
+ *   --trace=off       nothing
+ *   --trace=counters  per-device packet/byte/drop counters, one CSV at the end
+ *   --trace=sampled   counters + pcap of 1 in --traceSample packets per
+ *                     device, cut to the first --traceSnaplen bytes
+ *   --trace=full      counters + pcap of every packet, whole
+ *
+ * pcap files (<prefix>-<node>-<device>.pcap, as EnablePcapAll names them)
+ * are not written by the simulation thread: records are staged in a small
+ * per-file buffer, full buffers are packed into large blocks shared by all
+ * files, and full blocks go to a background thread that writes them out.
+ * The block pool is bounded, so a slow disk throttles the simulation
+ * instead of exhausting memory, and memory does not grow by a block per
+ * device.
+ *
+ * POSIX only (open/write).
+ */
+
+#ifndef PACKET_TRACE_HELPER_H
+#define PACKET_TRACE_HELPER_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/point-to-point-module.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace ns3
+{
+
+// Buffered writes to any number of files from one background thread.
+// Open() and Write() must only be called from one (the simulation) thread.
+// Each stream stages its records in a small buffer; full staging buffers are
+// copied into a large block shared by all streams, and full blocks go to the
+// thread. Memory is STAGE_SIZE per stream plus at most POOL_BLOCKS blocks.
+class AsyncTraceWriter
+{
+public:
+    static constexpr size_t STAGE_SIZE = 32 << 10;
+    static constexpr size_t BLOCK_SIZE = 1 << 20;
+    static constexpr size_t POOL_BLOCKS = 16;     // Blocks filling or waiting for the disk
+
+    AsyncTraceWriter() : m_stop(false), m_bytes(0), m_allocated(0) {}
+    ~AsyncTraceWriter() { Close(); }
+
+    // Returns the stream id for Write(), or -1 if the file cannot be created.
+    int Open(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return -1;
+        }
+        if (!m_thread.joinable()) {
+            m_stop = false;
+            m_thread = std::thread(&AsyncTraceWriter::Loop, this);
+        }
+        m_fds.push_back(fd);
+        m_stage.push_back(std::vector<char>());
+        m_stage.back().reserve(STAGE_SIZE);
+        return static_cast<int>(m_fds.size() - 1);
+    }
+
+    void Write(int stream, const void* data, size_t n)
+    {
+        std::vector<char>& stage = m_stage[stream];
+        m_bytes += n;
+        if (stage.size() + n > STAGE_SIZE) {
+            Flush(stream);
+        }
+        if (n >= STAGE_SIZE) {
+            Append(m_fds[stream], static_cast<const char*>(data), n); // Too big to stage
+            return;
+        }
+        stage.insert(stage.end(), static_cast<const char*>(data), static_cast<const char*>(data) + n);
+    }
+
+    // Flushes every stream, stops the thread and closes the files.
+    void Close(void)
+    {
+        if (!m_thread.joinable()) {
+            return;
+        }
+        for (uint32_t s = 0; s < m_stage.size(); ++s) {
+            Flush(s);
+        }
+        if (!m_block.data.empty()) {
+            Submit(true);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+        for (int fd : m_fds) {
+            close(fd);
+        }
+        m_fds.clear();
+        m_stage.clear();
+    }
+
+    uint64_t GetBytesWritten(void) const { return m_bytes; }
+
+private:
+    // A run of bytes in a block that goes to one file
+    struct Segment
+    {
+        int fd;
+        size_t length;
+    };
+
+    struct Block
+    {
+        std::vector<char> data;
+        std::vector<Segment> segments;
+    };
+
+    // Moves a stream's staged records into the shared block.
+    void Flush(int stream)
+    {
+        std::vector<char>& stage = m_stage[stream];
+        if (!stage.empty()) {
+            Append(m_fds[stream], stage.data(), stage.size());
+            stage.clear();
+        }
+    }
+
+    void Append(int fd, const char* data, size_t n)
+    {
+        if (m_block.data.capacity() == 0) {
+            m_block = NewBlock();
+        } else if (!m_block.data.empty() && m_block.data.size() + n > BLOCK_SIZE) {
+            Submit(false);
+        }
+        m_block.data.insert(m_block.data.end(), data, data + n);
+        if (!m_block.segments.empty() && m_block.segments.back().fd == fd) {
+            m_block.segments.back().length += n;
+        } else {
+            m_block.segments.push_back(Segment{fd, n});
+        }
+    }
+
+    // Waits for a written block, or allocates one while the pool has room.
+    Block NewBlock(void)
+    {
+        Block b;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done.wait(lock, [this] { return !m_free.empty() || m_allocated < POOL_BLOCKS; });
+            if (!m_free.empty()) {
+                b = std::move(m_free.back());
+                m_free.pop_back();
+                return b;
+            }
+            ++m_allocated;
+        }
+        b.data.reserve(BLOCK_SIZE);
+        return b;
+    }
+
+    // Hands the shared block to the thread; the last one gets no successor.
+    void Submit(bool last)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(std::move(m_block));
+        }
+        m_wake.notify_one();
+        m_block = last ? Block() : NewBlock();
+    }
+
+    void Loop(void)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                return; // Stopped and drained
+            }
+            Block b = std::move(m_queue.front());
+            m_queue.pop_front();
+            lock.unlock();
+
+            const char* p = b.data.data();
+            for (const Segment& seg : b.segments) {
+                const char* q = p;
+                size_t left = seg.length;
+                while (left > 0) {
+                    ssize_t n = write(seg.fd, q, left);
+                    if (n <= 0) {
+                        break;
+                    }
+                    q += n;
+                    left -= n;
+                }
+                p += seg.length;
+            }
+
+            lock.lock();
+            b.data.clear();
+            b.segments.clear();
+            m_free.push_back(std::move(b));
+            m_done.notify_one();
+        }
+    }
+
+    std::vector<int> m_fds;
+    std::vector<std::vector<char> > m_stage;     // Staged records, per stream
+    Block m_block;                               // Shared block being filled
+    std::deque<Block> m_queue;                   // Full blocks for the thread
+    std::vector<Block> m_free;                   // Written blocks, for reuse
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::thread m_thread;
+    bool m_stop;
+    uint64_t m_bytes;
+    size_t m_allocated;                          // Blocks in the pool so far
+};
+
+class PacketTraceHelper
+{
+public:
+    enum Level
+    {
+        OFF,
+        COUNTERS,
+        SAMPLED,
+        FULL
+    };
+
+    PacketTraceHelper() : m_levelName("full"), m_sample(100), m_snaplen(96), m_captured(0) {}
+
+    void AddCommandLineOptions(CommandLine& cmd)
+    {
+        cmd.AddValue("trace", "Tracing level: off, counters, sampled (pcap) or full (pcap)", m_levelName);
+        cmd.AddValue("traceSample", "Sampled tracing: capture 1 in N packets per device", m_sample);
+        cmd.AddValue("traceSnaplen", "Sampled tracing: bytes kept per packet (0 = whole packet)", m_snaplen);
+    }
+
+    Level GetLevel(void) const
+    {
+        if (m_levelName == "off") {
+            return OFF;
+        } else if (m_levelName == "counters") {
+            return COUNTERS;
+        } else if (m_levelName == "sampled") {
+            return SAMPLED;
+        } else if (m_levelName == "full") {
+            return FULL;
+        }
+        NS_ABORT_MSG("Unknown --trace " << m_levelName << "; use off, counters, sampled or full");
+        return OFF;
+    }
+
+    // Traces the devices; file names start with 'prefix'. Call before Simulator::Run().
+    void Install(const NetDeviceContainer& devices, const std::string& prefix)
+    {
+        Level level = GetLevel();
+        if (level == OFF) {
+            return;
+        }
+        m_prefix = prefix;
+        uint32_t every = level == SAMPLED ? std::max<uint32_t>(1, m_sample) : 1;
+        uint32_t snaplen = level == SAMPLED && m_snaplen > 0 ? m_snaplen : 65535;
+        for (uint32_t i = 0; i < devices.GetN(); ++i) {
+            Ptr<NetDevice> dev = devices.Get(i);
+            m_devices.push_back(std::unique_ptr<Device>(new Device(this, dev)));
+            Device* d = m_devices.back().get();
+            dev->TraceConnectWithoutContext("MacTx", MakeBoundCallback(&PacketTraceHelper::CountTx, d));
+            dev->TraceConnectWithoutContext("MacRx", MakeBoundCallback(&PacketTraceHelper::CountRx, d));
+            dev->TraceConnectWithoutContext("MacTxDrop", MakeBoundCallback(&PacketTraceHelper::CountDrop, d));
+            dev->TraceConnectWithoutContext("PhyTxDrop", MakeBoundCallback(&PacketTraceHelper::CountDrop, d));
+            dev->TraceConnectWithoutContext("PhyRxDrop", MakeBoundCallback(&PacketTraceHelper::CountDrop, d));
+
+            if (level < SAMPLED || DynamicCast<PointToPointNetDevice>(dev) == 0) {
+                continue;
+            }
+            std::ostringstream path;
+            path << prefix << '-' << dev->GetNode()->GetId() << '-' << dev->GetIfIndex() << ".pcap";
+            d->stream = m_writer.Open(path.str());
+            NS_ABORT_MSG_IF(d->stream < 0, "Cannot create " << path.str());
+            d->every = every;
+            d->snaplen = snaplen;
+            PcapFileHeader h = {0xa1b2c3d4, 2, 4, 0, 0, snaplen, PPP_LINKTYPE};
+            m_writer.Write(d->stream, &h, sizeof(h));
+            // The sniffer sees the packet with its PPP header, as EnablePcap does
+            dev->TraceConnectWithoutContext("PromiscSniffer", MakeBoundCallback(&PacketTraceHelper::Capture, d));
+        }
+    }
+
+    // Flushes the pcap files and writes <prefix>-counters.csv. Call after Simulator::Run().
+    void Finish(void)
+    {
+        if (m_devices.empty()) {
+            return;
+        }
+        m_writer.Close();
+        std::string path = m_prefix + "-counters.csv";
+        std::ofstream csv(path.c_str());
+        csv << "node,device,tx_packets,tx_bytes,rx_packets,rx_bytes,drops\n";
+        uint64_t tx = 0;
+        uint64_t rx = 0;
+        uint64_t drops = 0;
+        for (const std::unique_ptr<Device>& d : m_devices) {
+            csv << d->node << ',' << d->ifIndex << ',' << d->txPackets << ',' << d->txBytes << ','
+                << d->rxPackets << ',' << d->rxBytes << ',' << d->drops << '\n';
+            tx += d->txPackets;
+            rx += d->rxPackets;
+            drops += d->drops;
+        }
+        std::cout << "Trace counters (" << m_devices.size() << " devices): " << tx << " tx, " << rx
+                  << " rx, " << drops << " dropped -> " << path << "\n";
+        if (GetLevel() >= SAMPLED) {
+            std::cout << "Trace pcap: " << m_captured << " packets, " << m_writer.GetBytesWritten()
+                      << " bytes -> " << m_prefix << "-*.pcap\n";
+        }
+        m_devices.clear();
+    }
+
+private:
+    static constexpr uint32_t PPP_LINKTYPE = 9;
+
+    struct PcapFileHeader
+    {
+        uint32_t magic;
+        uint16_t versionMajor;
+        uint16_t versionMinor;
+        int32_t thisZone;
+        uint32_t sigFigs;
+        uint32_t snaplen;
+        uint32_t linkType;
+    };
+
+    struct PcapRecordHeader
+    {
+        uint32_t seconds;
+        uint32_t microseconds;
+        uint32_t inclLength;
+        uint32_t origLength;
+    };
+
+    struct Device
+    {
+        Device(PacketTraceHelper* h, Ptr<NetDevice> dev)
+            : helper(h), node(dev->GetNode()->GetId()), ifIndex(dev->GetIfIndex()), stream(-1),
+              every(1), snaplen(0), seen(0), txPackets(0), txBytes(0), rxPackets(0), rxBytes(0), drops(0)
+        {
+        }
+
+        PacketTraceHelper* helper;
+        uint32_t node;
+        uint32_t ifIndex;
+        int stream;             // AsyncTraceWriter stream, -1 if no pcap
+        uint32_t every;
+        uint32_t snaplen;
+        uint64_t seen;
+        uint64_t txPackets;
+        uint64_t txBytes;
+        uint64_t rxPackets;
+        uint64_t rxBytes;
+        uint64_t drops;
+    };
+
+    static void CountTx(Device* d, Ptr<const Packet> p)
+    {
+        d->txPackets++;
+        d->txBytes += p->GetSize();
+    }
+
+    static void CountRx(Device* d, Ptr<const Packet> p)
+    {
+        d->rxPackets++;
+        d->rxBytes += p->GetSize();
+    }
+
+    static void CountDrop(Device* d, Ptr<const Packet> p)
+    {
+        d->drops++;
+    }
+
+    static void Capture(Device* d, Ptr<const Packet> p)
+    {
+        if (d->seen++ % d->every != 0) {
+            return;
+        }
+        PacketTraceHelper* h = d->helper;
+        uint32_t size = p->GetSize();
+        uint32_t incl = size < d->snaplen ? size : d->snaplen;
+        int64_t us = Simulator::Now().GetMicroSeconds();
+        PcapRecordHeader r = {static_cast<uint32_t>(us / 1000000), static_cast<uint32_t>(us % 1000000), incl, size};
+        h->m_scratch.resize(incl);
+        p->CopyData(h->m_scratch.data(), incl);
+        h->m_writer.Write(d->stream, &r, sizeof(r));
+        h->m_writer.Write(d->stream, h->m_scratch.data(), incl);
+        h->m_captured++;
+    }
+
+    std::string m_levelName;
+    uint32_t m_sample;
+    uint32_t m_snaplen;
+    std::string m_prefix;
+    std::vector<std::unique_ptr<Device> > m_devices;
+    AsyncTraceWriter m_writer;
+    std::vector<uint8_t> m_scratch;
+    uint64_t m_captured;
+};
+
+} // namespace ns3
+
+#endif /* PACKET_TRACE_HELPER_H */
@@ -0,0 +1,168 @@
+/*
+ * PBR Classifier Benchmark
+ * Measures PbrClassifier lookup time at 10, 1k and 10k rules and compares it
+ * with a linear first-match scan over the same rule set, and the time to load
+ * the same rules into a PbrRouting (rule index plus the compiled DSCP table).
+ *
+ * Usage: ./ns3 run "scratch/pbr-classifier-benchmark --lookups=1000000"
+ */
+
+#include "ns3/core-module.h"
+#include "pbr-classifier.h"
+#include "pbr-routing.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("PbrClassifierBenchmark");
+
+// Builds a rule from one of a handful of shapes, as in a production policy set:
+// DSCP-only, destination prefix + DSCP, full 5-tuple, and port ranges.
+static PbrRule RandomRule(std::mt19937& rng, uint32_t index)
+{
+    PbrRule r;
+    r.priority = rng() % 1000;
+    switch (index % 4) {
+    case 0:
+        r.dscp = rng() % 64;
+        break;
+    case 1:
+        r.dscp = rng() % 64;
+        r.dstAddress = Ipv4Address(0x0a000000 | (rng() & 0x00ffff00));
+        r.dstMask = Ipv4Mask("255.255.255.0");
+        break;
+    case 2:
+        r.srcAddress = Ipv4Address(0x0a000000 | (rng() & 0x00ff0000));
+        r.srcMask = Ipv4Mask("255.255.0.0");
+        r.dstAddress = Ipv4Address(0x0a000000 | (rng() & 0x00ffff00));
+        r.dstMask = Ipv4Mask("255.255.255.0");
+        r.protocol = 17;
+        r.dstPortMin = r.dstPortMax = 1024 + rng() % 1024;
+        break;
+    default:
+        r.srcAddress = Ipv4Address(0x0a000000 | (rng() & 0x00ffff00));
+        r.srcMask = Ipv4Mask("255.255.255.0");
+        r.protocol = 6;
+        r.dstPortMin = rng() % 60000;
+        r.dstPortMax = r.dstPortMin + 100;
+        break;
+    }
+    return r;
+}
+
+// Reference first-match scan, i.e. what a naive rule list would do.
+static uint32_t LinearMatch(const PbrClassifier& c, const PbrFlowKey& k)
+{
+    uint32_t best = PbrClassifier::NO_MATCH;
+    for (uint32_t id = 0; id < c.GetRuleIdLimit(); ++id) {
+        if (!c.IsActive(id)) {
+            continue;
+        }
+        const PbrRule& r = c.GetRule(id);
+        bool ports = r.AnySrcPort() && r.AnyDstPort();
+        if (!ports && k.hasPorts) {
+            ports = k.srcPort >= r.srcPortMin && k.srcPort <= r.srcPortMax &&
+                    k.dstPort >= r.dstPortMin && k.dstPort <= r.dstPortMax;
+        }
+        if ((r.dscp < 0 || r.dscp == k.dscp) &&
+            (r.protocol < 0 || r.protocol == k.protocol) &&
+            (k.src & r.srcMask.Get()) == (r.srcAddress.Get() & r.srcMask.Get()) &&
+            (k.dst & r.dstMask.Get()) == (r.dstAddress.Get() & r.dstMask.Get()) && ports &&
+            (best == PbrClassifier::NO_MATCH ||
+             PbrClassifier::Outranks(r.priority, id, c.GetRule(best).priority, best))) {
+            best = id;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t lookups = 1000000;
+    uint32_t seed = 1;
+
+    CommandLine cmd;
+    cmd.AddValue("lookups", "Number of timed lookups per rule count", lookups);
+    cmd.AddValue("seed", "Seed for the rule/packet generator", seed);
+    cmd.Parse(argc, argv);
+
+    const uint32_t ruleCounts[] = {10, 1000, 10000};
+    const uint32_t NUM_KEYS = 4096;
+
+    std::cout << "\n--- PBR Classifier Lookup Benchmark ---\n";
+    std::cout << std::setw(8) << "Rules" << std::setw(8) << "Tuples"
+              << std::setw(14) << "TSS ns/pkt" << std::setw(16) << "Linear ns/pkt" << std::setw(16) << "PBR load ms" << "\n";
+
+    for (uint32_t n : ruleCounts) {
+        std::mt19937 rng(seed);
+        PbrClassifier classifier;
+        for (uint32_t i = 0; i < n; ++i) {
+            classifier.Add(RandomRule(rng, i), i);
+        }
+
+        // Half the keys are drawn from rules (hits), half are random (mostly misses).
+        std::vector<PbrFlowKey> keys(NUM_KEYS);
+        for (uint32_t i = 0; i < NUM_KEYS; ++i) {
+            PbrFlowKey& k = keys[i];
+            k.src = 0x0a000000 | (rng() & 0x00ffffff);
+            k.dst = 0x0a000000 | (rng() & 0x00ffffff);
+            k.dscp = rng() % 64;
+            k.protocol = (rng() & 1) ? 17 : 6;
+            k.srcPort = 49152 + rng() % 16384;
+            k.dstPort = rng() % 65536;
+            k.hasPorts = true;
+            if (i & 1) {
+                const PbrRule& r = classifier.GetRule(rng() % n);
+                k.src = (k.src & ~r.srcMask.Get()) | (r.srcAddress.Get() & r.srcMask.Get());
+                k.dst = (k.dst & ~r.dstMask.Get()) | (r.dstAddress.Get() & r.dstMask.Get());
+                k.dscp = r.dscp >= 0 ? r.dscp : k.dscp;
+                k.protocol = r.protocol >= 0 ? r.protocol : k.protocol;
+                k.dstPort = r.dstPortMin;
+            }
+        }
+
+        // Sanity check: both methods must agree before timing anything.
+        for (uint32_t i = 0; i < NUM_KEYS; ++i) {
+            NS_ABORT_MSG_UNLESS(classifier.Match(keys[i]) == LinearMatch(classifier, keys[i]),
+                                "Tuple space and linear scan disagree on key " << i);
+        }
+
+        volatile uint32_t sink = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < lookups; ++i) {
+            sink = sink + classifier.Lookup(keys[i % NUM_KEYS]);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+
+        // The linear scan is much slower at large rule counts; time fewer lookups.
+        uint32_t linearLookups = std::max<uint32_t>(1000, lookups / std::max<uint32_t>(1, n / 10));
+        for (uint32_t i = 0; i < linearLookups; ++i) {
+            sink = sink + LinearMatch(classifier, keys[i % NUM_KEYS]);
+        }
+        auto t2 = std::chrono::steady_clock::now();
+
+        // The same rules through PbrRouting's API, up to a usable DSCP table
+        std::mt19937 loadRng(seed);
+        Ptr<PbrRouting> pbr = CreateObject<PbrRouting>();
+        auto t3 = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < n; ++i) {
+            pbr->AddPolicyRule(RandomRule(loadRng, i), 1, Ipv4Address("10.0.0.1"));
+        }
+        pbr->Commit();
+        auto t4 = std::chrono::steady_clock::now();
+        pbr->Dispose();
+
+        double tssNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / lookups;
+        double linNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / linearLookups;
+        double loadMs = std::chrono::duration<double, std::milli>(t4 - t3).count();
+
+        std::cout << std::setw(8) << n << std::setw(8) << classifier.GetNTuples()
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(14) << tssNs << std::setw(16) << linNs << std::setw(16) << loadMs << "\n";
+    }
+    return 0;
+}
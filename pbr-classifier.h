@@ -0,0 +1,350 @@
+/*
+ * Multi-field packet classifier for Policy-Based Routing.
+ *
+ * Rules match on DSCP, source/destination prefix, IP protocol and
+ * source/destination port ranges. Lookup uses Tuple Space Search: rules are
+ * grouped by the combination of fields they specify ("tuple"), and each tuple
+ * is a hash table keyed on the masked header fields. A lookup costs one hash
+ * probe per tuple, so it depends on the number of distinct rule shapes, not on
+ * the number of rules.
+ *
+ * Port ranges that are neither exact nor wildcard are stored under a wildcard
+ * port and checked against the (short) bucket chain.
+ */
+
+#ifndef PBR_CLASSIFIER_H
+#define PBR_CLASSIFIER_H
+
+#include "ns3/ipv4-address.h"
+
+#include <algorithm>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3
+{
+
+// =================================================================
+// PbrRule: one policy. Fields left at their defaults are wildcards.
+// =================================================================
+struct PbrRule
+{
+    PbrRule()
+    : priority(0),
+      dscp(-1),
+      srcAddress(Ipv4Address::GetAny()),
+      srcMask(Ipv4Mask::GetZero()),
+      dstAddress(Ipv4Address::GetAny()),
+      dstMask(Ipv4Mask::GetZero()),
+      protocol(-1),
+      srcPortMin(0), srcPortMax(0xffff),
+      dstPortMin(0), dstPortMax(0xffff)
+    {}
+
+    uint32_t priority;    // Higher value wins; ties go to the older rule
+    int16_t dscp;         // 0..63, or -1 for any
+    Ipv4Address srcAddress;
+    Ipv4Mask srcMask;     // Must be contiguous (prefix) mask
+    Ipv4Address dstAddress;
+    Ipv4Mask dstMask;
+    int16_t protocol;     // IP protocol number, or -1 for any
+    uint16_t srcPortMin, srcPortMax;
+    uint16_t dstPortMin, dstPortMax;
+
+    bool AnySrcPort(void) const { return srcPortMin == 0 && srcPortMax == 0xffff; }
+    bool AnyDstPort(void) const { return dstPortMin == 0 && dstPortMax == 0xffff; }
+
+    // True if the rule constrains nothing but (optionally) the DSCP.
+    bool IsDscpOnly(void) const {
+        return srcMask.Get() == 0 && dstMask.Get() == 0 && protocol < 0 &&
+               AnySrcPort() && AnyDstPort();
+    }
+};
+
+// =================================================================
+// PbrFlowKey: the header fields a lookup is made on.
+// =================================================================
+struct PbrFlowKey
+{
+    PbrFlowKey()
+    : src(0), dst(0), srcPort(0), dstPort(0), dscp(0), protocol(0), hasPorts(false)
+    {}
+
+    uint32_t src;
+    uint32_t dst;
+    uint16_t srcPort;
+    uint16_t dstPort;
+    uint8_t dscp;
+    uint8_t protocol;
+    bool hasPorts;        // False when the L4 header is not available
+};
+
+// =================================================================
+// PbrClassifier: Tuple Space Search index over PbrRules
+// =================================================================
+class PbrClassifier
+{
+public:
+    static const uint32_t NO_MATCH = 0xffffffff;
+
+    PbrClassifier() : m_nActive(0) {}
+
+    // Adds a rule mapped to 'action'. Returns the rule id.
+    uint32_t Add(const PbrRule& rule, uint32_t action)
+    {
+        uint32_t id = static_cast<uint32_t>(m_rules.size());
+        Entry e;
+        e.rule = rule;
+        e.action = action;
+        e.active = true;
+        m_rules.push_back(e);
+        Insert(id);
+        ++m_nActive;
+        return id;
+    }
+
+    bool Remove(uint32_t id)
+    {
+        if (!IsActive(id)) {
+            return false;
+        }
+        Erase(id);
+        m_rules[id].active = false;
+        --m_nActive;
+        return true;
+    }
+
+    bool SetPriority(uint32_t id, uint32_t priority)
+    {
+        if (!IsActive(id)) {
+            return false;
+        }
+        Erase(id);
+        m_rules[id].rule.priority = priority;
+        Insert(id);
+        return true;
+    }
+
+    // Returns the id of the highest-ranked matching rule, or NO_MATCH.
+    uint32_t Match(const PbrFlowKey& key) const
+    {
+        uint32_t best = NO_MATCH;
+        for (std::vector<Tuple>::const_iterator t = m_tuples.begin(); t != m_tuples.end(); ++t) {
+            // Tuples are sorted by their best rule; nothing further can win.
+            if (best != NO_MATCH && !Outranks(t->maxPriority, 0, m_rules[best].rule.priority, best)) {
+                break;
+            }
+            if ((t->fields & (F_SRC_PORT | F_DST_PORT | F_PORT_RANGE)) && !key.hasPorts) {
+                continue;
+            }
+            BucketMap::const_iterator b = t->buckets.find(MaskKey(*t, key));
+            if (b == t->buckets.end()) {
+                continue;
+            }
+            for (std::vector<uint32_t>::const_iterator r = b->second.begin(); r != b->second.end(); ++r) {
+                const PbrRule& rule = m_rules[*r].rule;
+                if (best != NO_MATCH && !Outranks(rule.priority, *r, m_rules[best].rule.priority, best)) {
+                    break;
+                }
+                if (InRanges(rule, key)) {
+                    best = *r;
+                    break;
+                }
+            }
+        }
+        return best;
+    }
+
+    // Returns the action of the highest-ranked matching rule, or NO_MATCH.
+    uint32_t Lookup(const PbrFlowKey& key) const
+    {
+        uint32_t id = Match(key);
+        return id == NO_MATCH ? NO_MATCH : m_rules[id].action;
+    }
+
+    bool IsActive(uint32_t id) const { return id < m_rules.size() && m_rules[id].active; }
+    const PbrRule& GetRule(uint32_t id) const { return m_rules[id].rule; }
+    uint32_t GetAction(uint32_t id) const { return m_rules[id].action; }
+    // Upper bound on rule ids, for iterating with IsActive().
+    uint32_t GetRuleIdLimit(void) const { return static_cast<uint32_t>(m_rules.size()); }
+    uint32_t GetNRules(void) const { return m_nActive; }
+    uint32_t GetNTuples(void) const { return static_cast<uint32_t>(m_tuples.size()); }
+
+    // Rank order: higher priority first, then lower (older) id.
+    static bool Outranks(uint32_t prioA, uint32_t idA, uint32_t prioB, uint32_t idB)
+    {
+        return prioA > prioB || (prioA == prioB && idA < idB);
+    }
+
+private:
+    enum Fields {
+        F_DSCP = 1,
+        F_PROTO = 2,
+        F_SRC_PORT = 4,   // Exact source port in the hash key
+        F_DST_PORT = 8,   // Exact destination port in the hash key
+        F_PORT_RANGE = 16 // Some rule needs a residual port range check
+    };
+
+    struct Entry
+    {
+        PbrRule rule;
+        uint32_t action;
+        bool active;
+    };
+
+    struct Key
+    {
+        uint64_t addrs;   // src << 32 | dst
+        uint64_t rest;    // dscp, protocol, ports
+        bool operator==(const Key& o) const { return addrs == o.addrs && rest == o.rest; }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& k) const
+        {
+            uint64_t h = k.addrs * 0x9e3779b97f4a7c15ULL ^ (k.rest + 0x7f4a7c159e3779b9ULL);
+            h ^= h >> 31;
+            h *= 0xbf58476d1ce4e5b9ULL;
+            h ^= h >> 29;
+            return static_cast<size_t>(h);
+        }
+    };
+
+    typedef std::unordered_map<Key, std::vector<uint32_t>, KeyHash> BucketMap;
+
+    struct Tuple
+    {
+        uint32_t srcMask;
+        uint32_t dstMask;
+        uint32_t fields;
+        uint32_t maxPriority;
+        uint32_t nRules;
+        BucketMap buckets;  // Each chain sorted by rank
+    };
+
+    static uint32_t FieldsOf(const PbrRule& r)
+    {
+        uint32_t f = 0;
+        if (r.dscp >= 0) f |= F_DSCP;
+        if (r.protocol >= 0) f |= F_PROTO;
+        if (r.srcPortMin == r.srcPortMax) f |= F_SRC_PORT;
+        if (r.dstPortMin == r.dstPortMax) f |= F_DST_PORT;
+        if ((!r.AnySrcPort() && !(f & F_SRC_PORT)) || (!r.AnyDstPort() && !(f & F_DST_PORT))) {
+            f |= F_PORT_RANGE;
+        }
+        return f;
+    }
+
+    static Key MakeKey(uint32_t fields, uint32_t src, uint32_t dst, uint8_t dscp,
+                       uint8_t proto, uint16_t sport, uint16_t dport)
+    {
+        Key k;
+        k.addrs = (static_cast<uint64_t>(src) << 32) | dst;
+        k.rest = (static_cast<uint64_t>((fields & F_DSCP) ? dscp : 0) << 40) |
+                 (static_cast<uint64_t>((fields & F_PROTO) ? proto : 0) << 32) |
+                 (static_cast<uint64_t>((fields & F_SRC_PORT) ? sport : 0) << 16) |
+                 static_cast<uint64_t>((fields & F_DST_PORT) ? dport : 0);
+        return k;
+    }
+
+    static Key MaskKey(const Tuple& t, const PbrFlowKey& key)
+    {
+        return MakeKey(t.fields, key.src & t.srcMask, key.dst & t.dstMask, key.dscp,
+                       key.protocol, key.srcPort, key.dstPort);
+    }
+
+    Key RuleKey(const PbrRule& r, uint32_t fields) const
+    {
+        return MakeKey(fields, r.srcAddress.Get() & r.srcMask.Get(),
+                       r.dstAddress.Get() & r.dstMask.Get(), static_cast<uint8_t>(r.dscp),
+                       static_cast<uint8_t>(r.protocol), r.srcPortMin, r.dstPortMin);
+    }
+
+    static bool InRanges(const PbrRule& r, const PbrFlowKey& key)
+    {
+        if (r.AnySrcPort() && r.AnyDstPort()) {
+            return true;
+        }
+        return key.hasPorts &&
+               key.srcPort >= r.srcPortMin && key.srcPort <= r.srcPortMax &&
+               key.dstPort >= r.dstPortMin && key.dstPort <= r.dstPortMax;
+    }
+
+    Tuple* FindTuple(uint32_t srcMask, uint32_t dstMask, uint32_t fields)
+    {
+        for (std::vector<Tuple>::iterator t = m_tuples.begin(); t != m_tuples.end(); ++t) {
+            if (t->srcMask == srcMask && t->dstMask == dstMask && t->fields == fields) {
+                return &(*t);
+            }
+        }
+        return 0;
+    }
+
+    void Insert(uint32_t id)
+    {
+        const PbrRule& r = m_rules[id].rule;
+        uint32_t fields = FieldsOf(r);
+        Tuple* t = FindTuple(r.srcMask.Get(), r.dstMask.Get(), fields);
+        if (t == 0) {
+            Tuple nt;
+            nt.srcMask = r.srcMask.Get();
+            nt.dstMask = r.dstMask.Get();
+            nt.fields = fields;
+            nt.maxPriority = r.priority;
+            nt.nRules = 0;
+            m_tuples.push_back(nt);
+            t = &m_tuples.back();
+        }
+        std::vector<uint32_t>& chain = t->buckets[RuleKey(r, fields)];
+        std::vector<uint32_t>::iterator pos = chain.begin();
+        while (pos != chain.end() && Outranks(m_rules[*pos].rule.priority, *pos, r.priority, id)) {
+            ++pos;
+        }
+        chain.insert(pos, id);
+        t->maxPriority = std::max(t->maxPriority, r.priority);
+        ++t->nRules;
+        SortTuples();
+    }
+
+    void Erase(uint32_t id)
+    {
+        const PbrRule& r = m_rules[id].rule;
+        uint32_t fields = FieldsOf(r);
+        Tuple* t = FindTuple(r.srcMask.Get(), r.dstMask.Get(), fields);
+        BucketMap::iterator b = t->buckets.find(RuleKey(r, fields));
+        b->second.erase(std::find(b->second.begin(), b->second.end(), id));
+        if (b->second.empty()) {
+            t->buckets.erase(b);
+        }
+        if (--t->nRules == 0) {
+            m_tuples.erase(m_tuples.begin() + (t - &m_tuples[0]));
+        } else if (r.priority == t->maxPriority) {
+            // Chains are rank-sorted, so only their heads need inspecting.
+            t->maxPriority = 0;
+            for (BucketMap::const_iterator c = t->buckets.begin(); c != t->buckets.end(); ++c) {
+                t->maxPriority = std::max(t->maxPriority, m_rules[c->second.front()].rule.priority);
+            }
+        }
+        SortTuples();
+    }
+
+    struct TupleOrder
+    {
+        bool operator()(const Tuple& a, const Tuple& b) const { return a.maxPriority > b.maxPriority; }
+    };
+
+    void SortTuples(void)
+    {
+        std::stable_sort(m_tuples.begin(), m_tuples.end(), TupleOrder());
+    }
+
+    std::vector<Entry> m_rules;   // Indexed by rule id
+    std::vector<Tuple> m_tuples;  // Sorted by maxPriority, descending
+    uint32_t m_nActive;
+};
+
+} // namespace ns3
+
+#endif /* PBR_CLASSIFIER_H */
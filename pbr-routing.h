@@ -0,0 +1,890 @@
+/*
+ * PbrRouting: policy-based routing by DSCP and multi-field rules
+ * (pbr-classifier.h), with ECMP/flowlet groups, an adaptive spill onto a
+ * second path under congestion, precomputed backup next hops for fast
+ * reroute and a fallback protocol for unmatched traffic. Every DSCP whose
+ * outcome does not depend on other fields is compiled into a 64-entry route
+ * table, so the common case is one array lookup per packet.
+ *
+ * Logs under the "PbrRouting" component: events (failover, spill) at INFO,
+ * per-packet decisions at LOGIC and only in builds with logging
+ * (PBR_PACKET_LOG). Decisions are always counted per DSCP class in a fixed
+ * array (GetDecisionCounter, PrintDecisionCounters), which is what large
+ * runs should read instead of logs.
+ */
+
+#ifndef PBR_ROUTING_H
+#define PBR_ROUTING_H
+
+#include "ns3/core-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/ipv4-route.h"
+#include "ns3/ipv4-routing-protocol.h"
+#include "ns3/network-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/traffic-control-module.h"
+#include "pbr-classifier.h"
+
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+// Per-packet logs. ns-3 optimized builds leave NS3_LOG_ENABLE undefined, so
+// these compile to nothing there, message formatting included; defining
+// PBR_NO_PACKET_LOG drops them from debug builds as well.
+#if defined(NS3_LOG_ENABLE) && !defined(PBR_NO_PACKET_LOG)
+#define PBR_PACKET_LOG(msg) NS_LOG_LOGIC(msg)
+#else
+#define PBR_PACKET_LOG(msg)
+#endif
+
+namespace ns3
+{
+
+namespace pbr
+{
+// Registers the component PbrRouting's g_log refers to. An inline variable
+// is one object program-wide, so any number of files may include this
+// header; NS_LOG_COMPONENT_DEFINE here would register it once per file.
+inline LogComponent g_component("PbrRouting", __FILE__);
+}
+
+class PbrRouting : public Ipv4RoutingProtocol
+{
+public:
+    static const uint8_t DSCP_VIDEO_EF = 0x2e; // Expedited Forwarding (VoIP/Video)
+    static const uint8_t DSCP_DATA_BE = 0x00;  // Best Effort (Data/FTP)
+
+    PbrRouting() : NS_LOG_TEMPLATE_DEFINE("PbrRouting"), m_rulesDirty(false), m_adaptive(false), m_failovers(0)
+    {
+        BuildRouteCache();
+    }
+
+    // Legacy two-path setup: installs DSCP EF -> video path, DSCP BE -> data path.
+    PbrRouting(Ipv4Address videoNextHop, Ipv4Address dataNextHop,
+               uint32_t videoIfIndex, uint32_t dataIfIndex)
+    : NS_LOG_TEMPLATE_DEFINE("PbrRouting"),
+      m_rulesDirty(false),
+      m_adaptive(false),
+      m_failovers(0)
+    {
+        PbrRule video;
+        video.dscp = DSCP_VIDEO_EF;
+        AddPolicyRule(video, videoIfIndex, videoNextHop);
+        PbrRule data;
+        data.dscp = DSCP_DATA_BE;
+        AddPolicyRule(data, dataIfIndex, dataNextHop);
+        Commit();
+    }
+
+    virtual ~PbrRouting() {}
+
+    static TypeId GetTypeId(void) {
+        static TypeId tid = TypeId("ns3::PbrRouting")
+            .SetParent<Ipv4RoutingProtocol>()
+            .SetGroupName("Internet");
+        return tid;
+    }
+
+    // Policy rule API. Rules are returned an id; on overlap the highest
+    // priority wins (ties go to the rule added first). Changes only mark the
+    // DSCP table stale: it is recompiled once, by Commit() or the first route
+    // query after them, so loading N rules costs one compilation, not N.
+    uint32_t AddPolicyRule(const PbrRule& rule, uint32_t ifIndex, Ipv4Address nextHop);
+    // ECMP variant: matching flows are spread over (ifIndices[i], nextHops[i])
+    // by a 5-tuple hash, so each flow stays on one path. With a nonzero
+    // flowletGap, a flow that pauses longer than the gap starts a new flowlet
+    // that may take another member (the least queued one in adaptive mode);
+    // a gap above the path delay difference keeps packets in order.
+    uint32_t AddEcmpPolicyRule(const PbrRule& rule, const std::vector<uint32_t>& ifIndices,
+                               const std::vector<Ipv4Address>& nextHops, Time flowletGap = Seconds(0));
+    bool RemovePolicyRule(uint32_t ruleId);
+    bool SetPolicyRulePriority(uint32_t ruleId, uint32_t priority);
+    uint32_t GetNPolicyRules(void) const { return m_classifier.GetNRules(); }
+    // Recompiles the DSCP table now if rules changed since it was built.
+    void Commit(void)
+    {
+        if (m_rulesDirty) {
+            RefreshRoutes();
+        }
+    }
+
+    // Lower-priority protocol (e.g. Ipv4StaticRouting) that handles traffic no
+    // rule matches. It is called directly, never through m_ipv4, which would
+    // dispatch back into this PbrRouting instance.
+    void SetFallbackProtocol(Ptr<Ipv4RoutingProtocol> fallback);
+    Ptr<Ipv4RoutingProtocol> GetFallbackProtocol(void) const { return m_fallback; }
+
+    // Adaptive mode: every 'interval' the backlog of each PointToPointNetDevice
+    // (device queue + root queue disc) is converted into a queueing delay. A
+    // link is congested above 'highDelay' and stays so until below 'lowDelay'.
+    void EnableAdaptive(Time interval, Time highDelay, Time lowDelay);
+    // While the link on fromIfIndex is congested, moves a growing share of its
+    // flows onto the next hop registered on toIfIndex. The spill backs off as
+    // soon as toIfIndex itself congests, so the traffic already there (e.g.
+    // video) keeps its latency. Returns false if either next hop is unknown.
+    bool AddSpillPath(uint32_t fromIfIndex, uint32_t toIfIndex);
+
+    // Fast reroute: when the interface of (ifIndex, nextHop) goes down, its
+    // traffic moves to (backupIfIndex, backupNextHop). The backup must not
+    // route back through us (a loop-free alternate); that is up to the
+    // caller. Returns false if no rule uses (ifIndex, nextHop).
+    bool SetBackupNextHop(uint32_t ifIndex, Ipv4Address nextHop, uint32_t backupIfIndex, Ipv4Address backupNextHop);
+    // Interface-down notifications handled by switching to backups.
+    uint32_t GetNFailovers(void) const { return m_failovers; }
+
+    // Routing decision counters, per DSCP class (DSCP >> 3); route queries
+    // without a packet are not counted. Bytes are the IP payload including
+    // the L4 header, for local and forwarded packets alike.
+    enum Decision
+    {
+        POLICY_LOCAL,   // Locally sent, routed by policy
+        POLICY_FORWARD, // Forwarded, routed by policy
+        FALLBACK,       // Handed to the fallback protocol
+        NO_ROUTE,       // Unmatched and no fallback
+        N_DECISIONS
+    };
+    static const uint32_t N_DSCP_CLASSES = 8;
+    struct Counter
+    {
+        Counter() : packets(0), bytes(0) {}
+        uint64_t packets;
+        uint64_t bytes;
+    };
+    const Counter& GetDecisionCounter(Decision decision, uint32_t dscpClass) const
+    {
+        return m_counters[decision][dscpClass];
+    }
+    // Adds this instance's counters into 'sums', to report several routers as one.
+    void AccumulateDecisionCounters(Counter sums[N_DECISIONS][N_DSCP_CLASSES]) const;
+    void PrintDecisionCounters(std::ostream& os) const { PrintDecisionCounters(os, m_counters); }
+    static void PrintDecisionCounters(std::ostream& os, const Counter counters[N_DECISIONS][N_DSCP_CLASSES]);
+
+    // Required overrides
+    // Every interface/address change invalidates the cached routes, so each
+    // notification simply recompiles the tables (and is passed on to the
+    // fallback); only an interface going down takes the O(1) failover path.
+    virtual void SetIpv4(Ptr<Ipv4> ipv4) override;
+    virtual void NotifyInterfaceUp(uint32_t interface) override;
+    virtual void NotifyInterfaceDown(uint32_t interface) override;
+    virtual void NotifyAddAddress(uint32_t interface, Ipv4InterfaceAddress address) override;
+    virtual void NotifyRemoveAddress(uint32_t interface, Ipv4InterfaceAddress address) override;
+    
+    // Q2: Core PBR logic - using 'sockerr' instead of 'errno'
+    virtual Ptr<Ipv4Route> RouteOutput(Ptr<Packet> p, const Ipv4Header& header, 
+                                       Ptr<NetDevice> oif, Socket::SocketErrno& sockerr) override;
+    
+    // Correct signature for the second pure virtual function
+    virtual bool RouteInput(Ptr<const Packet> p, const Ipv4Header& header, Ptr<const NetDevice> idev, 
+                            UnicastForwardCallback ucb, MulticastForwardCallback mcb, 
+                            LocalDeliverCallback lcb, ErrorCallback ecb) override;
+                            
+    virtual void PrintRoutingTable(Ptr<OutputStreamWrapper> stream, Time::Unit unit = Time::S) const override;
+
+    // Builds the classifier key; L4 ports are read only if the packet carries
+    // them. Also used by the edge marker (traffic-conditioner.h).
+    static PbrFlowKey MakeFlowKey(const Ipv4Header& header, Ptr<const Packet> p, bool hasL4Header);
+
+protected:
+    virtual void DoDispose(void) override;
+
+private:
+    NS_LOG_TEMPLATE_DECLARE;   // Our own component, whatever the including file logs as
+
+    static const uint32_t DSCP_TABLE_SIZE = 64;   // DSCP is a 6-bit field
+    static const uint32_t CLASSIFY = 0xfffffffe;  // m_dscpAction: needs multi-field lookup
+    static const uint32_t NO_HOP = 0xffffffff;
+    static const uint32_t SPILL_ALL = 0x10000;    // Spill threshold covering the 16-bit flow hash
+    static const uint32_t FLOWLET_TABLE_SIZE = 4096; // Power of two
+
+    // A distinct (interface, next hop) pair that rules point at.
+    struct NextHop
+    {
+        uint32_t ifIndex;
+        Ipv4Address gateway;
+        Ptr<Ipv4Route> route;    // 0 while the interface is down/unaddressed
+        uint32_t spillTo;        // Adaptive alternate next hop, or NO_HOP
+        uint32_t spillThreshold; // Flows with (hash & 0xffff) below this use spillTo
+        uint32_t backup;         // Fast-reroute next hop while route is 0, or NO_HOP
+        std::vector<uint8_t> dscps; // Fast-path DSCPs whose table entry is this hop
+    };
+
+    // Last path taken by the flows hashing into one flowlet table slot.
+    struct Flowlet
+    {
+        int64_t lastSeen;        // Time steps
+        uint32_t member;
+    };
+
+    // What a rule points at: one next hop, or an ECMP group of them.
+    struct Action
+    {
+        std::vector<uint32_t> hops;     // Indices into m_nextHops; >1 = ECMP
+        int64_t flowletGap;             // Time steps; 0 = pure per-flow hashing
+        std::vector<Flowlet> flowlets;  // Preallocated, FLOWLET_TABLE_SIZE slots
+        uint32_t nextMember;            // Round-robin cursor for new flowlets
+    };
+
+    // Smoothed queueing state of one interface, updated by SampleLinks().
+    struct LinkState
+    {
+        LinkState() : delay(0), congested(false) {}
+        double delay;            // Seconds of backlog at the link rate
+        bool congested;
+    };
+
+    // Recompiles everything: rule outcomes per DSCP, then routes.
+    void BuildRouteCache(void) { CompileRules(); RefreshRoutes(); }
+    // Rule changes: CompileRules() waits for Commit() or the next query.
+    void InvalidateRules(void) { m_rulesDirty = true; }
+    // A hop's route, or its backup's while it is down (0 if both are).
+    Ptr<Ipv4Route> LiveRoute(const NextHop& hop) const
+    {
+        return hop.route != 0 || hop.backup == NO_HOP ? hop.route : m_nextHops[hop.backup].route;
+    }
+    // Drops the routes on 'interface' and repoints the affected table
+    // entries at their backups: no rule compilation, no route construction.
+    void FailOver(uint32_t interface);
+    // Derives, per DSCP, the deciding action (or CLASSIFY/NO_MATCH) from the rule set.
+    void CompileRules(void);
+    // Rebuilds next-hop routes from interface state and fills the fast table,
+    // compiling the rules first if they changed.
+    void RefreshRoutes(void);
+    uint32_t FindOrAddNextHop(uint32_t ifIndex, Ipv4Address gateway);
+    uint32_t AddAction(const PbrRule& rule, const Action& action);
+    // Picks the group member for a flow (ECMP hash or flowlet table).
+    uint32_t SelectMember(Action& action, uint32_t hash);
+    // Periodic adaptive sampler; reschedules itself.
+    void SampleLinks(void);
+    double GetQueueingDelay(uint32_t ifIndex) const;
+    static uint32_t FlowHash(const PbrFlowKey& key);
+    // Returns a route via (ifIndex, nextHop), or 0 if the interface is down/unaddressed.
+    Ptr<Ipv4Route> MakeRoute(uint32_t ifIndex, Ipv4Address nextHop) const;
+    // Slow path for DSCPs whose outcome depends on more than the DSCP: runs
+    // the multi-field lookup and/or the per-flow adaptive spill decision.
+    Ptr<Ipv4Route> SelectRoute(uint8_t dscp, const Ipv4Header& header, Ptr<const Packet> p,
+                               bool hasL4Header);
+
+    Ptr<Ipv4> m_ipv4;
+    Ptr<Ipv4RoutingProtocol> m_fallback; // 0 = unmatched traffic has no route
+    PbrClassifier m_classifier;       // Rule action = index into m_actions
+    std::vector<Action> m_actions;
+    std::vector<uint32_t> m_freeActions;          // Slots of removed rules' actions
+    std::vector<NextHop> m_nextHops;
+    uint32_t m_dscpAction[DSCP_TABLE_SIZE];       // Deciding action, CLASSIFY or NO_MATCH
+    Ptr<Ipv4Route> m_dscpRoutes[DSCP_TABLE_SIZE]; // 0 = no policy, use fallback
+    bool m_dscpSlow[DSCP_TABLE_SIZE];             // true = take SelectRoute()
+    bool m_rulesDirty;                            // m_dscpAction predates a rule change
+
+    bool m_adaptive;
+    Time m_sampleInterval;
+    Time m_highDelay;
+    Time m_lowDelay;
+    std::vector<LinkState> m_links;               // Indexed by interface
+    EventId m_sampleEvent;
+    uint32_t m_failovers;
+    Counter m_counters[N_DECISIONS][N_DSCP_CLASSES];
+};
+
+// =================================================================
+// PbrRouting Implementation
+// =================================================================
+
+inline void PbrRouting::SetFallbackProtocol(Ptr<Ipv4RoutingProtocol> fallback)
+{
+    NS_ASSERT_MSG(fallback != this, "PbrRouting cannot be its own fallback");
+    m_fallback = fallback;
+    if (m_fallback && m_ipv4) {
+        m_fallback->SetIpv4(m_ipv4);
+    }
+}
+
+inline void PbrRouting::SetIpv4(Ptr<Ipv4> ipv4)
+{
+    // Ipv4L3Protocol::SetRoutingProtocol calls this again after any manual
+    // SetIpv4; only forward a real change, as Ipv4StaticRouting asserts on a
+    // second SetIpv4.
+    if (m_fallback && ipv4 != m_ipv4) {
+        m_fallback->SetIpv4(ipv4);
+    }
+    m_ipv4 = ipv4;
+    RefreshRoutes();
+}
+
+inline void PbrRouting::NotifyInterfaceUp(uint32_t interface)
+{
+    if (m_fallback) {
+        m_fallback->NotifyInterfaceUp(interface);
+    }
+    RefreshRoutes();
+}
+
+inline void PbrRouting::NotifyInterfaceDown(uint32_t interface)
+{
+    if (m_fallback) {
+        m_fallback->NotifyInterfaceDown(interface);
+    }
+    FailOver(interface);
+}
+
+inline void PbrRouting::FailOver(uint32_t interface)
+{
+    bool affected = false;
+    for (NextHop& hop : m_nextHops) {
+        if (hop.ifIndex == interface && hop.route != 0) {
+            hop.route = 0;
+            affected = true;
+        }
+    }
+    if (!affected) {
+        return;
+    }
+    for (const NextHop& hop : m_nextHops) {
+        for (uint8_t d : hop.dscps) {
+            m_dscpRoutes[d] = LiveRoute(hop);
+        }
+    }
+    ++m_failovers;
+    NS_LOG_INFO("PBR: Interface " << interface << " down, rerouted to backups");
+}
+
+inline bool PbrRouting::SetBackupNextHop(uint32_t ifIndex, Ipv4Address nextHop, uint32_t backupIfIndex,
+                                         Ipv4Address backupNextHop)
+{
+    for (uint32_t h = 0; h < m_nextHops.size(); ++h) {
+        if (m_nextHops[h].ifIndex == ifIndex && m_nextHops[h].gateway == nextHop) {
+            uint32_t backup = FindOrAddNextHop(backupIfIndex, backupNextHop); // May grow m_nextHops
+            m_nextHops[h].backup = backup;
+            RefreshRoutes();
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void PbrRouting::NotifyAddAddress(uint32_t interface, Ipv4InterfaceAddress address)
+{
+    if (m_fallback) {
+        m_fallback->NotifyAddAddress(interface, address);
+    }
+    RefreshRoutes();
+}
+
+inline void PbrRouting::NotifyRemoveAddress(uint32_t interface, Ipv4InterfaceAddress address)
+{
+    if (m_fallback) {
+        m_fallback->NotifyRemoveAddress(interface, address);
+    }
+    RefreshRoutes();
+}
+
+inline void PbrRouting::DoDispose(void)
+{
+    m_sampleEvent.Cancel();
+    for (uint32_t d = 0; d < DSCP_TABLE_SIZE; ++d) {
+        m_dscpRoutes[d] = 0;
+    }
+    m_actions.clear();
+    m_freeActions.clear();
+    m_nextHops.clear();
+    m_fallback = 0;
+    m_ipv4 = 0;
+    Ipv4RoutingProtocol::DoDispose();
+}
+
+inline uint32_t PbrRouting::FindOrAddNextHop(uint32_t ifIndex, Ipv4Address gateway)
+{
+    for (uint32_t h = 0; h < m_nextHops.size(); ++h) {
+        if (m_nextHops[h].ifIndex == ifIndex && m_nextHops[h].gateway == gateway) {
+            return h;
+        }
+    }
+    NextHop hop;
+    hop.ifIndex = ifIndex;
+    hop.gateway = gateway;
+    hop.spillTo = NO_HOP;
+    hop.spillThreshold = 0;
+    hop.backup = NO_HOP;
+    m_nextHops.push_back(hop);
+    return static_cast<uint32_t>(m_nextHops.size() - 1);
+}
+
+inline uint32_t PbrRouting::AddAction(const PbrRule& rule, const Action& action)
+{
+    uint32_t slot;
+    if (!m_freeActions.empty()) {
+        slot = m_freeActions.back();
+        m_freeActions.pop_back();
+        m_actions[slot] = action;
+    } else {
+        slot = static_cast<uint32_t>(m_actions.size());
+        m_actions.push_back(action);
+    }
+    uint32_t id = m_classifier.Add(rule, slot);
+    InvalidateRules();
+    return id;
+}
+
+inline uint32_t PbrRouting::AddPolicyRule(const PbrRule& rule, uint32_t ifIndex, Ipv4Address nextHop)
+{
+    Action action;
+    action.hops.push_back(FindOrAddNextHop(ifIndex, nextHop));
+    action.flowletGap = 0;
+    action.nextMember = 0;
+    return AddAction(rule, action);
+}
+
+inline uint32_t PbrRouting::AddEcmpPolicyRule(const PbrRule& rule, const std::vector<uint32_t>& ifIndices,
+                                              const std::vector<Ipv4Address>& nextHops, Time flowletGap)
+{
+    NS_ASSERT_MSG(!ifIndices.empty() && ifIndices.size() == nextHops.size(),
+                  "ECMP rule needs one interface per next hop");
+    Action action;
+    for (uint32_t i = 0; i < ifIndices.size(); ++i) {
+        action.hops.push_back(FindOrAddNextHop(ifIndices[i], nextHops[i]));
+    }
+    action.flowletGap = flowletGap.GetTimeStep();
+    action.nextMember = 0;
+    if (action.flowletGap > 0) {
+        Flowlet unused;
+        unused.lastSeen = std::numeric_limits<int64_t>::min() / 2;
+        unused.member = 0;
+        action.flowlets.assign(FLOWLET_TABLE_SIZE, unused);
+    }
+    return AddAction(rule, action);
+}
+
+inline bool PbrRouting::RemovePolicyRule(uint32_t ruleId)
+{
+    if (!m_classifier.IsActive(ruleId)) {
+        return false;
+    }
+    // Free the action (an ECMP flowlet table is 4096 slots) for the next rule;
+    // m_dscpAction may still name it, but is recompiled before any query.
+    uint32_t slot = m_classifier.GetAction(ruleId);
+    m_classifier.Remove(ruleId);
+    m_actions[slot] = Action(); // Move-assigned: the old vectors' memory is released
+    m_freeActions.push_back(slot);
+    InvalidateRules();
+    return true;
+}
+
+inline bool PbrRouting::SetPolicyRulePriority(uint32_t ruleId, uint32_t priority)
+{
+    if (!m_classifier.SetPriority(ruleId, priority)) {
+        return false;
+    }
+    InvalidateRules();
+    return true;
+}
+
+inline void PbrRouting::CompileRules(void)
+{
+    // For each DSCP, find the top-ranked rule that can match it. If that rule
+    // looks at nothing but the DSCP, it decides every packet with this DSCP
+    // and the answer is cached; otherwise the packet needs the full lookup.
+    for (uint32_t d = 0; d < DSCP_TABLE_SIZE; ++d) {
+        uint32_t best = PbrClassifier::NO_MATCH;
+        for (uint32_t id = 0; id < m_classifier.GetRuleIdLimit(); ++id) {
+            if (!m_classifier.IsActive(id)) {
+                continue;
+            }
+            const PbrRule& r = m_classifier.GetRule(id);
+            if ((r.dscp < 0 || static_cast<uint32_t>(r.dscp) == d) &&
+                (best == PbrClassifier::NO_MATCH ||
+                 PbrClassifier::Outranks(r.priority, id, m_classifier.GetRule(best).priority, best))) {
+                best = id;
+            }
+        }
+        if (best == PbrClassifier::NO_MATCH) {
+            m_dscpAction[d] = PbrClassifier::NO_MATCH;
+        } else if (m_classifier.GetRule(best).IsDscpOnly()) {
+            m_dscpAction[d] = m_classifier.GetAction(best);
+        } else {
+            m_dscpAction[d] = CLASSIFY;
+        }
+    }
+    m_rulesDirty = false;
+}
+
+inline void PbrRouting::RefreshRoutes(void)
+{
+    if (m_rulesDirty) {
+        CompileRules();
+    }
+    for (uint32_t h = 0; h < m_nextHops.size(); ++h) {
+        m_nextHops[h].route = m_ipv4 ? MakeRoute(m_nextHops[h].ifIndex, m_nextHops[h].gateway)
+                                     : Ptr<Ipv4Route>();
+        m_nextHops[h].dscps.clear();
+    }
+
+    // A DSCP stays on the one-index fast path unless its action needs the
+    // classifier, hashes over an ECMP group or is spilling part of its flows.
+    for (uint32_t d = 0; d < DSCP_TABLE_SIZE; ++d) {
+        uint32_t action = m_dscpAction[d];
+        if (action == PbrClassifier::NO_MATCH) {
+            m_dscpSlow[d] = false;
+            m_dscpRoutes[d] = 0;
+            continue;
+        }
+        m_dscpSlow[d] = action == CLASSIFY || m_actions[action].hops.size() > 1 ||
+                        m_nextHops[m_actions[action].hops[0]].spillThreshold > 0;
+        if (m_dscpSlow[d]) {
+            m_dscpRoutes[d] = 0;
+            continue;
+        }
+        NextHop& hop = m_nextHops[m_actions[action].hops[0]];
+        m_dscpRoutes[d] = LiveRoute(hop);
+        hop.dscps.push_back(d);
+    }
+}
+
+inline void PbrRouting::EnableAdaptive(Time interval, Time highDelay, Time lowDelay)
+{
+    NS_ASSERT_MSG(lowDelay <= highDelay, "Adaptive PBR needs lowDelay <= highDelay");
+    m_adaptive = true;
+    m_sampleInterval = interval;
+    m_highDelay = highDelay;
+    m_lowDelay = lowDelay;
+    m_sampleEvent.Cancel();
+    m_sampleEvent = Simulator::Schedule(m_sampleInterval, &PbrRouting::SampleLinks, this);
+}
+
+inline bool PbrRouting::AddSpillPath(uint32_t fromIfIndex, uint32_t toIfIndex)
+{
+    uint32_t to = NO_HOP;
+    for (uint32_t h = 0; h < m_nextHops.size() && to == NO_HOP; ++h) {
+        if (m_nextHops[h].ifIndex == toIfIndex) {
+            to = h;
+        }
+    }
+    bool found = false;
+    for (uint32_t h = 0; h < m_nextHops.size() && to != NO_HOP; ++h) {
+        if (m_nextHops[h].ifIndex == fromIfIndex) {
+            m_nextHops[h].spillTo = to;
+            found = true;
+        }
+    }
+    return found;
+}
+
+inline double PbrRouting::GetQueueingDelay(uint32_t ifIndex) const
+{
+    Ptr<PointToPointNetDevice> dev = DynamicCast<PointToPointNetDevice>(m_ipv4->GetNetDevice(ifIndex));
+    if (dev == 0) {
+        return 0;
+    }
+    uint64_t backlog = dev->GetQueue()->GetNBytes();
+    Ptr<TrafficControlLayer> tc = dev->GetNode()->GetObject<TrafficControlLayer>();
+    Ptr<QueueDisc> qdisc = tc ? tc->GetRootQueueDiscOnDevice(dev) : Ptr<QueueDisc>();
+    if (qdisc != 0) {
+        backlog += qdisc->GetNBytes();
+    }
+    DataRateValue rate;
+    dev->GetAttribute("DataRate", rate);
+    return backlog * 8.0 / rate.Get().GetBitRate();
+}
+
+inline void PbrRouting::SampleLinks(void)
+{
+    // Queue-depth sampling runs once per interval, so the per-packet path
+    // only ever reads the resulting spill thresholds.
+    m_links.resize(m_ipv4->GetNInterfaces());
+    for (uint32_t i = 0; i < m_links.size(); ++i) {
+        LinkState& link = m_links[i];
+        link.delay = 0.5 * link.delay + 0.5 * GetQueueingDelay(i);
+        if (!link.congested && link.delay > m_highDelay.GetSeconds()) {
+            link.congested = true;
+        } else if (link.congested && link.delay < m_lowDelay.GetSeconds()) {
+            link.congested = false;
+        }
+    }
+
+    // Additive increase while our link is congested, halve as soon as the
+    // alternate congests, and drift home once our link has drained.
+    bool refresh = false;
+    for (uint32_t h = 0; h < m_nextHops.size(); ++h) {
+        NextHop& hop = m_nextHops[h];
+        if (hop.spillTo == NO_HOP) {
+            continue;
+        }
+        const LinkState& own = m_links[hop.ifIndex];
+        const LinkState& alt = m_links[m_nextHops[hop.spillTo].ifIndex];
+        uint32_t old = hop.spillThreshold;
+        if (alt.congested) {
+            hop.spillThreshold = hop.spillThreshold < SPILL_ALL / 64 ? 0 : hop.spillThreshold / 2;
+        } else if (own.congested) {
+            hop.spillThreshold = SPILL_ALL - hop.spillThreshold < SPILL_ALL / 8 ? SPILL_ALL : hop.spillThreshold + SPILL_ALL / 8;
+        } else if (own.delay < m_lowDelay.GetSeconds()) {
+            hop.spillThreshold = hop.spillThreshold < SPILL_ALL / 32 ? 0 : hop.spillThreshold - SPILL_ALL / 32;
+        }
+        if (hop.spillThreshold != old) {
+            NS_LOG_INFO("PBR: Adaptive spill from interface " << hop.ifIndex << " to "
+                        << m_nextHops[hop.spillTo].ifIndex << " now "
+                        << 100.0 * hop.spillThreshold / SPILL_ALL << "% of flows");
+        }
+        refresh = refresh || ((old == 0) != (hop.spillThreshold == 0));
+    }
+    if (refresh) {
+        RefreshRoutes();
+    }
+
+    m_sampleEvent = Simulator::Schedule(m_sampleInterval, &PbrRouting::SampleLinks, this);
+}
+
+inline uint32_t PbrRouting::FlowHash(const PbrFlowKey& key)
+{
+    uint64_t h = ((static_cast<uint64_t>(key.src) << 32) | key.dst) * 0x9e3779b97f4a7c15ULL;
+    h ^= ((static_cast<uint64_t>(key.srcPort) << 24) | (static_cast<uint64_t>(key.dstPort) << 8) |
+          key.protocol) + (h >> 29);
+    h *= 0xbf58476d1ce4e5b9ULL;
+    return static_cast<uint32_t>(h >> 32);
+}
+
+inline Ptr<Ipv4Route> PbrRouting::MakeRoute(uint32_t ifIndex, Ipv4Address nextHop) const
+{
+    if (ifIndex >= m_ipv4->GetNInterfaces() || !m_ipv4->IsUp(ifIndex) ||
+        m_ipv4->GetNAddresses(ifIndex) == 0) {
+        return 0;
+    }
+    Ptr<Ipv4Route> route = Create<Ipv4Route>();
+    route->SetSource(m_ipv4->GetAddress(ifIndex, 0).GetLocal());
+    route->SetGateway(nextHop);
+    route->SetOutputDevice(m_ipv4->GetNetDevice(ifIndex));
+    return route;
+}
+
+inline PbrFlowKey PbrRouting::MakeFlowKey(const Ipv4Header& header, Ptr<const Packet> p, bool hasL4Header)
+{
+    PbrFlowKey key;
+    key.src = header.GetSource().Get();
+    key.dst = header.GetDestination().Get();
+    key.dscp = header.GetDscp();
+    key.protocol = header.GetProtocol();
+    if (hasL4Header && p != 0 && header.GetFragmentOffset() == 0) { // Only the first fragment has the L4 header
+        if (key.protocol == UdpL4Protocol::PROT_NUMBER && p->GetSize() >= 8) {
+            UdpHeader udp;
+            p->PeekHeader(udp);
+            key.srcPort = udp.GetSourcePort();
+            key.dstPort = udp.GetDestinationPort();
+            key.hasPorts = true;
+        } else if (key.protocol == TcpL4Protocol::PROT_NUMBER && p->GetSize() >= 20) {
+            TcpHeader tcp;
+            p->PeekHeader(tcp);
+            key.srcPort = tcp.GetSourcePort();
+            key.dstPort = tcp.GetDestinationPort();
+            key.hasPorts = true;
+        }
+    }
+    return key;
+}
+
+inline uint32_t PbrRouting::SelectMember(Action& action, uint32_t hash)
+{
+    uint32_t n = static_cast<uint32_t>(action.hops.size());
+    if (action.flowletGap == 0) {
+        // Multiply-shift maps the hash onto [0, n) without a division.
+        return static_cast<uint32_t>((static_cast<uint64_t>(hash) * n) >> 32);
+    }
+
+    Flowlet& f = action.flowlets[hash & (FLOWLET_TABLE_SIZE - 1)];
+    int64_t now = Simulator::Now().GetTimeStep();
+    if (now - f.lastSeen > action.flowletGap) {
+        // New flowlet: it may safely take a different path.
+        if (m_adaptive && !m_links.empty()) {
+            uint32_t best = 0;
+            for (uint32_t m = 1; m < n; ++m) {
+                if (m_links[m_nextHops[action.hops[m]].ifIndex].delay <
+                    m_links[m_nextHops[action.hops[best]].ifIndex].delay) {
+                    best = m;
+                }
+            }
+            f.member = best;
+        } else {
+            f.member = action.nextMember;
+            action.nextMember = (action.nextMember + 1) % n;
+        }
+    }
+    f.lastSeen = now;
+    return f.member;
+}
+
+inline Ptr<Ipv4Route> PbrRouting::SelectRoute(uint8_t dscp, const Ipv4Header& header, Ptr<const Packet> p,
+                                              bool hasL4Header)
+{
+    PbrFlowKey key = MakeFlowKey(header, p, hasL4Header);
+    uint32_t a = m_dscpAction[dscp] == CLASSIFY ? m_classifier.Lookup(key) : m_dscpAction[dscp];
+    if (a == PbrClassifier::NO_MATCH) {
+        return Ptr<Ipv4Route>();
+    }
+    Action& action = m_actions[a];
+    uint32_t hash = FlowHash(key);
+    uint32_t member = action.hops.size() > 1 ? SelectMember(action, hash) : 0;
+    const NextHop& hop = m_nextHops[action.hops[member]];
+    if (hop.route == 0 && action.hops.size() > 1) {
+        // Member down: rehash over the group rather than dropping the flow.
+        for (uint32_t i = 1; i < action.hops.size() && m_nextHops[action.hops[member]].route == 0; ++i) {
+            member = (member + 1) % action.hops.size();
+        }
+        return m_nextHops[action.hops[member]].route;
+    }
+    if (hop.spillThreshold > 0 && m_nextHops[hop.spillTo].route != 0 &&
+        (hash & 0xffff) < hop.spillThreshold) {
+        return m_nextHops[hop.spillTo].route;
+    }
+    return LiveRoute(hop);
+}
+
+inline Ptr<Ipv4Route> PbrRouting::RouteOutput(Ptr<Packet> p, const Ipv4Header& header, 
+                                              Ptr<NetDevice> oif, Socket::SocketErrno& sockerr)
+{
+    // 1. Classification based on DSCP/TOS field: a single lookup into the
+    //    precompiled table, no per-packet allocation or address resolution.
+    //    Only DSCPs covered by multi-field rules or an active spill pay more.
+    //    Locally generated UDP packets have no L4 header yet, so port rules
+    //    only apply to forwarded traffic.
+    Commit();
+    uint8_t dscp = header.GetDscp();
+    Ptr<Ipv4Route> route = m_dscpSlow[dscp] ? SelectRoute(dscp, header, p, false) : m_dscpRoutes[dscp];
+
+    Decision decision = route != 0 ? POLICY_LOCAL : m_fallback ? FALLBACK : NO_ROUTE;
+    if (p != 0) {
+        // A UDP socket routes its payload before adding the UDP header; TCP
+        // sockets route without a packet, and anything else that gets here
+        // from Ipv4L3Protocol::Send already carries its L4 header.
+        Counter& c = m_counters[decision][dscp >> 3];
+        ++c.packets;
+        c.bytes += p->GetSize();
+        if (header.GetProtocol() == UdpL4Protocol::PROT_NUMBER) {
+            c.bytes += UdpHeader().GetSerializedSize();
+        }
+    }
+
+    if (route != 0) {
+        PBR_PACKET_LOG("PBR: DSCP " << static_cast<uint32_t>(dscp) << " routed via " << route->GetGateway());
+        // The cached route is shared; only the destination varies per packet.
+        route->SetDestination(header.GetDestination());
+        sockerr = Socket::ERROR_NOTERROR;
+        return route;
+    }
+    
+    // Fallback: hand unmatched traffic straight to the inner protocol.
+    PBR_PACKET_LOG("PBR: No match, deferring to fallback routing protocol.");
+    if (m_fallback) {
+        return m_fallback->RouteOutput(p, header, oif, sockerr);
+    }
+    sockerr = Socket::ERROR_NOROUTETOHOST;
+    return 0;
+}
+
+inline bool PbrRouting::RouteInput(Ptr<const Packet> p, const Ipv4Header& header, Ptr<const NetDevice> idev, 
+                                  UnicastForwardCallback ucb, MulticastForwardCallback mcb, 
+                                  LocalDeliverCallback lcb, ErrorCallback ecb)
+{
+    NS_ASSERT(m_ipv4->GetInterfaceForDevice(idev) >= 0);
+    uint32_t iif = m_ipv4->GetInterfaceForDevice(idev);
+
+    // Local delivery and multicast are not subject to policy.
+    if (m_ipv4->IsDestinationAddress(header.GetDestination(), iif)) {
+        if (lcb.IsNull()) {
+            return false;
+        }
+        lcb(p, header, iif);
+        return true;
+    }
+
+    // Forwarded unicast traffic: this is where the router applies its policy.
+    // Unlike RouteOutput, the packet here carries its L4 header.
+    Commit();
+    uint8_t dscp = header.GetDscp();
+    if (!header.GetDestination().IsMulticast() && m_ipv4->IsForwarding(iif)) {
+        Ptr<Ipv4Route> route = m_dscpSlow[dscp] ? SelectRoute(dscp, header, p, true) : m_dscpRoutes[dscp];
+        if (route != 0) {
+            Counter& c = m_counters[POLICY_FORWARD][dscp >> 3];
+            ++c.packets;
+            c.bytes += p->GetSize();
+            PBR_PACKET_LOG("PBR: Forwarding DSCP " << static_cast<uint32_t>(dscp) << " via " << route->GetGateway());
+            route->SetDestination(header.GetDestination());
+            ucb(route, p, header);
+            return true;
+        }
+    }
+
+    Counter& c = m_counters[m_fallback ? FALLBACK : NO_ROUTE][dscp >> 3];
+    ++c.packets;
+    c.bytes += p->GetSize();
+    if (m_fallback) {
+        return m_fallback->RouteInput(p, header, idev, ucb, mcb, lcb, ecb);
+    }
+    return false;
+}
+
+inline void PbrRouting::AccumulateDecisionCounters(Counter sums[N_DECISIONS][N_DSCP_CLASSES]) const
+{
+    for (uint32_t d = 0; d < N_DECISIONS; ++d) {
+        for (uint32_t k = 0; k < N_DSCP_CLASSES; ++k) {
+            sums[d][k].packets += m_counters[d][k].packets;
+            sums[d][k].bytes += m_counters[d][k].bytes;
+        }
+    }
+}
+
+inline void PbrRouting::PrintDecisionCounters(std::ostream& os, const Counter counters[N_DECISIONS][N_DSCP_CLASSES])
+{
+    static const char* const names[N_DECISIONS] = {"policy (local)", "policy (forwarded)", "fallback", "no route"};
+    os << "Class  Decision            Packets     Bytes" << std::endl;
+    for (uint32_t k = 0; k < N_DSCP_CLASSES; ++k) {
+        for (uint32_t d = 0; d < N_DECISIONS; ++d) {
+            if (counters[d][k].packets == 0) {
+                continue;
+            }
+            os << std::left << "CS" << std::setw(5) << k << std::setw(20) << names[d] << std::right << std::setw(7)
+               << counters[d][k].packets << std::setw(10) << counters[d][k].bytes << std::endl;
+        }
+    }
+}
+
+inline void PbrRouting::PrintRoutingTable(Ptr<OutputStreamWrapper> stream, Time::Unit unit) const
+{
+    std::ostream* os = stream->GetStream();
+    *os << "PbrRouting Table: Policy-Based Routing Active, " << m_classifier.GetNRules()
+        << " rules in " << m_classifier.GetNTuples() << " tuples" << std::endl;
+    *os << "Id    Prio  DSCP  Source              Destination         Proto SrcPorts    DstPorts    Gateway         If" << std::endl;
+    for (uint32_t id = 0; id < m_classifier.GetRuleIdLimit(); ++id) {
+        if (!m_classifier.IsActive(id)) {
+            continue;
+        }
+        const PbrRule& r = m_classifier.GetRule(id);
+        const Action& action = m_actions[m_classifier.GetAction(id)];
+        const NextHop& hop = m_nextHops[action.hops[0]];
+        std::ostringstream src, dst, dscp, proto, sports, dports, gw;
+        src << r.srcAddress << "/" << r.srcMask.GetPrefixLength();
+        dst << r.dstAddress << "/" << r.dstMask.GetPrefixLength();
+        if (r.dscp < 0) dscp << "*"; else dscp << r.dscp;
+        if (r.protocol < 0) proto << "*"; else proto << r.protocol;
+        sports << r.srcPortMin << "-" << r.srcPortMax;
+        dports << r.dstPortMin << "-" << r.dstPortMax;
+        gw << hop.gateway;
+        if (action.hops.size() > 1) {
+            gw << " +" << action.hops.size() - 1 << " ECMP";
+        }
+        *os << std::left << std::setw(6) << id << std::setw(6) << r.priority << std::setw(6) << dscp.str()
+            << std::setw(20) << src.str() << std::setw(20) << dst.str() << std::setw(6) << proto.str()
+            << std::setw(12) << sports.str() << std::setw(12) << dports.str() << std::setw(16) << gw.str()
+            << hop.ifIndex << (hop.route == 0 ? " (down)" : "");
+        if (hop.backup != NO_HOP) {
+            *os << ", backup " << m_nextHops[hop.backup].gateway << " if " << m_nextHops[hop.backup].ifIndex;
+        }
+        *os << std::endl;
+    }
+    *os << std::right;
+    if (m_fallback) {
+        *os << "Fallback (" << m_fallback->GetInstanceTypeId().GetName() << "):" << std::endl;
+        m_fallback->PrintRoutingTable(stream, unit);
+    }
+}
+
+} // namespace ns3
+
+#endif /* PBR_ROUTING_H */
@@ -1,7 +1,26 @@
 /*
- * Exercise 5: Policy-Based Routing Main Script (Self-Contained)
+ * Exercise 5: Policy-Based Routing Main Script
  * Topology: Studio (n0) -> Router (n1) -> Cloud (n2) via two parallel links (Primary/Secondary).
- * Implements: PBR routing logic directly in this file.
+ * PBR routing logic lives in pbr-routing.h and the multi-field rule index
+ * in pbr-classifier.h.
+ * --topology=dual-homed (or full-mesh) runs PBR on every branch of a
+ * generated WAN instead (wan-topology-helper.h), each forwarding for a
+ * studio host on its own LAN.
+ * --batch="wanRate=10Mbps,100Mbps;dataFlows=1,4" --runs=30 runs independent
+ * replications in parallel and reports per-class delivery with 95%
+ * confidence intervals (batch-runner.h).
+ * --stats / --statsJson=FILE report run time, event rate and peak memory
+ * (run-stats.h).
+ * --condition="dscp=ef mode=srtcm cir=800kbps cbs=3000 ebs=6000 action=police"
+ * polices or shapes classes on the Studio's access link, before the Router's
+ * PBR sees them (traffic-conditioner.h).
+ * --marks="dst=10.0.2.2 set=ef" makes the Studio's apps send unmarked and sets
+ * the DSCP on that same access link instead, so the Router's PBR needs only
+ * its DSCP table, not the multi-field classifier.
+ * Each link backs up the other (PbrRouting::SetBackupNextHop). --failAt=S
+ * cuts the Primary link, --detect=MS later the Router declares it down and
+ * fails over, --restoreAt=S repairs it; convergence time and the EF packets
+ * lost in the outage are reported.
  */
 
 #include "ns3/core-module.h"
@@ -9,123 +28,271 @@
 #include "ns3/internet-module.h"
 #include "ns3/point-to-point-module.h"
 #include "ns3/applications-module.h"
+#include "ns3/traffic-control-module.h"
 #include "ns3/ipv4-routing-protocol.h"
 #include "ns3/ipv4-route.h"
 #include "ns3/log.h"
+#include "batch-runner.h"
+#include "pbr-routing.h"
+#include "run-stats.h"
+#include "traffic-conditioner.h"
+#include "wan-topology-helper.h"
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <vector>
 
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE("PbrSimulationComplete");
 
 // =================================================================
-// PbrRouting Class Definition (Self-Contained)
+// Main Simulation Script
 // =================================================================
-class PbrRouting : public Ipv4RoutingProtocol
+
+// Bytes handed to a socket by an OnOffApplication ("Tx" trace).
+static void CountTxBytes(uint64_t* bytes, Ptr<const Packet> p)
+{
+    *bytes += p->GetSize();
+}
+
+// Failure injection: a cut link silently drops everything at both ends; the
+// Router only learns of it when its interface is declared down, as a BFD
+// session would after its missed hellos.
+static void SetLinkCut(Ptr<ErrorModel> a, Ptr<ErrorModel> b, bool cut)
+{
+    if (cut) {
+        a->Enable();
+        b->Enable();
+    } else {
+        a->Disable();
+        b->Disable();
+    }
+}
+
+static void SetInterfaceUp(Ptr<Ipv4> ipv4, uint32_t interface, bool up)
+{
+    if (up) {
+        ipv4->SetUp(interface);
+    } else {
+        ipv4->SetDown(interface);
+    }
+}
+
+// Watches the EF flow arrive at the Cloud: which link each packet came in on
+// and which sequence numbers are missing around the switch to the backup.
+class FailoverMonitor
 {
 public:
-    PbrRouting(Ipv4Address videoNextHop, Ipv4Address dataNextHop,
-               uint32_t videoIfIndex, uint32_t dataIfIndex)
-    : m_videoNextHop(videoNextHop), 
-      m_dataNextHop(dataNextHop), 
-      m_videoIfIndex(videoIfIndex), 
-      m_dataIfIndex(dataIfIndex)
+    FailoverMonitor(Ipv4Address destination, uint32_t primaryIf, uint32_t backupIf, Time failAt)
+    : m_destination(destination), m_primaryIf(primaryIf), m_backupIf(backupIf), m_failAt(failAt),
+      m_lastPrimarySeq(-1), m_firstBackupSeq(-1)
     {}
 
-    virtual ~PbrRouting() {}
-
-    static TypeId GetTypeId(void) {
-        static TypeId tid = TypeId("ns3::PbrRouting")
-            .SetParent<Ipv4RoutingProtocol>()
-            .SetGroupName("Internet");
-        return tid;
+    void Install(Ptr<Node> node)
+    {
+        node->GetObject<Ipv4L3Protocol>()->TraceConnectWithoutContext(
+            "LocalDeliver", MakeCallback(&FailoverMonitor::LocalDeliver, this));
     }
 
-    // Required overrides
-    virtual void SetIpv4(Ptr<Ipv4> ipv4) override { m_ipv4 = ipv4; }
-    virtual void NotifyInterfaceUp(uint32_t interface) override {}
-    virtual void NotifyInterfaceDown(uint32_t interface) override {}
-    virtual void NotifyAddAddress(uint32_t interface, Ipv4InterfaceAddress address) override {}
-    virtual void NotifyRemoveAddress(uint32_t interface, Ipv4InterfaceAddress address) override {}
-    
-    // Q2: Core PBR logic - using 'sockerr' instead of 'errno'
-    virtual Ptr<Ipv4Route> RouteOutput(Ptr<Packet> p, const Ipv4Header& header, 
-                                       Ptr<NetDevice> oif, Socket::SocketErrno& sockerr) override;
-    
-    // Correct signature for the second pure virtual function
-    virtual bool RouteInput(Ptr<const Packet> p, const Ipv4Header& header, Ptr<const NetDevice> idev, 
-                            UnicastForwardCallback ucb, MulticastForwardCallback mcb, 
-                            LocalDeliverCallback lcb, ErrorCallback ecb) override;
-                            
-    virtual void PrintRoutingTable(Ptr<OutputStreamWrapper> stream, Time::Unit unit = Time::S) const override {
-        *stream->GetStream() << "PbrRouting Table: Policy-Based Routing Active (DSCP EF -> Primary, DSCP BE -> Secondary)" << std::endl;
+    bool HasConverged(void) const { return m_firstBackupSeq >= 0; }
+    // From the cut to the first EF packet delivered over the backup.
+    Time GetConvergenceTime(void) const { return m_firstBackupTime - m_failAt; }
+
+    // EF packets sent between the last one the Primary delivered and the
+    // first one over the backup that never arrived.
+    uint32_t GetOutageLoss(void) const
+    {
+        uint32_t lost = 0;
+        for (int64_t seq = m_lastPrimarySeq + 1; seq < m_firstBackupSeq; ++seq) {
+            lost += m_received[seq] ? 0 : 1;
+        }
+        return lost;
     }
 
 private:
-    Ptr<Ipv4> m_ipv4;
-    Ipv4Address m_videoNextHop; 
-    Ipv4Address m_dataNextHop;  
-    uint32_t m_videoIfIndex;    
-    uint32_t m_dataIfIndex;     
-};
+    void LocalDeliver(const Ipv4Header& header, Ptr<const Packet> p, uint32_t iif)
+    {
+        SeqTsSizeHeader ts;
+        if (header.GetDestination() != m_destination || p->GetSize() < 8 + ts.GetSerializedSize()) {
+            return;
+        }
+        Ptr<Packet> copy = p->Copy();
+        UdpHeader udp;
+        copy->RemoveHeader(udp);
+        copy->PeekHeader(ts);
+        int64_t seq = ts.GetSeq();
+        if (seq >= static_cast<int64_t>(m_received.size())) {
+            m_received.resize(seq + 1, false);
+        }
+        m_received[seq] = true;
+        if (iif == m_primaryIf && m_firstBackupSeq < 0) {
+            m_lastPrimarySeq = std::max(m_lastPrimarySeq, seq);
+        } else if (iif == m_backupIf && m_firstBackupSeq < 0 && Simulator::Now() >= m_failAt) {
+            m_firstBackupSeq = seq;
+            m_firstBackupTime = Simulator::Now();
+        }
+    }
 
-// =================================================================
-// PbrRouting Implementation
-// =================================================================
+    Ipv4Address m_destination;
+    uint32_t m_primaryIf;
+    uint32_t m_backupIf;
+    Time m_failAt;
+    int64_t m_lastPrimarySeq;
+    int64_t m_firstBackupSeq;
+    Time m_firstBackupTime;
+    std::vector<bool> m_received;
+};
 
-Ptr<Ipv4Route> PbrRouting::RouteOutput(Ptr<Packet> p, const Ipv4Header& header, 
-                                       Ptr<NetDevice> oif, Socket::SocketErrno& sockerr)
+// Generated WAN: every branch is its own PBR router, sending EF to the peer
+// on its first link and BE to the peer on its second (or hashing BE over
+// both with --ecmp). Needs two links per branch: dual-homed or full-mesh.
+// A --condition conditioner goes on both uplinks: the branch is its own
+// edge, so it polices after its PBR decision.
+static void RunGeneratedWan(WanTopologyHelper& wan, bool adaptive, bool ecmp, Time flowletGap,
+                            const std::string& dataRate, uint32_t dataFlows, const std::string& condition,
+                            RunStats& stats)
 {
-    const uint8_t DSCP_VIDEO_EF = 0x2e; // Expedited Forwarding (VoIP/Video)
-    const uint8_t DSCP_DATA_BE = 0x00;  // Best Effort (Data/FTP)
-
-    // 1. Classification based on DSCP/TOS field
-    uint8_t dscp = header.GetDscp(); 
-
-    if (dscp == DSCP_VIDEO_EF) {
-        // Policy: Video traffic (EF) uses the Primary path (Net 2)
-        NS_LOG_INFO("PBR: Video traffic (EF), routing via Primary (Net 2)");
-        Ptr<Ipv4Route> route = Create<Ipv4Route>();
-        route->SetDestination(header.GetDestination());
-        route->SetSource(m_ipv4->GetAddress(m_videoIfIndex, 0).GetLocal());
-        route->SetGateway(m_videoNextHop); 
-        route->SetOutputDevice(m_ipv4->GetNetDevice(m_videoIfIndex));
-        return route;
-    }
-    else if (dscp == DSCP_DATA_BE) {
-        // Policy: Data traffic (BE) uses the Secondary path (Net 3)
-        NS_LOG_INFO("PBR: Data traffic (BE), routing via Secondary (Net 3)");
-        Ptr<Ipv4Route> route = Create<Ipv4Route>();
-        route->SetDestination(header.GetDestination());
-        route->SetSource(m_ipv4->GetAddress(m_dataIfIndex, 0).GetLocal());
-        route->SetGateway(m_dataNextHop); 
-        route->SetOutputDevice(m_ipv4->GetNetDevice(m_dataIfIndex));
-        return route;
+    wan.Build();
+    uint16_t port = 9;
+    NodeContainer branches = wan.GetBranches();
+    std::vector<Ptr<PbrRouting> > routers;
+    // Each branch forwards for a studio host on its LAN, as the Router does
+    // in the fixed topology. Traffic a node sends itself reaches RouteOutput
+    // before UDP adds its header, so only forwarded packets carry the ports
+    // that --ecmp and the adaptive spill hash on.
+    InternetStackHelper hostStack;
+    Ipv4AddressHelper hostAddress("172.16.0.0", "255.255.255.252");
+    Ipv4StaticRoutingHelper hostRouting;
+    PointToPointHelper lan;
+    lan.SetDeviceAttribute("DataRate", StringValue("100Mbps"));
+    lan.SetChannelAttribute("Delay", StringValue("1ms"));
+    for (uint32_t b = 0; b < branches.GetN(); ++b) {
+        uint32_t node = wan.GetBranchIndex(b);
+        const std::vector<uint32_t>& links = wan.GetNodeLinks(node);
+        NS_ABORT_MSG_UNLESS(links.size() >= 2, "PBR needs two uplinks per branch; use --topology=dual-homed");
+        const WanTopologyHelper::Link& primary = wan.GetLinks()[links[0]];
+        const WanTopologyHelper::Link& secondary = wan.GetLinks()[links[1]];
+        uint32_t primaryIf = primary.nodeA == node ? primary.ifA : primary.ifB;
+        uint32_t secondaryIf = secondary.nodeA == node ? secondary.ifA : secondary.ifB;
+        Ipv4Address primaryPeer = primary.nodeA == node ? primary.addrB : primary.addrA;
+        Ipv4Address secondaryPeer = secondary.nodeA == node ? secondary.addrB : secondary.addrA;
+
+        Ptr<PbrRouting> pbr = CreateObject<PbrRouting>();
+        PbrRule videoRule;
+        videoRule.dscp = PbrRouting::DSCP_VIDEO_EF;
+        pbr->AddPolicyRule(videoRule, primaryIf, primaryPeer);
+        PbrRule dataRule;
+        dataRule.dscp = PbrRouting::DSCP_DATA_BE;
+        if (ecmp) {
+            std::vector<uint32_t> ifIndices;
+            std::vector<Ipv4Address> gateways;
+            ifIndices.push_back(secondaryIf); gateways.push_back(secondaryPeer);
+            ifIndices.push_back(primaryIf); gateways.push_back(primaryPeer);
+            pbr->AddEcmpPolicyRule(dataRule, ifIndices, gateways, flowletGap);
+        } else {
+            pbr->AddPolicyRule(dataRule, secondaryIf, secondaryPeer);
+        }
+        pbr->SetFallbackProtocol(CreateObject<Ipv4StaticRouting>());
+        branches.Get(b)->GetObject<Ipv4>()->SetRoutingProtocol(pbr);
+        routers.push_back(pbr);
+
+        NodeContainer host;
+        host.Create(1, branches.Get(b)->GetSystemId());
+        hostStack.Install(host);
+        Ipv4InterfaceContainer hostIf = hostAddress.Assign(lan.Install(host.Get(0), branches.Get(b)));
+        hostAddress.NewNetwork();
+        hostRouting.GetStaticRouting(host.Get(0)->GetObject<Ipv4>())->SetDefaultRoute(hostIf.GetAddress(1), 1);
+        if (!condition.empty()) {
+            InstallTrafficConditioner(primary.nodeA == node ? primary.devA : primary.devB, condition);
+            InstallTrafficConditioner(secondary.nodeA == node ? secondary.devA : secondary.devB, condition);
+        }
+        if (adaptive) {
+            pbr->EnableAdaptive(MilliSeconds(10), MilliSeconds(5), MilliSeconds(1));
+            pbr->AddSpillPath(secondaryIf, primaryIf);
+        }
+
+        OnOffHelper videoApp("ns3::UdpSocketFactory", InetSocketAddress(primaryPeer, port));
+        videoApp.SetAttribute("PacketSize", UintegerValue(1024));
+        videoApp.SetAttribute("DataRate", StringValue("1Mbps"));
+        videoApp.SetAttribute("ToS", UintegerValue(0x2e << 2));
+        videoApp.Install(host).Start(Seconds(1.0));
+
+        OnOffHelper dataApp("ns3::UdpSocketFactory", InetSocketAddress(secondaryPeer, port));
+        dataApp.SetAttribute("PacketSize", UintegerValue(1024));
+        dataApp.SetAttribute("DataRate", StringValue(dataRate));
+        dataApp.SetAttribute("ToS", UintegerValue(0x00));
+        for (uint32_t f = 0; f < dataFlows; ++f) {
+            dataApp.Install(host).Start(Seconds(1.0));
+        }
     }
-    
-    // Fallback: Use the default routing logic
-    NS_LOG_INFO("PBR: No match, deferring to underlying routing protocol.");
-    // FIX: Use GetRoutingProtocol() instead of GetRoutingServices() for NS-3.35 compatibility
-    return m_ipv4->GetRoutingProtocol()->RouteOutput(p, header, oif, sockerr); 
-}
 
-bool PbrRouting::RouteInput(Ptr<const Packet> p, const Ipv4Header& header, Ptr<const NetDevice> idev, 
-                           UnicastForwardCallback ucb, MulticastForwardCallback mcb, 
-                           LocalDeliverCallback lcb, ErrorCallback ecb)
-{
-    // Defer input routing decisions to the underlying global routing system
-    // FIX: Use GetRoutingProtocol() instead of GetRoutingServices() for NS-3.35 compatibility
-    return m_ipv4->GetRoutingProtocol()->RouteInput(p, header, idev, ucb, mcb, lcb, ecb);
-}
+    // Peers may be hubs or (full-mesh) other branches
+    PacketSinkHelper sink("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), port));
+    sink.Install(wan.GetNodes()).Start(Seconds(0.0));
 
-// =================================================================
-// Main Simulation Script
-// =================================================================
+    Simulator::Stop(Seconds(10.0));
+    stats.Run();
+
+    PbrRouting::Counter sums[PbrRouting::N_DECISIONS][PbrRouting::N_DSCP_CLASSES];
+    for (const Ptr<PbrRouting>& pbr : routers) {
+        pbr->AccumulateDecisionCounters(sums);
+    }
+    std::cout << "\n--- PBR Decisions (" << routers.size() << " branches) ---\n";
+    PbrRouting::PrintDecisionCounters(std::cout, sums);
+    stats.Report("pbr-simulation-complete");
+    Simulator::Destroy();
+}
 
 int main(int argc, char *argv[])
 {
-    // Enable Logs for PBR decisions
+    RunStats stats;
+    bool adaptive = false;
+    bool ecmp = false;
+    double flowletGapMs = 0.0;
+    std::string wanRate = "100Mbps";
+    std::string dataRate = "1Mbps";
+    uint32_t dataFlows = 1;
+    std::string condition;
+    std::string marks;
+    double failAt = 0.0;
+    double detectMs = 50.0;
+    double restoreAt = 0.0;
+    WanTopologyHelper wan;
+    BatchRunner batch;
+
+    CommandLine cmd;
+    cmd.AddValue("adaptive", "Spill BE flows onto the Primary link while Secondary is congested", adaptive);
+    cmd.AddValue("ecmp", "Hash BE flows over both Router -> Cloud links", ecmp);
+    cmd.AddValue("flowletGap", "ECMP flowlet gap in ms (0 = pure per-flow hashing)", flowletGapMs);
+    cmd.AddValue("wanRate", "Data rate of the two Router -> Cloud links", wanRate);
+    cmd.AddValue("dataRate", "Data rate of each BE flow", dataRate);
+    cmd.AddValue("dataFlows", "Number of BE flows", dataFlows);
+    cmd.AddValue("condition", "Policing/shaping profiles on the Studio's access link (traffic-conditioner.h)",
+                 condition);
+    cmd.AddValue("marks", "DSCP marking rules on the Studio's access link; the apps then send unmarked", marks);
+    cmd.AddValue("failAt", "Cut the Primary link at this time in s (0 = never)", failAt);
+    cmd.AddValue("detect", "Failure detection time in ms before the Router fails over", detectMs);
+    cmd.AddValue("restoreAt", "Repair the Primary link at this time in s (0 = never)", restoreAt);
+    wan.AddCommandLineOptions(cmd);
+    batch.AddCommandLineOptions(cmd);
+    stats.AddCommandLineOptions(cmd);
+    cmd.Parse(argc, argv);
+
+    if (batch.IsBatch()) {
+        return batch.Run(argc, argv);
+    }
+
+    // PBR events only (failover, spill); per-packet decisions are counted,
+    // see PrintDecisionCounters below
     LogComponentEnable("PbrRouting", LOG_LEVEL_INFO);
-    LogComponentEnable("OnOffApplication", LOG_LEVEL_INFO);
+
+    if (wan.IsGenerated()) {
+        // A branch routes its own traffic before any queue disc could mark it
+        NS_ABORT_MSG_UNLESS(marks.empty(), "--marks needs the fixed Studio/Router/Cloud topology");
+        RunGeneratedWan(wan, adaptive, ecmp, MicroSeconds(flowletGapMs * 1000.0), dataRate, dataFlows, condition, stats);
+        return 0;
+    }
 
     // Topology: Studio (n0) -> Router (n1) -> Cloud (n2)
     NodeContainer nodes;
@@ -140,6 +307,7 @@ int main(int argc, char *argv[])
 
     // Link 1: Studio -> Router (10.0.1.0/24)
     NetDeviceContainer d0 = p2p.Install(studio, router);
+    p2p.SetDeviceAttribute("DataRate", StringValue(wanRate));
     // Link 2: Router -> Cloud (Primary/Video) (10.0.2.0/24)
     NetDeviceContainer d1 = p2p.Install(router, cloud);
     // Link 3: Router -> Cloud (Secondary/Data) (10.0.3.0/24)
@@ -151,7 +319,7 @@ int main(int argc, char *argv[])
 
     // Assign IPs
     Ipv4AddressHelper ipv4;
-    ipv4.SetBase("10.0.1.0", "255.255.255.0"); ipv4.Assign(d0); 
+    ipv4.SetBase("10.0.1.0", "255.255.255.0"); Ipv4InterfaceContainer i0 = ipv4.Assign(d0); // Access Link
     ipv4.SetBase("10.0.2.0", "255.255.255.0"); Ipv4InterfaceContainer i1 = ipv4.Assign(d1); // Primary Link
     ipv4.SetBase("10.0.3.0", "255.255.255.0"); Ipv4InterfaceContainer i2 = ipv4.Assign(d2); // Secondary Link
 
@@ -163,38 +331,156 @@ int main(int argc, char *argv[])
     Ptr<Ipv4> ipv4Router = router->GetObject<Ipv4>();
     
     // Create and configure the custom PbrRouting instance
-    Ptr<PbrRouting> pbr = CreateObject<PbrRouting>(
-        videoNextHop, 
-        dataNextHop,  
-        2,            // Interface Index for Video path (Net 2)
-        3             // Interface Index for Data path (Net 3)
-    );
-    pbr->SetIpv4(ipv4Router);
+    Ptr<PbrRouting> pbr = CreateObject<PbrRouting>();
+    PbrRule videoRule;
+    videoRule.dscp = PbrRouting::DSCP_VIDEO_EF;
+    pbr->AddPolicyRule(videoRule, 2, videoNextHop); // Interface Index for Video path (Net 2)
+    PbrRule dataRule;
+    dataRule.dscp = PbrRouting::DSCP_DATA_BE;
+    if (ecmp) {
+        // BE flows are split across Secondary and Primary (Net 3 and Net 2)
+        std::vector<uint32_t> ifIndices;
+        std::vector<Ipv4Address> gateways;
+        ifIndices.push_back(3); gateways.push_back(dataNextHop);
+        ifIndices.push_back(2); gateways.push_back(videoNextHop);
+        pbr->AddEcmpPolicyRule(dataRule, ifIndices, gateways, MicroSeconds(flowletGapMs * 1000.0));
+    } else {
+        pbr->AddPolicyRule(dataRule, 3, dataNextHop); // Interface Index for Data path (Net 3)
+    }
+    // Fast reroute: the two Cloud links back each other up. The Cloud owns
+    // both next hops, so neither backup can loop back through the Router.
+    pbr->SetBackupNextHop(2, videoNextHop, 3, dataNextHop);
+    pbr->SetBackupNextHop(3, dataNextHop, 2, videoNextHop);
+    // Unmatched traffic goes to a plain static table; it learns the connected
+    // networks from the interfaces when PBR hands it the Ipv4 object.
+    pbr->SetFallbackProtocol(CreateObject<Ipv4StaticRouting>());
     ipv4Router->SetRoutingProtocol(pbr); // Replace default routing with PBR
 
+    if (adaptive) {
+        // Sample every 10ms; Secondary counts as congested above 5ms of backlog.
+        // Video never moves: only BE may spill, and only while Primary is clear.
+        pbr->EnableAdaptive(MilliSeconds(10), MilliSeconds(5), MilliSeconds(1));
+        pbr->AddSpillPath(3, 2);
+    }
+
+    // End hosts reach everything through the router.
+    Ipv4StaticRoutingHelper staticRoutingHelper;
+    staticRoutingHelper.GetStaticRouting(studio->GetObject<Ipv4>())
+        ->SetDefaultRoute(i0.GetAddress(1), 1); // 10.0.1.2 (Router IP on Access)
+    staticRoutingHelper.GetStaticRouting(cloud->GetObject<Ipv4>())
+        ->SetDefaultRoute(i1.GetAddress(0), 1); // 10.0.2.1 (Router IP on Primary)
+
+    // Edge conditioning on the Studio side of the access link
+    Ptr<TrafficConditionerQueueDisc> conditioner;
+    if (!condition.empty() || !marks.empty()) {
+        conditioner = InstallTrafficConditioner(d0.Get(0), condition, marks);
+    }
+
     // --- Traffic Generation (Q2) ---
     uint16_t port = 9;
+    const Time appStart = Seconds(1.0);
+    const Time appStop = Seconds(10.0); // The end of the run
     
     // 1. Video Flow (DSCP EF = 0x2e, High Priority)
     OnOffHelper videoApp("ns3::UdpSocketFactory", InetSocketAddress(videoNextHop, port));
     videoApp.SetAttribute("PacketSize", UintegerValue(1024));
     videoApp.SetAttribute("DataRate", StringValue("1Mbps"));
-    videoApp.SetAttribute("ToS", UintegerValue(0x2e << 2)); // Set ToS for DSCP EF
-    videoApp.Install(studio).Start(Seconds(1.0));
+    videoApp.SetAttribute("ToS", UintegerValue(marks.empty() ? 0x2e << 2 : 0)); // Set ToS for DSCP EF, or mark at the edge
+    videoApp.SetAttribute("EnableSeqTsSizeHeader", BooleanValue(failAt > 0)); // Sequence numbers for FailoverMonitor
+    ApplicationContainer videoApps = videoApp.Install(studio);
+    videoApps.Start(appStart);
+    videoApps.Stop(appStop);
 
-    // 2. Data Flow (DSCP BE = 0x00, Low Priority)
+    // 2. Data Flows (DSCP BE = 0x00, Low Priority), one socket each so
+    //    adaptive mode can move them individually
     OnOffHelper dataApp("ns3::UdpSocketFactory", InetSocketAddress(dataNextHop, port));
     dataApp.SetAttribute("PacketSize", UintegerValue(1024));
-    dataApp.SetAttribute("DataRate", StringValue("1Mbps"));
+    dataApp.SetAttribute("DataRate", StringValue(dataRate));
     dataApp.SetAttribute("ToS", UintegerValue(0x00)); // Set ToS for DSCP BE
-    dataApp.Install(studio).Start(Seconds(1.0));
+    ApplicationContainer dataApps;
+    for (uint32_t f = 0; f < dataFlows; ++f) {
+        dataApps.Add(dataApp.Install(studio));
+    }
+    dataApps.Start(appStart);
+    dataApps.Stop(appStop);
 
-    // Sink on Cloud node (n2)
-    PacketSinkHelper sink("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), port));
-    sink.Install(cloud).Start(Seconds(0.0));
+    // Sinks on Cloud node (n2), one per destination so each class is counted
+    PacketSinkHelper videoSink("ns3::UdpSocketFactory", InetSocketAddress(videoNextHop, port));
+    ApplicationContainer videoSinkApp = videoSink.Install(cloud);
+    videoSinkApp.Start(Seconds(0.0));
+    PacketSinkHelper dataSink("ns3::UdpSocketFactory", InetSocketAddress(dataNextHop, port));
+    ApplicationContainer dataSinkApp = dataSink.Install(cloud);
+    dataSinkApp.Start(Seconds(0.0));
 
-    Simulator::Stop(Seconds(10.0));
-    Simulator::Run();
+    uint64_t videoTx = 0;
+    uint64_t dataTx = 0;
+    for (uint32_t i = 0; i < videoApps.GetN(); ++i) {
+        videoApps.Get(i)->TraceConnectWithoutContext("Tx", MakeBoundCallback(&CountTxBytes, &videoTx));
+    }
+    for (uint32_t i = 0; i < dataApps.GetN(); ++i) {
+        dataApps.Get(i)->TraceConnectWithoutContext("Tx", MakeBoundCallback(&CountTxBytes, &dataTx));
+    }
+
+    // Failure injection on the Primary link (d1)
+    Ptr<Ipv4> cloudIpv4 = cloud->GetObject<Ipv4>();
+    FailoverMonitor failover(videoNextHop, cloudIpv4->GetInterfaceForDevice(d1.Get(1)),
+                             cloudIpv4->GetInterfaceForDevice(d2.Get(1)), Seconds(failAt));
+    if (failAt > 0) {
+        Ptr<RateErrorModel> cutA = CreateObjectWithAttributes<RateErrorModel>(
+            "ErrorRate", DoubleValue(1.0), "ErrorUnit", EnumValue(RateErrorModel::ERROR_UNIT_PACKET));
+        Ptr<RateErrorModel> cutB = CreateObjectWithAttributes<RateErrorModel>(
+            "ErrorRate", DoubleValue(1.0), "ErrorUnit", EnumValue(RateErrorModel::ERROR_UNIT_PACKET));
+        cutA->Disable();
+        cutB->Disable();
+        DynamicCast<PointToPointNetDevice>(d1.Get(0))->SetReceiveErrorModel(cutA);
+        DynamicCast<PointToPointNetDevice>(d1.Get(1))->SetReceiveErrorModel(cutB);
+        Simulator::Schedule(Seconds(failAt), &SetLinkCut, cutA, cutB, true);
+        Simulator::Schedule(Seconds(failAt) + MilliSeconds(detectMs), &SetInterfaceUp, ipv4Router, 2, false);
+        if (restoreAt > failAt) {
+            Simulator::Schedule(Seconds(restoreAt), &SetLinkCut, cutA, cutB, false);
+            Simulator::Schedule(Seconds(restoreAt), &SetInterfaceUp, ipv4Router, 2, true);
+        }
+        failover.Install(cloud);
+    }
+
+    Simulator::Stop(appStop);
+    stats.Run();
+
+    const double activeTime = (appStop - appStart).GetSeconds();
+    uint64_t videoRx = DynamicCast<PacketSink>(videoSinkApp.Get(0))->GetTotalRx();
+    uint64_t dataRx = DynamicCast<PacketSink>(dataSinkApp.Get(0))->GetTotalRx();
+    double videoMbps = videoRx * 8.0 / activeTime / 1e6;
+    double dataMbps = dataRx * 8.0 / activeTime / 1e6;
+    double videoLoss = videoTx > 0 ? 100.0 * (1.0 - static_cast<double>(videoRx) / videoTx) : 0.0;
+    double dataLoss = dataTx > 0 ? 100.0 * (1.0 - static_cast<double>(dataRx) / dataTx) : 0.0;
+    std::cout << "\n--- PBR Delivery ---\n" << std::fixed << std::setprecision(2)
+              << "Video (EF): " << videoMbps << " Mbps, " << videoLoss << " % lost\n"
+              << "Data (BE):  " << dataMbps << " Mbps, " << dataLoss << " % lost\n";
+    std::cout << "Router decisions:\n";
+    pbr->PrintDecisionCounters(std::cout);
+    if (conditioner != 0) {
+        std::cout << "Studio edge conditioner:\n";
+        PrintConditionerCounts(std::cout, conditioner);
+    }
+    if (failAt > 0) {
+        std::cout << "Primary cut at " << failAt << " s, detected after " << detectMs << " ms, "
+                  << pbr->GetNFailovers() << " failover(s)\n";
+        if (failover.HasConverged()) {
+            std::cout << "Failover:   EF on the backup after " << failover.GetConvergenceTime().GetSeconds() * 1000.0
+                      << " ms, " << failover.GetOutageLoss() << " EF packets lost in the outage\n";
+            batch.Report("failover.convergence_ms", failover.GetConvergenceTime().GetSeconds() * 1000.0);
+            batch.Report("failover.lost_packets", failover.GetOutageLoss());
+        } else {
+            std::cout << "Failover:   EF never reached the Cloud over the backup\n";
+        }
+    }
+    batch.Report("video.throughput_mbps", videoMbps);
+    batch.Report("video.loss_pct", videoLoss);
+    batch.Report("data.throughput_mbps", dataMbps);
+    batch.Report("data.loss_pct", dataLoss);
+
+    stats.Report("pbr-simulation-complete");
     Simulator::Destroy();
+    batch.WriteResults();
     return 0;
 }
@@ -3,6 +3,42 @@
  * Implements: Traffic Differentiation (Q1), Priority Queueing (Q2), 
  * Performance Measurement (Q3), and Congestion Scenario (Q4).
  * Topology: Triangular Mesh (n0, n1, n2) | Bottleneck link is n0 <-> n2 (5Mbps).
+ * --topology=hub-spoke|full-mesh|dual-homed|multi-tier swaps in a generated
+ * WAN (wan-topology-helper.h) with QoS on every branch uplink.
+ * --batch="bottleneckRate=5Mbps,10Mbps;ftpRate=4Mbps,8Mbps" --runs=30 runs
+ * independent replications in parallel and reports the CheckMetrics values
+ * with 95% confidence intervals (batch-runner.h).
+ * With MPI, "mpirun -np N ... --topology=hub-spoke --branches=1000
+ * --distributed" splits a generated WAN over N ranks (DistributedSimulatorImpl),
+ * cutting on the branch access links, and aggregates the metrics on rank 0.
+ * The device queue under each QoS queue disc is --qosDeviceQueue (5p), so
+ * the backlog, and the scheduling, happen in the queue disc;
+ * --batch="qosDeviceQueue=5p,100p" compares the class delays with the
+ * scheduler in effect and with a 100-packet device FIFO in front of it.
+ * --stats / --statsJson=FILE report run time, event rate and peak memory
+ * (run-stats.h).
+ * --condition="dscp=ef mode=srtcm cir=1500kbps cbs=3000 ebs=6000 action=police"
+ * polices or shapes classes at the edge, in front of the scheduler
+ * (traffic-conditioner.h).
+ * --marks="proto=udp dport=9 set=ef" makes the sources send unmarked and sets
+ * the DSCP once, at the same edge queue disc, by 5-tuple.
+ * --traffic=models replaces the OnOff sources with --voipCalls G.711/Opus
+ * calls, a GOP-structured VBR video stream (AF41) and a TCP bulk transfer
+ * (traffic-models.h).
+ * --tcp=newreno|cubic|bbr makes the FTP source a TCP bulk transfer with that
+ * congestion control; goodput is read from the sinks and cwnd/RTT are kept
+ * as counters per sender (TransportMetrics).
+ * The class metrics are aggregated per packet as the run goes (RxClassTap,
+ * Welford delay mean/sd/min/max) and printed after it; --aggregate=flowmon
+ * goes back to one FlowMonitor pass late in the run, as do runs with TCP
+ * (segments carry no send time) or with --marks or a yellow= remark (the
+ * class changes between sender and sink).
+ * --qosPlacement=auto routes each source's offered load over the installed
+ * tables and puts the QoS queue disc on every egress it can congest, in
+ * either direction and at any hop, instead of the fixed choice.
+ * --routeSnapshot=FILE saves a generated WAN's routes on the first run and
+ * loads them instead of running global routing on later ones
+ * (route-snapshot.h).
  */
 
 #include "ns3/applications-module.h"
@@ -12,193 +48,1500 @@
 #include "ns3/point-to-point-module.h"
 #include "ns3/traffic-control-module.h" 
 #include "ns3/flow-monitor-module.h"    
+#include "batch-runner.h"
+#include "flow-results-format.h"
+#include "ipv4-trie-routing.h"
+#include "latency-histogram.h"
+#include "route-snapshot.h"
+#include "run-stats.h"
+#include "traffic-conditioner.h"
+#include "traffic-models.h"
+#include "wan-topology-helper.h"
+#ifdef NS3_MPI
+#include "ns3/mpi-interface.h"
+#include <mpi.h>
+#endif
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <unordered_map>
 #include <iomanip>                      // Required for std::setprecision
+#include <sstream>
 
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE("QoSImplementation");
 
-const std::string LINK_DATA_RATE = "5Mbps"; // Link Capacity (Bottleneck)
+const std::string LINK_DATA_RATE = "5Mbps"; // Default Link Capacity (Bottleneck), see --bottleneckRate
 const double SIMULATION_TIME = 15.0;       // Total Simulation Time
+const double DELAY_BIN_WIDTH = 0.0001;     // FlowMonitor delay histogram bin (100us)
+// Source parameters, shared by the applications and --qosPlacement=auto's
+// estimate of their load
+const std::string VOIP_ONOFF_RATE = "2Mbps"; // --traffic=onoff VoIP source
+const uint32_t VOIP_ONOFF_PACKET = 200;
+const uint32_t VIDEO_PACKET = 1200;         // --traffic=models VBR video
+const uint32_t FTP_PACKET = 1500;           // UDP FTP source
 
-// --- Q2: Function to Configure and Install PfifoFastQueueDisc ---
-void InstallQoS(Ptr<NetDevice> device)
+// =================================================================
+// WanSchedulerQueueDisc: classful scheduler (Strict Priority / DRR / WFQ)
+// Three classes selected by DSCP, each a child queue disc (FIFO by default).
+// =================================================================
+class WanSchedulerQueueDisc : public QueueDisc
+{
+public:
+    enum Mode { STRICT_PRIORITY, DRR, WFQ };
+    static const uint32_t N_CLASSES = 3;
+
+    static TypeId GetTypeId(void);
+    WanSchedulerQueueDisc();
+    virtual ~WanSchedulerQueueDisc() {}
+
+    // Class for a DSCP: 0 = EF/CS5-7 (real time), 1 = AF/CS1-4, 2 = BE and the rest.
+    static uint32_t ClassifyDscp(uint8_t dscp);
+
+private:
+    virtual bool DoEnqueue(Ptr<QueueDiscItem> item) override;
+    virtual Ptr<QueueDiscItem> DoDequeue(void) override;
+    virtual bool CheckConfig(void) override;
+    virtual void InitializeParams(void) override;
+
+    Ptr<QueueDiscItem> DequeueStrictPriority(void);
+    Ptr<QueueDiscItem> DequeueDrr(void);
+    Ptr<QueueDiscItem> DequeueWfq(void);
+    Ptr<QueueDisc> GetChild(uint32_t c) const { return GetQueueDiscClass(c)->GetQueueDisc(); }
+
+    Mode m_mode;
+    std::string m_weightsStr;         // e.g. "4 2 1", one weight per class
+    uint32_t m_quantum;               // DRR bytes per round per unit of weight
+    double m_weights[N_CLASSES];
+
+    // DRR: round-robin ring of backlogged classes (fixed size, no allocation)
+    uint32_t m_deficit[N_CLASSES];
+    uint32_t m_ring[N_CLASSES];
+    uint32_t m_ringHead;
+    uint32_t m_ringCount;
+    bool m_inRing[N_CLASSES];
+
+    // WFQ: self-clocked fair queueing on head-of-line packets
+    double m_virtualTime;
+    double m_lastFinish[N_CLASSES];
+    double m_headFinish[N_CLASSES];
+    bool m_headTagged[N_CLASSES];
+};
+
+NS_OBJECT_ENSURE_REGISTERED(WanSchedulerQueueDisc);
+
+TypeId WanSchedulerQueueDisc::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::WanSchedulerQueueDisc")
+        .SetParent<QueueDisc>()
+        .SetGroupName("TrafficControl")
+        .AddConstructor<WanSchedulerQueueDisc>()
+        .AddAttribute("Mode", "Scheduling discipline across the classes",
+                      EnumValue(STRICT_PRIORITY),
+                      MakeEnumAccessor(&WanSchedulerQueueDisc::m_mode),
+                      MakeEnumChecker(STRICT_PRIORITY, "SP", DRR, "DRR", WFQ, "WFQ"))
+        .AddAttribute("Weights", "Space-separated weight of each class (EF AF BE) for DRR/WFQ",
+                      StringValue("1 1 1"),
+                      MakeStringAccessor(&WanSchedulerQueueDisc::m_weightsStr),
+                      MakeStringChecker())
+        .AddAttribute("Quantum", "DRR quantum in bytes for a class of weight 1",
+                      UintegerValue(1514),
+                      MakeUintegerAccessor(&WanSchedulerQueueDisc::m_quantum),
+                      MakeUintegerChecker<uint32_t>(1));
+    return tid;
+}
+
+WanSchedulerQueueDisc::WanSchedulerQueueDisc()
+: QueueDisc(QueueDiscSizePolicy::NO_LIMITS), // Limits are enforced by the children
+  m_mode(STRICT_PRIORITY),
+  m_quantum(1514),
+  m_ringHead(0),
+  m_ringCount(0),
+  m_virtualTime(0)
+{
+    for (uint32_t c = 0; c < N_CLASSES; ++c) {
+        m_weights[c] = 1.0;
+        m_deficit[c] = 0;
+        m_inRing[c] = false;
+        m_lastFinish[c] = 0;
+        m_headFinish[c] = 0;
+        m_headTagged[c] = false;
+    }
+}
+
+uint32_t WanSchedulerQueueDisc::ClassifyDscp(uint8_t dscp)
+{
+    if (dscp >= 0x28) { // CS5 and above: EF, VOICE-ADMIT, CS5-CS7
+        return 0;
+    }
+    if (dscp >= 0x08) {                                  // CS1-CS4 and AF11-AF43
+        return 1;
+    }
+    return 2;
+}
+
+bool WanSchedulerQueueDisc::DoEnqueue(Ptr<QueueDiscItem> item)
+{
+    uint8_t tos = 0;
+    item->GetUint8Value(QueueItem::IP_DSFIELD, tos);
+    uint32_t c = ClassifyDscp(tos >> 2);
+
+    // On failure the child has already dropped (and traced) the packet.
+    if (!GetChild(c)->Enqueue(item)) {
+        return false;
+    }
+    if (m_mode == DRR && !m_inRing[c]) {
+        m_ring[(m_ringHead + m_ringCount) % N_CLASSES] = c;
+        ++m_ringCount;
+        m_inRing[c] = true;
+        m_deficit[c] = 0;
+    }
+    return true;
+}
+
+Ptr<QueueDiscItem> WanSchedulerQueueDisc::DoDequeue(void)
+{
+    switch (m_mode) {
+    case DRR:
+        return DequeueDrr();
+    case WFQ:
+        return DequeueWfq();
+    default:
+        return DequeueStrictPriority();
+    }
+}
+
+Ptr<QueueDiscItem> WanSchedulerQueueDisc::DequeueStrictPriority(void)
+{
+    for (uint32_t c = 0; c < N_CLASSES; ++c) {
+        Ptr<QueueDiscItem> item = GetChild(c)->Dequeue();
+        if (item != 0) {
+            return item;
+        }
+    }
+    return 0;
+}
+
+Ptr<QueueDiscItem> WanSchedulerQueueDisc::DequeueDrr(void)
+{
+    while (m_ringCount > 0) {
+        uint32_t c = m_ring[m_ringHead];
+        Ptr<const QueueDiscItem> head = GetChild(c)->Peek();
+        if (head == 0) {
+            // Drained (possibly by the child's own AQM): leave the round.
+            m_inRing[c] = false;
+            m_ringHead = (m_ringHead + 1) % N_CLASSES;
+            --m_ringCount;
+            continue;
+        }
+        if (m_deficit[c] < head->GetSize()) {
+            // Out of credit: top up and move to the back of the round.
+            m_deficit[c] += std::max<uint32_t>(1, static_cast<uint32_t>(m_weights[c] * m_quantum));
+            m_ringHead = (m_ringHead + 1) % N_CLASSES;
+            m_ring[(m_ringHead + m_ringCount - 1) % N_CLASSES] = c;
+            continue;
+        }
+        Ptr<QueueDiscItem> item = GetChild(c)->Dequeue();
+        m_deficit[c] -= item->GetSize();
+        return item;
+    }
+    return 0;
+}
+
+Ptr<QueueDiscItem> WanSchedulerQueueDisc::DequeueWfq(void)
+{
+    // Each backlogged class is tagged with the virtual finish time of its
+    // head packet; the smallest tag goes first and becomes the system clock.
+    int32_t best = -1;
+    for (uint32_t c = 0; c < N_CLASSES; ++c) {
+        Ptr<const QueueDiscItem> head = GetChild(c)->Peek();
+        if (head == 0) {
+            m_headTagged[c] = false;
+            continue;
+        }
+        if (!m_headTagged[c]) {
+            m_headFinish[c] = std::max(m_virtualTime, m_lastFinish[c]) + head->GetSize() / m_weights[c];
+            m_headTagged[c] = true;
+        }
+        if (best < 0 || m_headFinish[c] < m_headFinish[best]) {
+            best = c;
+        }
+    }
+    if (best < 0) {
+        return 0;
+    }
+    m_virtualTime = m_headFinish[best];
+    m_lastFinish[best] = m_headFinish[best];
+    m_headTagged[best] = false;
+    return GetChild(best)->Dequeue();
+}
+
+bool WanSchedulerQueueDisc::CheckConfig(void)
+{
+    if (GetNInternalQueues() > 0) {
+        NS_LOG_ERROR("WanSchedulerQueueDisc cannot have internal queues");
+        return false;
+    }
+    if (GetNQueueDiscClasses() == 0) {
+        // No classes configured through the helper: one FIFO per class.
+        for (uint32_t c = 0; c < N_CLASSES; ++c) {
+            Ptr<QueueDisc> qd = CreateObject<FifoQueueDisc>();
+            qd->Initialize();
+            Ptr<QueueDiscClass> qdc = CreateObject<QueueDiscClass>();
+            qdc->SetQueueDisc(qd);
+            AddQueueDiscClass(qdc);
+        }
+    }
+    if (GetNQueueDiscClasses() != N_CLASSES) {
+        NS_LOG_ERROR("WanSchedulerQueueDisc needs exactly " << N_CLASSES << " classes");
+        return false;
+    }
+    return true;
+}
+
+void WanSchedulerQueueDisc::InitializeParams(void)
+{
+    std::istringstream is(m_weightsStr);
+    for (uint32_t c = 0; c < N_CLASSES; ++c) {
+        NS_ABORT_MSG_UNLESS(is >> m_weights[c] && m_weights[c] > 0,
+                            "Weights must list " << N_CLASSES << " positive values: " << m_weightsStr);
+    }
+}
+
+// --- Q2: Scheduler selection for InstallQoS ---
+struct QoSConfig
+{
+    std::string scheduler; // "pfifo" (PfifoFast), "sp", "drr" or "wfq"
+    std::string weights;   // Per-class weights (EF AF BE) for drr/wfq
+    uint32_t quantum;      // DRR quantum in bytes per unit weight
+    std::string aqm;       // Per-class AQM: "none", "codel", "fqcodel" or "pie"
+    std::string condition; // TrafficConditionerQueueDisc profiles, "" for none
+    std::string marks;     // TrafficConditionerQueueDisc marking rules, "" for none
+    std::string deviceQueue; // Device queue under the queue disc, e.g. "5p"
+};
+
+// --- Q2: Function to Configure and Install the Queue Disc ---
+// Returns the root queue disc so its drop statistics can be reported.
+Ptr<QueueDisc> InstallQoS(Ptr<NetDevice> device, const QoSConfig& config)
 {
     TrafficControlHelper tcHelper;
 
-    // Use SetRootQueueDisc and configure via Attributes
-    tcHelper.SetRootQueueDisc("ns3::PfifoFastQueueDisc",
-                              "Bands", UintegerValue(3)); 
+    // An edge conditioner becomes the root, with the scheduler as its child
+    uint16_t conditioner = 0;
+    TrafficControlHelper::ClassIdList conditionerClass;
+    if (!config.condition.empty() || !config.marks.empty()) {
+        conditioner = tcHelper.SetRootQueueDisc(TrafficConditionerQueueDisc::GetTypeId().GetName(),
+                                                "Profiles", StringValue(config.condition),
+                                                "Marks", StringValue(config.marks));
+        conditionerClass = tcHelper.AddQueueDiscClasses(conditioner, 1, "ns3::QueueDiscClass");
+    }
+
+    std::string aqmType;
+    if (config.aqm == "codel") {
+        aqmType = "ns3::CoDelQueueDisc";
+    } else if (config.aqm == "fqcodel") {
+        aqmType = "ns3::FqCoDelQueueDisc";
+    } else if (config.aqm == "pie") {
+        aqmType = "ns3::PieQueueDisc";
+    } else {
+        NS_ABORT_MSG_UNLESS(config.aqm == "none", "Unknown AQM " << config.aqm);
+    }
+
+    if (config.scheduler == "pfifo" && aqmType.empty()) {
+        // Use SetRootQueueDisc and configure via Attributes
+        if (conditionerClass.empty()) {
+            tcHelper.SetRootQueueDisc("ns3::PfifoFastQueueDisc");
+        } else {
+            tcHelper.AddChildQueueDisc(conditioner, conditionerClass[0], "ns3::PfifoFastQueueDisc");
+        }
+    } else {
+        // PfifoFast has no child classes, so with an AQM it is replaced by
+        // the equivalent three-band strict priority scheduler.
+        std::string mode = config.scheduler == "drr" ? "DRR" : config.scheduler == "wfq" ? "WFQ" : "SP";
+        NS_ABORT_MSG_UNLESS(config.scheduler == "sp" || config.scheduler == "pfifo" || mode != "SP",
+                            "Unknown scheduler " << config.scheduler);
+        uint16_t handle = conditionerClass.empty()
+            ? tcHelper.SetRootQueueDisc("ns3::WanSchedulerQueueDisc",
+                                        "Mode", StringValue(mode),
+                                        "Weights", StringValue(config.weights),
+                                        "Quantum", UintegerValue(config.quantum))
+            : tcHelper.AddChildQueueDisc(conditioner, conditionerClass[0], "ns3::WanSchedulerQueueDisc",
+                                         "Mode", StringValue(mode),
+                                         "Weights", StringValue(config.weights),
+                                         "Quantum", UintegerValue(config.quantum));
+        if (!aqmType.empty()) {
+            TrafficControlHelper::ClassIdList cid =
+                tcHelper.AddQueueDiscClasses(handle, WanSchedulerQueueDisc::N_CLASSES, "ns3::QueueDiscClass");
+            tcHelper.AddChildQueueDiscs(handle, cid, aqmType);
+        }
+    }
+
+    // The scheduler (and any AQM) can only arbitrate a backlog it holds:
+    // shrink the device queue so the backlog builds in the queue disc
+    // instead of in the device FIFO, where EF waits behind every BE packet.
+    Ptr<PointToPointNetDevice> p2pDevice = DynamicCast<PointToPointNetDevice>(device);
+    if (p2pDevice != 0) {
+        p2pDevice->GetQueue()->SetMaxSize(QueueSize(config.deviceQueue));
+    }
     
+    // Address assignment already gave the device a default root queue disc.
+    tcHelper.Uninstall(device);
     // Install the queue disc on the device's output queue (TX side)
-    tcHelper.Install(device);
-    NS_LOG_INFO("QoS: PfifoFast installed on device " << device->GetNode()->GetId() << ":" << device->GetIfIndex());
+    QueueDiscContainer qdiscs = tcHelper.Install(device);
+    NS_LOG_INFO("QoS: " << (conditionerClass.empty() ? "" : "conditioner/") << config.scheduler << "/" << config.aqm << " installed on device " << device->GetNode()->GetId() << ":" << device->GetIfIndex());
+    return qdiscs.Get(0);
 }
 
-// --- Metrics Collection using FlowMonitor ---
-// FIX: The FlowMonitorHelper object (flowHelper) must be passed to retrieve the classifier
-void CheckMetrics(Ptr<FlowMonitor> fm, FlowMonitorHelper* flowHelper) 
+// --- Automatic QoS placement ---
+// Finds the egress devices whose offered load can exceed their link rate.
+// Each demand is routed hop by hop through the installed routing tables and
+// adds its rate to every egress on its path; an elastic (TCP) demand grows to
+// whatever its slowest hop leaves, so it only loads that one. Egresses are
+// kept in (node, interface) order, so the outcome does not depend on pointers.
+class QosPlacement
 {
-    std::cout << "\n--- Q3: QoS Performance Verification ---\n";
+public:
+    struct Egress
+    {
+        Egress() : offered(0), rate(0), elastic(false) {}
+        Ptr<NetDevice> device;
+        double offered;     // bit/s, inelastic demands
+        double rate;        // bit/s of the link, 0 if unknown
+        bool elastic;       // An elastic demand bottlenecks here
+    };
+
+    void AddDemand(Ptr<Node> source, Ipv4Address destination, double bps, bool elastic)
+    {
+        std::vector<Ptr<NetDevice> > path = Trace(source, destination);
+        Ptr<NetDevice> slowest;
+        for (const Ptr<NetDevice>& dev : path) {
+            Egress& e = Get(dev);
+            e.offered += bps;
+            if (e.rate > 0 && (slowest == 0 || e.rate < Get(slowest).rate)) {
+                slowest = dev; // Links of unknown rate cannot be placed on
+            }
+        }
+        if (elastic && slowest != 0) {
+            Get(slowest).elastic = true;
+        }
+    }
+
+    // Egresses loaded beyond 'load' times their rate, most loaded first
+    // (elastic bottlenecks count as fully loaded).
+    std::vector<Egress> GetCongested(double load) const
+    {
+        std::vector<Egress> congested;
+        for (const std::pair<const std::pair<uint32_t, uint32_t>, Egress>& e : m_egress) {
+            if (e.second.rate > 0 && (e.second.elastic || e.second.offered > load * e.second.rate)) {
+                congested.push_back(e.second);
+            }
+        }
+        std::stable_sort(congested.begin(), congested.end(), [](const Egress& a, const Egress& b) {
+            return Utilization(a) > Utilization(b);
+        });
+        return congested;
+    }
+
+    uint32_t GetNEgresses(void) const { return m_egress.size(); }
+
+    static double Utilization(const Egress& e) { return std::max(e.elastic ? 1.0 : 0.0, e.offered / e.rate); }
+
+private:
+    Egress& Get(Ptr<NetDevice> dev)
+    {
+        Egress& e = m_egress[std::make_pair(dev->GetNode()->GetId(), dev->GetIfIndex())];
+        if (e.device == 0) {
+            e.device = dev;
+            Ptr<PointToPointNetDevice> p2p = DynamicCast<PointToPointNetDevice>(dev);
+            if (p2p != 0) {
+                DataRateValue rate;
+                p2p->GetAttribute("DataRate", rate);
+                e.rate = rate.Get().GetBitRate();
+            }
+        }
+        return e;
+    }
+
+    // Egress devices from 'source' to 'destination', following RouteOutput
+    // at each node (empty if a hop has no route).
+    static std::vector<Ptr<NetDevice> > Trace(Ptr<Node> source, Ipv4Address destination)
+    {
+        std::vector<Ptr<NetDevice> > path;
+        Ipv4Header header;
+        header.SetDestination(destination);
+        Ptr<Node> node = source;
+        for (uint32_t hop = 0; hop < 255; ++hop) { // TTL bound, in case of a loop
+            Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
+            if (ipv4->GetInterfaceForAddress(destination) >= 0) {
+                return path;
+            }
+            Socket::SocketErrno err;
+            Ptr<Ipv4Route> route = ipv4->GetRoutingProtocol()->RouteOutput(Ptr<Packet>(), header, 0, err);
+            if (route == 0 || route->GetOutputDevice()->GetChannel() == 0) {
+                break;
+            }
+            Ptr<NetDevice> dev = route->GetOutputDevice();
+            path.push_back(dev);
+            Ptr<Channel> channel = dev->GetChannel();
+            Ptr<Node> next;
+            for (std::size_t i = 0; i < channel->GetNDevices(); ++i) {
+                if (channel->GetDevice(i) != dev) {
+                    next = channel->GetDevice(i)->GetNode(); // Point-to-point: the one peer
+                }
+            }
+            if (next == 0) {
+                break;
+            }
+            node = next;
+        }
+        return std::vector<Ptr<NetDevice> >();
+    }
+
+    std::map<std::pair<uint32_t, uint32_t>, Egress> m_egress;
+};
+
+// The DSCP a flow is classified by: the one most of its packets carried.
+// The classifier counts every hop, so a flow marked at the edge (--marks) is
+// also seen unmarked at its source; any marking outranks the unmarked count.
+static uint8_t GetFlowDscp(Ptr<Ipv4FlowClassifier> classifier, FlowId id)
+{
+    std::vector<std::pair<Ipv4Header::DscpType, uint32_t> > counts = classifier->GetDscpCounts(id);
+    uint8_t dscp = 0;
+    uint32_t best = 0;
+    for (uint32_t k = 0; k < counts.size(); ++k) {
+        if (counts[k].first != Ipv4Header::DscpDefault && (dscp == 0 || counts[k].second > best)) {
+            best = counts[k].second;
+            dscp = counts[k].first;
+        } else if (dscp == 0 && counts[k].second > best) {
+            best = counts[k].second;
+            dscp = counts[k].first;
+        }
+    }
+    return dscp;
+}
+
+// =================================================================
+// FlowMonitorSampler: periodic per-flow deltas streamed to CSV or binary
+// =================================================================
+class FlowMonitorSampler
+{
+public:
+    // One flow over one interval; the binary format is FMS2 (flow-results-format.h).
+    typedef FlowResultRecord Record;
+
+    // Records are buffered in a preallocated ring of 'capacity' entries and
+    // written out in one block whenever it fills, so memory stays bounded
+    // however long the run is. 'config' goes into the binary file's header.
+    FlowMonitorSampler(Ptr<FlowMonitor> fm, Ptr<Ipv4FlowClassifier> classifier, Time interval,
+                       const std::string& path, bool binary, const std::string& config,
+                       uint32_t capacity = 65536);
+    ~FlowMonitorSampler() { Flush(); }
+
+    void Start(Time at) { m_event = Simulator::Schedule(at, &FlowMonitorSampler::Sample, this); }
+    void Flush(void);
+
+private:
+    void Sample(void);
+
+    Ptr<FlowMonitor> m_fm;
+    Ptr<Ipv4FlowClassifier> m_classifier;
+    Time m_interval;
+    std::ofstream m_out;
+    bool m_binary;
+    std::vector<Record> m_ring;
+    uint32_t m_count;
+    std::vector<Record> m_last;  // Cumulative counters at the previous tick, by FlowId
+    EventId m_event;
+};
+
+FlowMonitorSampler::FlowMonitorSampler(Ptr<FlowMonitor> fm, Ptr<Ipv4FlowClassifier> classifier, Time interval,
+                                       const std::string& path, bool binary, const std::string& config,
+                                       uint32_t capacity)
+: m_fm(fm),
+  m_classifier(classifier),
+  m_interval(interval),
+  m_out(path.c_str(), binary ? std::ios::out | std::ios::binary : std::ios::out),
+  m_binary(binary),
+  m_ring(capacity),
+  m_count(0)
+{
+    NS_ABORT_MSG_UNLESS(m_out.is_open(), "Cannot open sample file " << path);
+    if (m_binary) {
+        WriteFlowResultsHeader(m_out, RngSeedManager::GetRun(), interval.GetNanoSeconds(), config);
+    } else {
+        m_out << "time_s,flow_id,dscp,tx_packets,rx_packets,lost_packets,tx_bytes,rx_bytes,delay_sum_s,jitter_sum_s\n";
+    }
+}
+
+void FlowMonitorSampler::Sample(void)
+{
+    int64_t now = Simulator::Now().GetNanoSeconds();
+    // Const reference: the stats map is walked in place, never copied.
+    const FlowMonitor::FlowStatsContainer& stats = m_fm->GetFlowStats();
+    for (FlowMonitor::FlowStatsContainer::const_iterator i = stats.begin(); i != stats.end(); ++i) {
+        if (i->first >= m_last.size()) {
+            m_last.resize(i->first + 1, Record());  // FlowIds are dense; grows once per new flow
+        }
+        Record& last = m_last[i->first];
+        if (last.txPackets == 0 && last.rxPackets == 0 && last.lostPackets == 0) {
+            last.dscp = GetFlowDscp(m_classifier, i->first); // First time the flow is recorded
+        }
+        const FlowMonitor::FlowStats& fs = i->second;
+        if (fs.txPackets == last.txPackets && fs.rxPackets == last.rxPackets &&
+            fs.lostPackets == last.lostPackets) {
+            continue; // Idle flow: nothing to record
+        }
+
+        Record& r = m_ring[m_count];
+        r.timeNs = now;
+        r.flowId = i->first;
+        r.txPackets = fs.txPackets - last.txPackets;
+        r.rxPackets = fs.rxPackets - last.rxPackets;
+        r.lostPackets = fs.lostPackets - last.lostPackets;
+        r.txBytes = fs.txBytes - last.txBytes;
+        r.rxBytes = fs.rxBytes - last.rxBytes;
+        r.delaySumNs = fs.delaySum.GetNanoSeconds() - last.delaySumNs;
+        r.jitterSumNs = fs.jitterSum.GetNanoSeconds() - last.jitterSumNs;
+        r.dscp = last.dscp;
+
+        last.txPackets = fs.txPackets;
+        last.rxPackets = fs.rxPackets;
+        last.lostPackets = fs.lostPackets;
+        last.txBytes = fs.txBytes;
+        last.rxBytes = fs.rxBytes;
+        last.delaySumNs = fs.delaySum.GetNanoSeconds();
+        last.jitterSumNs = fs.jitterSum.GetNanoSeconds();
+
+        if (++m_count == m_ring.size()) {
+            Flush();
+        }
+    }
+    m_event = Simulator::Schedule(m_interval, &FlowMonitorSampler::Sample, this);
+}
+
+void FlowMonitorSampler::Flush(void)
+{
+    if (m_binary) {
+        m_out.write(reinterpret_cast<const char*>(m_ring.data()), m_count * sizeof(Record));
+    } else {
+        for (uint32_t i = 0; i < m_count; ++i) {
+            const Record& r = m_ring[i];
+            m_out << r.timeNs / 1e9 << ',' << r.flowId << ',' << static_cast<uint32_t>(r.dscp) << ',' << r.txPackets << ',' << r.rxPackets << ','
+                  << r.lostPackets << ',' << r.txBytes << ',' << r.rxBytes << ','
+                  << r.delaySumNs / 1e9 << ',' << r.jitterSumNs / 1e9 << '\n';
+        }
+    }
+    m_out.flush();
+    m_count = 0;
+}
+
+// --- Per-class aggregation: one fixed accumulator per DSCP class selector ---
+// Class = DSCP >> 3, i.e. CS0 (BE) ... CS7; EF (46) falls in class 5 and the
+// AFx1-AFx3 codepoints in classes 1-4.
+const uint32_t N_TRAFFIC_CLASSES = 8;
+
+const char* const TRAFFIC_CLASS_NAMES[N_TRAFFIC_CLASSES] = {
+    "FTP (Low Priority / DSCP BE)", "CS1 / AF1x", "CS2 / AF2x", "CS3 / AF3x",
+    "CS4 / AF4x", "VoIP (High Priority / DSCP EF)", "CS6", "CS7"};
+
+// Metric name prefixes for batch reports.
+const char* const TRAFFIC_CLASS_KEYS[N_TRAFFIC_CLASSES] = {"be", "cs1", "cs2", "cs3", "cs4", "ef", "cs6", "cs7"};
+
+// Expected outcome of the original VoIP/FTP experiment, shown next to the values.
+static std::string Expect(uint32_t trafficClass, const char* ef, const char* be)
+{
+    return trafficClass == 5 ? std::string(" [Expected: ") + ef + "]"
+         : trafficClass == 0 ? std::string(" [Expected: ") + be + "]" : std::string();
+}
+
+// Welford running mean and variance, with extremes: O(1) per sample and
+// readable at any time.
+struct RunningStats
+{
+    RunningStats() : n(0), mean(0), m2(0), min(0), max(0) {}
+
+    void Add(double x)
+    {
+        ++n;
+        double d = x - mean;
+        mean += d / n;
+        m2 += d * (x - mean);
+        min = n == 1 ? x : std::min(min, x);
+        max = n == 1 ? x : std::max(max, x);
+    }
+
+    double GetStdDev(void) const { return n > 1 ? std::sqrt(m2 / (n - 1)) : 0.0; }
+
+    uint64_t n;
+    double mean;
+    double m2;    // Sum of squared deviations from the running mean
+    double min;
+    double max;
+};
+
+struct TrafficClassStats
+{
+    TrafficClassStats() : flows(0), txPackets(0), rxPackets(0), rxBytes(0), untimed(0), delaySum(0), jitterSum(0) {}
 
-    double totalTxVoIP = 0, totalRxVoIP = 0, totalDelayVoIP = 0, totalJitterVoIP = 0;
-    double totalTxFTP = 0, totalRxFTP = 0, totalDelayFTP = 0;
+    uint32_t flows;
+    double txPackets;
+    double rxPackets;
+    double rxBytes;
+    double untimed;    // Received packets without a delay (RxClassTap, TCP)
+    double delaySum;   // Seconds
+    double jitterSum;  // Seconds
+    LatencyHistogram delay;
+    RunningStats delayStats; // Seconds; only measured per packet (RxClassTap)
+};
 
+// --- Metrics Collection using FlowMonitor ---
+// FIX: The FlowMonitorHelper object (flowHelper) must be passed to retrieve the classifier
+static void CollectClassStats(Ptr<FlowMonitor> fm, FlowMonitorHelper* flowHelper,
+                              TrafficClassStats classes[N_TRAFFIC_CLASSES])
+{
     // FIX: Retrieve the classifier directly from the FlowMonitorHelper object.
     Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier>(flowHelper->GetClassifier());
     
-    std::map<FlowId, FlowMonitor::FlowStats> stats = fm->GetFlowStats();
+    // One linear pass over the flows, by reference, into the class accumulators.
+    // Flows are classified by DSCP, not by port: the sources use ephemeral ports.
+    const FlowMonitor::FlowStatsContainer& stats = fm->GetFlowStats();
+    for (FlowMonitor::FlowStatsContainer::const_iterator i = stats.begin(); i != stats.end(); ++i)
+    {
+        TrafficClassStats& c = classes[GetFlowDscp(classifier, i->first) >> 3];
+        c.flows++;
+        c.txPackets += i->second.txPackets;
+        c.rxPackets += i->second.rxPackets;
+        c.rxBytes += i->second.rxBytes;
+        c.delaySum += i->second.delaySum.GetSeconds();
+        c.jitterSum += i->second.jitterSum.GetSeconds();
+        // Per-class tail latency: each flow's delay histogram is folded in bin by bin
+        c.delay.Record(i->second.delayHistogram, DELAY_BIN_WIDTH);
+    }
+}
 
-    for (std::map<FlowId, FlowMonitor::FlowStats>::const_iterator i = stats.begin(); i != stats.end(); ++i)
+// Prints the per-class results; in a batch replication the same values are
+// also reported to the runner.
+static void ReportClassStats(const TrafficClassStats classes[N_TRAFFIC_CLASSES], BatchRunner* batch)
+{
+    // Report the busiest classes first: EF, then the AF classes, then BE.
+    const uint32_t order[N_TRAFFIC_CLASSES] = {5, 7, 6, 4, 3, 2, 1, 0};
+    for (uint32_t k = 0; k < N_TRAFFIC_CLASSES; ++k)
     {
-        Ipv4FlowClassifier::FiveTuple t = classifier->FindFlow(i->first);
+        const TrafficClassStats& c = classes[order[k]];
+        if (c.rxPackets == 0) {
+            continue;
+        }
+        double loss = (c.txPackets - c.rxPackets) / c.txPackets * 100.0;
+        double avgDelay = c.delaySum / c.rxPackets * 1000.0;
+        double avgJitter = c.jitterSum / c.rxPackets * 1000.0;
+        double throughput = (c.rxBytes * 8.0) / ((SIMULATION_TIME - 3.0) * 1000000.0);
 
-        // Classify the flows based on the source port (9=VoIP, 10=FTP)
-        if (t.sourcePort == 9) // VoIP Flow
-        {
-            totalTxVoIP += i->second.txPackets;
-            totalRxVoIP += i->second.rxPackets;
-            totalDelayVoIP += i->second.delaySum.GetSeconds();
-            totalJitterVoIP += i->second.jitterSum.GetSeconds();
+        std::cout << "\n" << TRAFFIC_CLASS_NAMES[order[k]] << " [" << c.flows << " flows]:\n";
+        std::cout << "  Packet Loss: " << std::fixed << std::setprecision(2) << loss << " %" << Expect(order[k], "Near 0%", "High") << "\n";
+        // A delay over only part of the class would understate it: without
+        // FlowMonitor, a class carrying TCP has none
+        bool timed = c.untimed == 0;
+        if (timed) {
+            std::cout << "  Avg Latency: " << std::fixed << std::setprecision(2) << avgDelay << " ms" << Expect(order[k], "Low", "High") << "\n";
+            std::cout << "  Avg Jitter:  " << std::fixed << std::setprecision(2) << avgJitter << " ms" << Expect(order[k], "Low", "-") << "\n";
+            if (c.delayStats.n > 0) {
+                std::cout << "  Latency sd/min/max: " << std::fixed << std::setprecision(2) << c.delayStats.GetStdDev() * 1000.0
+                          << " / " << c.delayStats.min * 1000.0 << " / " << c.delayStats.max * 1000.0 << " ms\n";
+            }
+            std::cout << "  Latency p50/p99/p99.9: " << std::fixed << std::setprecision(2) << c.delay.GetPercentileMs(0.5)
+                      << " / " << c.delay.GetPercentileMs(0.99) << " / " << c.delay.GetPercentileMs(0.999) << " ms\n";
+        } else {
+            std::cout << "  Latency:     n/a (" << c.untimed << " packets without a send time)\n";
         }
-        else if (t.sourcePort == 10) // FTP Flow
-        {
-            totalTxFTP += i->second.txPackets;
-            totalRxFTP += i->second.rxPackets;
-            totalDelayFTP += i->second.delaySum.GetSeconds();
+        std::cout << "  Throughput:  " << std::fixed << std::setprecision(2) << throughput << " Mbps" << Expect(order[k], "-", "Bottlenecked") << "\n";
+
+        std::string key = TRAFFIC_CLASS_KEYS[order[k]];
+        batch->Report(key + ".loss_pct", loss);
+        if (timed) {
+            batch->Report(key + ".delay_ms", avgDelay);
+            batch->Report(key + ".jitter_ms", avgJitter);
+            if (c.delayStats.n > 0) {
+                batch->Report(key + ".delay_sd_ms", c.delayStats.GetStdDev() * 1000.0);
+                batch->Report(key + ".delay_max_ms", c.delayStats.max * 1000.0);
+            }
+            batch->Report(key + ".p50_ms", c.delay.GetPercentileMs(0.5));
+            batch->Report(key + ".p99_ms", c.delay.GetPercentileMs(0.99));
+            batch->Report(key + ".p999_ms", c.delay.GetPercentileMs(0.999));
         }
+        batch->Report(key + ".throughput_mbps", throughput);
     }
+}
 
-    // --- Metrics for VoIP (High Priority - DSCP EF) ---
-    if (totalRxVoIP > 0)
+// Application goodput per class from the sinks' GetTotalRx(), and for TCP the
+// congestion window and RTT of every bulk sender. The trace callbacks only
+// update running counters (a time-weighted cwnd mean, RTT sum and extremes),
+// so tracing costs no logging or allocation per ACK.
+class TransportMetrics
+{
+public:
+    TransportMetrics() {}
+
+    void AddSink(uint32_t trafficClass, const ApplicationContainer& sinkApps)
     {
-        double lossVoIP = (totalTxVoIP - totalRxVoIP) / totalTxVoIP * 100.0;
-        double avgDelayVoIP = totalDelayVoIP / totalRxVoIP * 1000.0;
-        double avgJitterVoIP = totalJitterVoIP / totalRxVoIP * 1000.0;
+        for (uint32_t i = 0; i < sinkApps.GetN(); ++i) {
+            m_sinks.push_back(std::make_pair(trafficClass, DynamicCast<PacketSink>(sinkApps.Get(i))));
+        }
+    }
 
-        std::cout << "VoIP (High Priority / DSCP EF):\n";
-        std::cout << "  Packet Loss: " << std::fixed << std::setprecision(2) << lossVoIP << " % [Expected: Near 0%]\n";
-        std::cout << "  Avg Latency: " << std::fixed << std::setprecision(2) << avgDelayVoIP << " ms [Expected: Low]\n";
-        std::cout << "  Avg Jitter:  " << std::fixed << std::setprecision(2) << avgJitterVoIP << " ms [Expected: Low]\n";
+    // The sockets exist once the applications start, so the traces are
+    // hooked just after 'start'.
+    void TrackTcp(const std::string& congestionControl, const ApplicationContainer& bulkApps, Time start, Time stop)
+    {
+        m_cc = congestionControl;
+        m_stop = stop;
+        for (uint32_t i = 0; i < bulkApps.GetN(); ++i) {
+            m_tcp.push_back(TcpProbe());
+            Simulator::Schedule(start + NanoSeconds(1), &TransportMetrics::Connect, &m_tcp.back(),
+                                DynamicCast<BulkSendApplication>(bulkApps.Get(i)));
+        }
     }
 
-    // --- Metrics for FTP (Low Priority - DSCP BE) ---
-    if (totalRxFTP > 0)
+    void Report(BatchRunner* batch) const
     {
-        double lossFTP = (totalTxFTP - totalRxFTP) / totalTxFTP * 100.0;
-        double throughputFTP = (totalRxFTP * 1500.0 * 8.0) / ((SIMULATION_TIME - 3.0) * 1000000.0);
-        double avgDelayFTP = totalDelayFTP / totalRxFTP * 1000.0;
+        if (!m_sinks.empty()) {
+            std::cout << "\nApplication Goodput (PacketSink):\n";
+        }
+        for (const std::pair<uint32_t, Ptr<PacketSink> >& s : m_sinks) {
+            double goodput = s.second->GetTotalRx() * 8.0 / ((SIMULATION_TIME - 3.0) * 1000000.0);
+            std::cout << "  " << TRAFFIC_CLASS_KEYS[s.first] << ": " << std::fixed << std::setprecision(2)
+                      << goodput << " Mbps\n";
+            batch->Report(std::string(TRAFFIC_CLASS_KEYS[s.first]) + ".goodput_mbps", goodput);
+        }
+        if (m_tcp.empty()) {
+            return;
+        }
+        std::cout << "\nTCP Bulk Senders (" << m_cc << "):\n";
+        double cwndAll = 0, rttAll = 0;
+        uint32_t rttFlows = 0;
+        Time now = std::min(Simulator::Now(), m_stop); // The senders' cwnd is frozen after they stop
+        for (uint32_t i = 0; i < m_tcp.size(); ++i) {
+            const TcpProbe& t = m_tcp[i];
+            if (t.start.IsZero()) {
+                continue; // Never connected
+            }
+            Time tracked = now - t.start;
+            double cwnd = (t.cwndArea + t.cwnd * (now - t.lastChange).GetSeconds()) / tracked.GetSeconds();
+            cwndAll += cwnd;
+            std::cout << "  Flow " << i << ": cwnd avg/max " << std::fixed << std::setprecision(1)
+                      << cwnd / 1024 << " / " << t.cwndMax / 1024.0 << " KB";
+            if (t.rttSamples > 0) {
+                double rtt = t.rttSum / t.rttSamples * 1000.0;
+                rttAll += rtt;
+                ++rttFlows;
+                std::cout << ", RTT avg/min/max " << std::setprecision(2) << rtt << " / "
+                          << t.rttMin.GetSeconds() * 1000.0 << " / " << t.rttMax.GetSeconds() * 1000.0 << " ms";
+            }
+            std::cout << "\n";
+        }
+        batch->Report("tcp.cwnd_kb", cwndAll / m_tcp.size() / 1024);
+        if (rttFlows > 0) {
+            batch->Report("tcp.rtt_ms", rttAll / rttFlows);
+        }
+    }
+
+private:
+    struct TcpProbe
+    {
+        TcpProbe() : cwnd(0), cwndMax(0), cwndArea(0), rttSamples(0), rttSum(0) {}
+
+        Time start;         // Hooked at
+        uint32_t cwnd;      // Bytes, current
+        uint32_t cwndMax;
+        Time lastChange;
+        double cwndArea;    // Byte-seconds up to lastChange
+        uint64_t rttSamples;
+        double rttSum;      // Seconds
+        Time rttMin;
+        Time rttMax;
+    };
+
+    static void Connect(TcpProbe* probe, Ptr<BulkSendApplication> app)
+    {
+        Ptr<Socket> socket = app->GetSocket();
+        if (socket == 0) {
+            return;
+        }
+        probe->start = probe->lastChange = Simulator::Now();
+        socket->TraceConnectWithoutContext("CongestionWindow", MakeBoundCallback(&TransportMetrics::OnCwnd, probe));
+        socket->TraceConnectWithoutContext("RTT", MakeBoundCallback(&TransportMetrics::OnRtt, probe));
+    }
 
-        std::cout << "\nFTP (Low Priority / DSCP BE):\n";
-        std::cout << "  Packet Loss: " << std::fixed << std::setprecision(2) << lossFTP << " % [Expected: High]\n";
-        std::cout << "  Avg Latency: " << std::fixed << std::setprecision(2) << avgDelayFTP << " ms [Expected: High]\n";
-        std::cout << "  Throughput:  " << std::fixed << std::setprecision(2) << throughputFTP << " Mbps [Expected: Bottlenecked]\n";
+    static void OnCwnd(TcpProbe* probe, uint32_t, uint32_t cwnd)
+    {
+        Time now = Simulator::Now();
+        probe->cwndArea += probe->cwnd * (now - probe->lastChange).GetSeconds();
+        probe->lastChange = now;
+        probe->cwnd = cwnd;
+        probe->cwndMax = std::max(probe->cwndMax, cwnd);
+    }
+
+    static void OnRtt(TcpProbe* probe, Time, Time rtt)
+    {
+        if (probe->rttSamples == 0 || rtt < probe->rttMin) {
+            probe->rttMin = rtt;
+        }
+        probe->rttMax = std::max(probe->rttMax, rtt);
+        probe->rttSum += rtt.GetSeconds();
+        ++probe->rttSamples;
+    }
+
+    std::string m_cc;
+    Time m_stop;
+    std::vector<std::pair<uint32_t, Ptr<PacketSink> > > m_sinks;
+    std::deque<TcpProbe> m_tcp; // Stable addresses for the callbacks
+};
+
+// Per-class queue decisions of a queue disc tree, from the counters every
+// queue disc and queue keeps anyway: one line per class (child queue disc)
+// or band (internal queue), nested as installed.
+static void PrintQueueClassCounters(std::ostream& os, Ptr<QueueDisc> qdisc, const std::string& indent)
+{
+    for (std::size_t i = 0; i < qdisc->GetNQueueDiscClasses(); ++i) {
+        Ptr<QueueDisc> child = qdisc->GetQueueDiscClass(i)->GetQueueDisc();
+        const QueueDisc::Stats& st = child->GetStats();
+        os << indent << "Class " << i << " (" << child->GetInstanceTypeId().GetName() << "): "
+           << st.nTotalSentPackets << " packets / " << st.nTotalSentBytes << " bytes sent, "
+           << st.nTotalDroppedPackets << " dropped\n";
+        PrintQueueClassCounters(os, child, indent + "  ");
+    }
+    for (std::size_t i = 0; i < qdisc->GetNInternalQueues(); ++i) {
+        Ptr<QueueDisc::InternalQueue> q = qdisc->GetInternalQueue(i);
+        os << indent << "Band " << i << ": " << q->GetTotalReceivedPackets() << " packets / "
+           << q->GetTotalReceivedBytes() << " bytes queued, " << q->GetTotalDroppedPackets() << " dropped\n";
+    }
+}
+
+// Prints (and reports) the class, transport and bottleneck queue metrics.
+static void ReportMetrics(const TrafficClassStats classes[N_TRAFFIC_CLASSES], Ptr<QueueDisc> bottleneckQdisc,
+                          const TransportMetrics* transport, BatchRunner* batch)
+{
+    std::cout << "\n--- Q3: QoS Performance Verification ---\n";
+
+    ReportClassStats(classes, batch);
+    transport->Report(batch);
+
+    // --- Bottleneck queue disc: where AQM drops happen ---
+    if (bottleneckQdisc != 0)
+    {
+        const QueueDisc::Stats& qs = bottleneckQdisc->GetStats();
+        std::cout << "\nBottleneck Queue Disc (" << bottleneckQdisc->GetInstanceTypeId().GetName() << "):\n";
+        std::cout << "  Sent:    " << qs.nTotalSentPackets << " packets\n";
+        std::cout << "  Dropped: " << qs.nTotalDroppedPackets << " packets (AQM + overflow)\n";
+        PrintQueueClassCounters(std::cout, bottleneckQdisc, "    ");
+        batch->Report("qdisc.sent", qs.nTotalSentPackets);
+        batch->Report("qdisc.dropped", qs.nTotalDroppedPackets);
+
+        Ptr<TrafficConditionerQueueDisc> conditioner = DynamicCast<TrafficConditionerQueueDisc>(bottleneckQdisc);
+        if (conditioner != 0) {
+            std::cout << "  Policed: " << qs.GetNDroppedPackets(TrafficConditionerQueueDisc::POLICED_DROP)
+                      << " packets (red at the edge)\n";
+            PrintConditionerCounts(std::cout, conditioner);
+            batch->Report("qdisc.policed", qs.GetNDroppedPackets(TrafficConditionerQueueDisc::POLICED_DROP));
+        }
     }
 }
 
+// --aggregate=flowmon: one pass over the FlowMonitor's flows, late in the run.
+void CheckMetrics(Ptr<FlowMonitor> fm, FlowMonitorHelper* flowHelper, Ptr<QueueDisc> bottleneckQdisc,
+                  const TransportMetrics* transport, BatchRunner* batch)
+{
+    TrafficClassStats classes[N_TRAFFIC_CLASSES];
+    CollectClassStats(fm, flowHelper, classes);
+    ReportMetrics(classes, bottleneckQdisc, transport, batch);
+}
+
+// --- Incremental aggregation (RxClassTap) ---
+// The class accumulators are updated per packet, in O(1), from the IPv4 trace
+// sources: SendOutgoing on the sources counts what they send to the sink,
+// LocalDeliver on the sink measures what arrives, with the delay taken from
+// the SeqTsSizeHeader timestamp the UDP sources put in every packet (TCP
+// segments are counted as untimed, and their class gets no delay). The
+// accumulators are complete at any time, so reading them costs O(classes)
+// and no FlowMonitor is needed.
+//
+// In distributed (MPI) mode a FlowMonitor only knows the packets its own
+// rank sent, so it still provides the transmit counts; the tap measures the
+// receive side and rank 0 sums all ranks' accumulators.
+class RxClassTap
+{
+public:
+    RxClassTap(TrafficClassStats* classes, Ipv4Address sink) : m_classes(classes), m_sink(sink) {}
+
+    void Install(Ptr<Node> node)
+    {
+        node->GetObject<Ipv4L3Protocol>()->TraceConnectWithoutContext(
+            "LocalDeliver", MakeCallback(&RxClassTap::LocalDeliver, this));
+    }
+
+    void InstallTx(NodeContainer nodes)
+    {
+        for (uint32_t i = 0; i < nodes.GetN(); ++i) {
+            nodes.Get(i)->GetObject<Ipv4L3Protocol>()->TraceConnectWithoutContext(
+                "SendOutgoing", MakeCallback(&RxClassTap::SendOutgoing, this));
+        }
+    }
+
+private:
+    void SendOutgoing(const Ipv4Header& header, Ptr<const Packet> p, uint32_t interface)
+    {
+        if (header.GetDestination() == m_sink) {
+            m_classes[header.GetDscp() >> 3].txPackets++;
+        }
+    }
+
+    // Called after reassembly, with the L4 header still on the packet.
+    void LocalDeliver(const Ipv4Header& header, Ptr<const Packet> p, uint32_t iif)
+    {
+        if (header.GetDestination() != m_sink) {
+            return;
+        }
+        TrafficClassStats& c = m_classes[header.GetDscp() >> 3];
+        uint16_t ports[2];
+        bool timed = false;
+        Time delay;
+        if (header.GetProtocol() == UdpL4Protocol::PROT_NUMBER) {
+            Ptr<Packet> copy = p->Copy();
+            UdpHeader udp;
+            copy->RemoveHeader(udp);
+            ports[0] = udp.GetSourcePort();
+            ports[1] = udp.GetDestinationPort();
+            SeqTsSizeHeader ts;
+            if (copy->GetSize() >= ts.GetSerializedSize()) {
+                copy->PeekHeader(ts);
+                delay = Simulator::Now() - ts.GetTs();
+                timed = true;
+            }
+        } else if (header.GetProtocol() == TcpL4Protocol::PROT_NUMBER) {
+            TcpHeader tcp;
+            p->PeekHeader(tcp);
+            ports[0] = tcp.GetSourcePort();
+            ports[1] = tcp.GetDestinationPort();
+        } else {
+            return;
+        }
+
+        uint64_t flow = (static_cast<uint64_t>(header.GetSource().Get()) << 32) |
+                        (static_cast<uint64_t>(ports[0]) << 16) | ports[1];
+        std::unordered_map<uint64_t, Time>::iterator last = m_lastDelay.find(flow);
+        if (last == m_lastDelay.end()) {
+            c.flows++;
+            last = m_lastDelay.insert(std::make_pair(flow, delay)).first;
+        } else if (timed) {
+            c.jitterSum += std::abs((delay - last->second).GetSeconds());
+        }
+        last->second = delay;
+        c.rxPackets++;
+        c.rxBytes += p->GetSize() + header.GetSerializedSize(); // IP bytes, as FlowMonitor counts
+        if (timed) {
+            c.delaySum += delay.GetSeconds();
+            c.delay.Record(delay);
+            c.delayStats.Add(delay.GetSeconds());
+        } else {
+            c.untimed++;
+        }
+    }
+
+    TrafficClassStats* m_classes;
+    Ipv4Address m_sink;
+    std::unordered_map<uint64_t, Time> m_lastDelay;  // Per flow, for jitter
+};
+
+#ifdef NS3_MPI
+// Sums every rank's class accumulators (and queue disc counters) into rank 0's.
+static void ReduceClassStats(TrafficClassStats classes[N_TRAFFIC_CLASSES], uint64_t qdisc[2])
+{
+    const uint32_t FIELDS = 7;
+    std::vector<double> sums(N_TRAFFIC_CLASSES * FIELDS);
+    std::vector<uint64_t> counts(N_TRAFFIC_CLASSES * LatencyHistogram::N_BUCKETS + 2);
+    for (uint32_t k = 0; k < N_TRAFFIC_CLASSES; ++k) {
+        const TrafficClassStats& c = classes[k];
+        double fields[FIELDS] = {static_cast<double>(c.flows), c.txPackets, c.rxPackets, c.rxBytes,
+                                 c.untimed, c.delaySum, c.jitterSum};
+        std::copy(fields, fields + FIELDS, sums.begin() + k * FIELDS);
+        std::copy(c.delay.GetCounts().begin(), c.delay.GetCounts().end(), counts.begin() + k * LatencyHistogram::N_BUCKETS);
+    }
+    counts[N_TRAFFIC_CLASSES * LatencyHistogram::N_BUCKETS] = qdisc[0];
+    counts[N_TRAFFIC_CLASSES * LatencyHistogram::N_BUCKETS + 1] = qdisc[1];
+
+    std::vector<double> sumsOut(sums.size());
+    std::vector<uint64_t> countsOut(counts.size());
+    MPI_Reduce(sums.data(), sumsOut.data(), sums.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(counts.data(), countsOut.data(), counts.size(), MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    for (uint32_t k = 0; k < N_TRAFFIC_CLASSES; ++k) {
+        TrafficClassStats c;
+        c.flows = static_cast<uint32_t>(sumsOut[k * FIELDS]);
+        c.txPackets = sumsOut[k * FIELDS + 1];
+        c.rxPackets = sumsOut[k * FIELDS + 2];
+        c.rxBytes = sumsOut[k * FIELDS + 3];
+        c.untimed = sumsOut[k * FIELDS + 4];
+        c.delaySum = sumsOut[k * FIELDS + 5];
+        c.jitterSum = sumsOut[k * FIELDS + 6];
+        c.delay.Merge(countsOut.data() + k * LatencyHistogram::N_BUCKETS);
+        classes[k] = c;
+    }
+    qdisc[0] = countsOut[N_TRAFFIC_CLASSES * LatencyHistogram::N_BUCKETS];
+    qdisc[1] = countsOut[N_TRAFFIC_CLASSES * LatencyHistogram::N_BUCKETS + 1];
+}
+#endif
+
 int main(int argc, char *argv[])
 {
+    RunStats stats;
+    QoSConfig qos;
+    qos.scheduler = "pfifo";
+    qos.weights = "4 2 1";
+    qos.quantum = 1514;
+    qos.aqm = "none";
+    qos.deviceQueue = "5p";
+    double sampleIntervalMs = 0.0;
+    std::string sampleFile = "qos-flow-samples.csv";
+    WanTopologyHelper wan;
+    std::string table = "static";
+    std::string bottleneckRate = LINK_DATA_RATE;
+    std::string lanRate = "100Mbps";
+    std::string ftpRate = "4Mbps";
+    std::string queueSize = "100p";
+    std::string traffic = "onoff";
+    uint32_t voipCalls = 25;
+    std::string codec = "g711";
+    std::string videoRate = "1.5Mbps";
+    std::string tcp;
+    BatchRunner batch;
+    bool distributed = false;
+    std::string aggregate = "incremental";
+    std::string routeSnapshot;
+    std::string placement = "manual";
+    double qosLoad = 1.0;
+
+    CommandLine cmd;
+    cmd.AddValue("scheduler", "Bottleneck scheduler: pfifo, sp, drr or wfq", qos.scheduler);
+    cmd.AddValue("weights", "Per-class weights \"EF AF BE\" for drr/wfq", qos.weights);
+    cmd.AddValue("quantum", "DRR quantum in bytes per unit of weight", qos.quantum);
+    cmd.AddValue("aqm", "AQM on each priority band: none, codel, fqcodel or pie", qos.aqm);
+    cmd.AddValue("qosDeviceQueue", "Device queue size under each QoS queue disc (e.g. 100p bypasses the scheduler)",
+                 qos.deviceQueue);
+    cmd.AddValue("condition", "Edge policing/shaping profiles in front of the scheduler (traffic-conditioner.h)",
+                 qos.condition);
+    cmd.AddValue("marks", "Edge DSCP marking rules; the sources then send unmarked (traffic-conditioner.h)", qos.marks);
+    cmd.AddValue("sampleInterval", "Per-flow sampling interval in ms (0 = off)", sampleIntervalMs);
+    cmd.AddValue("sampleFile", "Sample output; a .bin suffix selects the binary FMS2 format (flow-results-tool)", sampleFile);
+    cmd.AddValue("table", "Route table for the fixed topology: static (Ipv4StaticRouting) or trie", table);
+    cmd.AddValue("bottleneckRate", "Data rate of the HQ <-> DC bottleneck link", bottleneckRate);
+    cmd.AddValue("lanRate", "Data rate of the other two links of the fixed topology", lanRate);
+    cmd.AddValue("ftpRate", "Data rate of each FTP (BE) source", ftpRate);
+    cmd.AddValue("queueSize", "Device queue size of the fixed topology links", queueSize);
+    cmd.AddValue("traffic", "Sources: onoff (constant-rate UDP) or models (VoIP calls, VBR video, TCP bulk)", traffic);
+    cmd.AddValue("voipCalls", "VoIP calls per source with --traffic=models", voipCalls);
+    cmd.AddValue("codec", "VoIP codec with --traffic=models: g711 or opus", codec);
+    cmd.AddValue("tcp", "Make the FTP source a TCP bulk transfer with this congestion control: newreno, cubic or bbr",
+                 tcp);
+    cmd.AddValue("videoRate", "Mean AF41 video rate per source with --traffic=models (0 = none)", videoRate);
+    wan.AddCommandLineOptions(cmd);
+    batch.AddCommandLineOptions(cmd);
+    stats.AddCommandLineOptions(cmd);
+    cmd.AddValue("aggregate", "Class metrics: incremental (per-packet taps, read at the end) or flowmon (FlowMonitor pass)",
+                 aggregate);
+    cmd.AddValue("qosPlacement", "manual (the bottleneck / branch uplinks) or auto (every egress that can congest)",
+                 placement);
+    cmd.AddValue("qosLoad", "Offered load, as a fraction of the link rate, from which auto placement installs QoS",
+                 qosLoad);
+    cmd.AddValue("routeSnapshot", "Generated WAN: load the routes from this file, or compute and save them there",
+                 routeSnapshot);
+    cmd.AddValue("distributed", "Split the generated WAN over the MPI ranks (needs an MPI build and mpirun)", distributed);
+    cmd.Parse(argc, argv);
+    NS_ABORT_MSG_UNLESS(traffic == "onoff" || traffic == "models", "Unknown --traffic: " << traffic);
+    NS_ABORT_MSG_UNLESS(codec == "g711" || codec == "opus", "Unknown --codec: " << codec);
+    NS_ABORT_MSG_UNLESS(aggregate == "incremental" || aggregate == "flowmon", "Unknown --aggregate: " << aggregate);
+    NS_ABORT_MSG_UNLESS(placement == "manual" || placement == "auto", "Unknown --qosPlacement: " << placement);
+    bool autoPlacement = placement == "auto";
+    if (traffic == "models" && tcp.empty()) {
+        tcp = "newreno"; // The model mix always has a TCP bulk flow
+    }
+    // The taps count a packet by the DSCP it leaves the source with and
+    // arrives with, and time only UDP. FlowMonitor is kept where that does
+    // not hold: with --marks or a yellow= remark the class changes on the
+    // way, and TCP segments carry no send time.
+    bool remarked = !qos.marks.empty() || qos.condition.find("yellow=") != std::string::npos;
+    bool incremental = aggregate == "incremental" && !distributed && !remarked && tcp.empty();
+    bool timestamps = incremental || distributed; // Send times for RxClassTap
+    if (!tcp.empty()) {
+        const char* tcpTypes[][2] = {{"newreno", "ns3::TcpNewReno"}, {"cubic", "ns3::TcpCubic"}, {"bbr", "ns3::TcpBbr"}};
+        std::string tcpType;
+        for (const auto& t : tcpTypes) {
+            if (tcp == t[0]) {
+                tcpType = t[1];
+            }
+        }
+        NS_ABORT_MSG_IF(tcpType.empty(), "Unknown --tcp: " << tcp);
+        Config::SetDefault("ns3::TcpL4Protocol::SocketType", TypeIdValue(TypeId::LookupByName(tcpType)));
+        Config::SetDefault("ns3::TcpSocket::SegmentSize", UintegerValue(1448));
+        Config::SetDefault("ns3::TcpSocketState::EnablePacing", BooleanValue(tcp == "bbr")); // BBR paces its sends
+    }
+
+    if (batch.IsBatch()) {
+        return batch.Run(argc, argv);
+    }
+
+    uint32_t rank = 0;
+    if (distributed) {
+        NS_ABORT_MSG_UNLESS(wan.IsGenerated(), "--distributed needs a generated --topology");
+#ifdef NS3_MPI
+        GlobalValue::Bind("SimulatorImplementationType", StringValue("ns3::DistributedSimulatorImpl"));
+        MpiInterface::Enable(&argc, &argv);
+        rank = MpiInterface::GetSystemId();
+        wan.SetSystemCount(MpiInterface::GetSize());
+        stats.SetRank(rank);
+#else
+        NS_ABORT_MSG("--distributed needs ns-3 configured with --enable-mpi");
+#endif
+    }
+
     // Setup logging
+    // Setup messages only: per-packet components (OnOff, queue discs) stay
+    // off, the queue decisions are read from PrintQueueClassCounters instead
     LogComponentEnable("QoSImplementation", LOG_LEVEL_INFO);
-    LogComponentEnable("OnOffApplication", LOG_LEVEL_INFO);
-    LogComponentEnable("PfifoFastQueueDisc", LOG_LEVEL_INFO);
-    
-    // 1. Create Nodes (n0, n1, n2)
-    NodeContainer nodes;
-    nodes.Create(3);
-    Ptr<Node> n0 = nodes.Get(0); 
-    Ptr<Node> n2 = nodes.Get(2); // Destination
-
-    // 2. Setup Links (Triangular Mesh)
-    PointToPointHelper p2p;
-    p2p.SetQueue("ns3::DropTailQueue", "MaxPackets", UintegerValue(100)); // Base Queue
-
-    // Link 1 (HQ <-> Branch)
-    p2p.SetDeviceAttribute("DataRate", StringValue("100Mbps"));
-    p2p.SetChannelAttribute("Delay", StringValue("1ms"));
-    NodeContainer link1Nodes(n0, nodes.Get(1));
-    NetDeviceContainer link1Devices = p2p.Install(link1Nodes);
-
-    // Link 2 (Branch <-> DC)
-    NodeContainer link2Nodes(nodes.Get(1), n2);
-    NetDeviceContainer link2Devices = p2p.Install(link2Nodes);
-
-    // Link 3 (HQ <-> DC) - THE BOTTLENECK LINK (Q4)
-    p2p.SetDeviceAttribute("DataRate", StringValue(LINK_DATA_RATE)); 
-    p2p.SetChannelAttribute("Delay", StringValue("10ms")); // High delay for congestion
-    NodeContainer link3Nodes(n0, n2);
-    NetDeviceContainer bottleneckDevices = p2p.Install(link3Nodes);
-
-    // 3. Install Internet Stack
-    InternetStackHelper stack;
-    stack.Install(nodes);
     
-    Ipv4AddressHelper address;
-    address.SetBase("10.1.1.0", "255.255.255.0"); address.Assign(link1Devices);
-    address.SetBase("10.1.2.0", "255.255.255.0"); address.Assign(link2Devices);
-    address.SetBase("10.1.3.0", "255.255.255.0"); 
-    Ipv4InterfaceContainer interfaces3 = address.Assign(bottleneckDevices);
+    Ptr<QueueDisc> bottleneckQdisc;
+    Ipv4Address sinkAddress;
+    Ptr<Node> sinkNode;
+    NodeContainer sources;
+    NodeContainer allSources;                        // Of every rank, for auto placement
+    std::vector<Ptr<QueueDisc> > uplinkQdiscs;       // Local branch uplinks (distributed mode)
+    if (wan.IsGenerated()) {
+        // Every branch sends VoIP + FTP to the first hub over its own access
+        // link; QoS goes on each branch's primary uplink.
+        wan.Build();
+        sinkAddress = wan.GetLinks()[0].addrA;
+        sinkNode = wan.GetHubs().Get(0);
+        allSources = wan.GetBranches();
+        for (uint32_t b = 0; b < wan.GetBranches().GetN(); ++b) {
+            if (wan.GetBranches().Get(b)->GetSystemId() != rank) {
+                continue; // Another rank simulates this branch
+            }
+            sources.Add(wan.GetBranches().Get(b));
+            if (autoPlacement) {
+                continue; // Placed once the routes are known
+            }
+            uint32_t node = wan.GetBranchIndex(b);
+            const WanTopologyHelper::Link& uplink = wan.GetLinks()[wan.GetNodeLinks(node)[0]];
+            Ptr<QueueDisc> q = InstallQoS(uplink.nodeA == node ? uplink.devA : uplink.devB, qos);
+            uplinkQdiscs.push_back(q);
+            if (b == 0) {
+                bottleneckQdisc = q; // CheckMetrics reports branch 0's uplink
+            }
+        }
+        uint64_t loaded = 0;
+        if (!routeSnapshot.empty() && RouteSnapshot::Load(routeSnapshot, wan.GetNodes(), "global", &loaded)) {
+            std::cout << "Route snapshot: " << loaded << " routes loaded from " << routeSnapshot << "\n";
+        } else {
+            Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+            if (!routeSnapshot.empty() && rank == 0) {
+                std::cout << "Route snapshot: " << RouteSnapshot::Save(routeSnapshot, wan.GetNodes(), "global")
+                          << " routes saved to " << routeSnapshot << "\n";
+            }
+        }
+    } else {
+        // 1. Create Nodes (n0, n1, n2)
+        NodeContainer nodes;
+        nodes.Create(3);
+        Ptr<Node> n0 = nodes.Get(0); 
+        Ptr<Node> n2 = nodes.Get(2); // Destination
+
+        // 2. Setup Links (Triangular Mesh)
+        PointToPointHelper p2p;
+        p2p.SetQueue("ns3::DropTailQueue<Packet>", "MaxSize", QueueSizeValue(QueueSize(queueSize))); // Base Queue
+
+        // Link 1 (HQ <-> Branch)
+        p2p.SetDeviceAttribute("DataRate", StringValue(lanRate));
+        p2p.SetChannelAttribute("Delay", StringValue("1ms"));
+        NodeContainer link1Nodes(n0, nodes.Get(1));
+        NetDeviceContainer link1Devices = p2p.Install(link1Nodes);
+
+        // Link 2 (Branch <-> DC)
+        NodeContainer link2Nodes(nodes.Get(1), n2);
+        NetDeviceContainer link2Devices = p2p.Install(link2Nodes);
 
-    // 4. Q2: Install QoS on the Bottleneck Link (HQ side - n0)
-    InstallQoS(bottleneckDevices.Get(0));
+        // Link 3 (HQ <-> DC) - THE BOTTLENECK LINK (Q4)
+        p2p.SetDeviceAttribute("DataRate", StringValue(bottleneckRate));
+        p2p.SetChannelAttribute("Delay", StringValue("10ms")); // High delay for congestion
+        NodeContainer link3Nodes(n0, n2);
+        NetDeviceContainer bottleneckDevices = p2p.Install(link3Nodes);
 
-    // 5. Setup Static Routing (Forces traffic through the bottleneck)
-    Ipv4GlobalRoutingHelper::PopulateRoutingTables(); 
+        // 3. Install Internet Stack
+        InternetStackHelper stack;
+        if (table == "trie") {
+            Ipv4ListRoutingHelper list;
+            list.Add(Ipv4TrieRoutingHelper(), 0);
+            list.Add(Ipv4GlobalRoutingHelper(), -10);
+            stack.SetRoutingHelper(list);
+        }
+        stack.Install(nodes);
     
-    // Correct call to GetRouting<T> 
-    Ptr<Ipv4StaticRouting> n0Routing = Ipv4GlobalRoutingHelper::GetRouting<Ipv4StaticRouting>(n0->GetObject<Ipv4>()->GetObject<Ipv4RoutingProtocol>());
+        Ipv4AddressHelper address;
+        address.SetBase("10.1.1.0", "255.255.255.0"); address.Assign(link1Devices);
+        address.SetBase("10.1.2.0", "255.255.255.0"); address.Assign(link2Devices);
+        address.SetBase("10.1.3.0", "255.255.255.0"); 
+        Ipv4InterfaceContainer interfaces3 = address.Assign(bottleneckDevices);
+
+        // 4. Q2: Install QoS on the Bottleneck Link (HQ side - n0)
+        if (!autoPlacement) {
+            bottleneckQdisc = InstallQoS(bottleneckDevices.Get(0), qos);
+        }
+
+        // 5. Setup Static Routing (Forces traffic through the bottleneck)
+        Ipv4GlobalRoutingHelper::PopulateRoutingTables(); 
     
-    // Add a route on n0: to reach 10.1.2.0/24 (via DC, next-hop 10.1.3.2)
-    n0Routing->AddNetworkRouteTo(Ipv4Address("10.1.2.0"), Ipv4Mask("255.255.255.0"), 
-                                 interfaces3.GetAddress(1), 3, 0); 
+        // Add a route on n0: to reach 10.1.2.0/24 (via DC, next-hop 10.1.3.2)
+        Ptr<Ipv4RoutingProtocol> n0Proto = n0->GetObject<Ipv4>()->GetRoutingProtocol();
+        if (table == "trie") {
+            Ipv4GlobalRoutingHelper::GetRouting<Ipv4TrieRouting>(n0Proto)
+                ->AddNetworkRouteTo(Ipv4Address("10.1.2.0"), Ipv4Mask("255.255.255.0"), interfaces3.GetAddress(1), 3, 0);
+        } else {
+            // Correct call to GetRouting<T>
+            Ipv4GlobalRoutingHelper::GetRouting<Ipv4StaticRouting>(n0Proto)
+                ->AddNetworkRouteTo(Ipv4Address("10.1.2.0"), Ipv4Mask("255.255.255.0"), interfaces3.GetAddress(1), 3, 0);
+        }
+
+        sinkAddress = interfaces3.GetAddress(1); // 10.1.3.2 (DC's direct link IP)
+        sinkNode = n2;
+        sources.Add(n0);
+        allSources.Add(n0);
+    }
+
+    if (autoPlacement) {
+        // Offered load per source at the link layer: payload plus UDP, IPv4
+        // and PPP headers; a TCP transfer is elastic
+        const double OVERHEAD = 8 + 20 + 2;
+        double offered = 0;
+        if (traffic == "models") {
+            Ptr<VoipApplication> call = CreateObject<VoipApplication>();
+            call->SetAttribute("Codec", EnumValue(codec == "opus" ? VoipApplication::OPUS : VoipApplication::G711));
+            TimeValue ptime;
+            call->GetAttribute("Ptime", ptime);
+            offered += voipCalls * (call->GetPayloadSize() + OVERHEAD) * 8 / ptime.Get().GetSeconds();
+            offered += DataRate(videoRate).GetBitRate() * (VIDEO_PACKET + OVERHEAD) / VIDEO_PACKET;
+        } else {
+            offered += DataRate(VOIP_ONOFF_RATE).GetBitRate() * (VOIP_ONOFF_PACKET + OVERHEAD) / VOIP_ONOFF_PACKET;
+        }
+        if (tcp.empty()) {
+            offered += DataRate(ftpRate).GetBitRate() * (FTP_PACKET + OVERHEAD) / FTP_PACKET;
+        }
+
+        QosPlacement qosPlacement;
+        for (uint32_t i = 0; i < allSources.GetN(); ++i) {
+            qosPlacement.AddDemand(allSources.Get(i), sinkAddress, offered, !tcp.empty());
+        }
+        std::vector<QosPlacement::Egress> congested = qosPlacement.GetCongested(qosLoad);
+        std::cout << "QoS placement: " << congested.size() << " of " << qosPlacement.GetNEgresses()
+                  << " egresses on the source paths can congest\n";
+        for (const QosPlacement::Egress& e : congested) {
+            if (e.device->GetNode()->GetSystemId() != rank) {
+                continue;
+            }
+            Ptr<QueueDisc> q = InstallQoS(e.device, qos);
+            uplinkQdiscs.push_back(q);
+            if (bottleneckQdisc == 0) {
+                // CheckMetrics reports the most loaded one
+                bottleneckQdisc = q;
+                std::cout << "  Most loaded: node " << e.device->GetNode()->GetId() << " if " << e.device->GetIfIndex()
+                          << ", " << std::fixed << std::setprecision(2) << e.offered / 1e6 << " Mbps offered"
+                          << (e.elastic ? " + TCP" : "") << " on " << e.rate / 1e6 << " Mbps\n";
+            }
+        }
+    }
 
     // 6. Application Setup (VoIP/FTP)
-    Ipv4Address sinkAddress = interfaces3.GetAddress(1); // 10.1.3.2 (DC's direct link IP)
     uint16_t voipPort = 9;
     uint16_t ftpPort = 10;
-    
+    bool localSink = sinkNode->GetSystemId() == rank;
+
+    TransportMetrics transport;
     PacketSinkHelper sink("ns3::UdpSocketFactory", InetSocketAddress(sinkAddress, voipPort));
     sink.SetAttribute("Protocol", TypeIdValue(UdpSocketFactory::GetTypeId()));
-    sink.Install(n2).Start(Seconds(0.0));
-    
-    PacketSinkHelper sink2("ns3::UdpSocketFactory", InetSocketAddress(sinkAddress, ftpPort));
-    sink2.SetAttribute("Protocol", TypeIdValue(UdpSocketFactory::GetTypeId()));
-    sink2.Install(n2).Start(Seconds(0.0));
-
-    // A. VoIP Traffic (High Priority - DSCP EF)
-    OnOffHelper voipApp("ns3::UdpSocketFactory", InetSocketAddress(sinkAddress, voipPort));
-    voipApp.SetAttribute("PacketSize", UintegerValue(200)); 
-    voipApp.SetAttribute("DataRate", StringValue("2Mbps")); 
-    voipApp.SetAttribute("ToS", UintegerValue(0x2e << 2)); // DSCP EF (101110)
-    ApplicationContainer voipApps = voipApp.Install(n0);
+    if (localSink) {
+        transport.AddSink(5, sink.Install(sinkNode));
+    }
+
+    ApplicationContainer voipApps;
+    ApplicationContainer ftpApps;
+    ApplicationContainer videoApps;
+    uint8_t voipTos = qos.marks.empty() ? 0x2e << 2 : 0; // DSCP EF (101110), or marked at the edge
+    if (traffic == "models") {
+        // Fixed random variable streams, so a run depends only on --RngRun
+        int64_t stream = 1;
+        // A. VoIP calls (EF), 20 ms packetization (traffic-models.h)
+        TrafficModelHelper voipApp(VoipApplication::GetTypeId(), InetSocketAddress(sinkAddress, voipPort));
+        voipApp.SetAttribute("Codec", EnumValue(codec == "opus" ? VoipApplication::OPUS : VoipApplication::G711));
+        voipApp.SetAttribute("ToS", UintegerValue(voipTos));
+        voipApp.SetAttribute("EnableSeqTsSizeHeader", BooleanValue(timestamps));
+        voipApps = voipApp.Install(sources, voipCalls);
+        stream += voipApp.AssignStreams(voipApps, stream);
+
+        // VBR video (AF41) with a GOP structure
+        if (DataRate(videoRate).GetBitRate() > 0) {
+            uint16_t videoPort = 11;
+            PacketSinkHelper sink3("ns3::UdpSocketFactory", InetSocketAddress(sinkAddress, videoPort));
+            if (localSink) {
+                transport.AddSink(4, sink3.Install(sinkNode));
+            }
+            TrafficModelHelper videoApp(VbrVideoApplication::GetTypeId(), InetSocketAddress(sinkAddress, videoPort));
+            videoApp.SetAttribute("DataRate", DataRateValue(DataRate(videoRate)));
+            videoApp.SetAttribute("PacketSize", UintegerValue(VIDEO_PACKET));
+            videoApp.SetAttribute("ToS", UintegerValue(qos.marks.empty() ? 34 << 2 : 0)); // DSCP AF41 (100010)
+            videoApp.SetAttribute("EnableSeqTsSizeHeader", BooleanValue(timestamps));
+            videoApps = videoApp.Install(sources);
+            stream += videoApp.AssignStreams(videoApps, stream);
+        }
+    } else {
+        // A. VoIP Traffic (High Priority - DSCP EF)
+        OnOffHelper voipApp("ns3::UdpSocketFactory", InetSocketAddress(sinkAddress, voipPort));
+        voipApp.SetAttribute("PacketSize", UintegerValue(VOIP_ONOFF_PACKET));
+        voipApp.SetAttribute("DataRate", StringValue(VOIP_ONOFF_RATE));
+        voipApp.SetAttribute("ToS", UintegerValue(voipTos));
+        voipApp.SetAttribute("EnableSeqTsSizeHeader", BooleanValue(timestamps)); // Send time for RxClassTap
+        voipApps = voipApp.Install(sources);
+    }
+
+    if (!tcp.empty()) {
+        // B. TCP bulk transfer (BE), as fast as the congestion control allows
+        PacketSinkHelper tcpSink("ns3::TcpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), ftpPort));
+        if (localSink) {
+            transport.AddSink(0, tcpSink.Install(sinkNode));
+        }
+        ftpApps = InstallBulkSend(sources, InetSocketAddress(sinkAddress, ftpPort), 0x00);
+        transport.TrackTcp(tcp, ftpApps, Seconds(1.0), Seconds(SIMULATION_TIME - 3.0));
+    } else {
+        PacketSinkHelper sink2("ns3::UdpSocketFactory", InetSocketAddress(sinkAddress, ftpPort));
+        sink2.SetAttribute("Protocol", TypeIdValue(UdpSocketFactory::GetTypeId()));
+        if (localSink) {
+            transport.AddSink(0, sink2.Install(sinkNode));
+        }
+
+        // B. FTP Traffic (Low Priority - DSCP BE) - CONGESTION CAUSE
+        OnOffHelper ftpApp("ns3::UdpSocketFactory", InetSocketAddress(sinkAddress, ftpPort));
+        ftpApp.SetAttribute("PacketSize", UintegerValue(FTP_PACKET));
+        ftpApp.SetAttribute("DataRate", StringValue(ftpRate));
+        ftpApp.SetAttribute("ToS", UintegerValue(0x00)); // DSCP BE (000000)
+        ftpApp.SetAttribute("EnableSeqTsSizeHeader", BooleanValue(timestamps));
+        ftpApps = ftpApp.Install(sources);
+    }
     voipApps.Start(Seconds(1.0));
-    
-    // B. FTP Traffic (Low Priority - DSCP BE) - CONGESTION CAUSE
-    OnOffHelper ftpApp("ns3::UdpSocketFactory", InetSocketAddress(sinkAddress, ftpPort));
-    ftpApp.SetAttribute("PacketSize", UintegerValue(1500));
-    ftpApp.SetAttribute("DataRate", StringValue("4Mbps")); 
-    ftpApp.SetAttribute("ToS", UintegerValue(0x00)); // DSCP BE (000000)
-    ApplicationContainer ftpApps = ftpApp.Install(n0);
     ftpApps.Start(Seconds(1.0));
+    videoApps.Start(Seconds(1.0));
 
     // FINAL FIX: Use SetStopTime on the specific application to schedule its termination.
     // This is the public method to control the running time of an application.
-    voipApps.Get(0)->SetStopTime(Seconds(SIMULATION_TIME - 3.0));
-    ftpApps.Get(0)->SetStopTime(Seconds(SIMULATION_TIME - 3.0));
+    voipApps.Stop(Seconds(SIMULATION_TIME - 3.0));
+    ftpApps.Stop(Seconds(SIMULATION_TIME - 3.0));
+    videoApps.Stop(Seconds(SIMULATION_TIME - 3.0));
 
-    // 7. Q3: Flow Monitor Setup
+    // 7. Q3: Flow Monitor Setup, only where it is still needed
     Ptr<FlowMonitor> flowMonitor;
     FlowMonitorHelper flowHelper;
-    flowMonitor = flowHelper.InstallAll();
-    
-    // Schedule periodic check of metrics (Q3 Verification)
-    Simulator::Schedule(Seconds(SIMULATION_TIME - 2.0), &CheckMetrics, flowMonitor, &flowHelper);
+    flowHelper.SetMonitorAttribute("DelayBinWidth", DoubleValue(DELAY_BIN_WIDTH));
+    TrafficClassStats rxClasses[N_TRAFFIC_CLASSES];
+    RxClassTap rxTap(rxClasses, sinkAddress);
+    if (incremental) {
+        rxTap.InstallTx(sources);
+        rxTap.Install(sinkNode);
+        if (sampleIntervalMs > 0) {
+            flowMonitor = flowHelper.InstallAll(); // For the sampler only
+        }
+    } else if (distributed) {
+        // Per-rank monitor on the local nodes only
+        NodeContainer local;
+        for (uint32_t i = 0; i < wan.GetNodes().GetN(); ++i) {
+            if (wan.GetNodes().Get(i)->GetSystemId() == rank) {
+                local.Add(wan.GetNodes().Get(i));
+            }
+        }
+        flowMonitor = flowHelper.Install(local);
+        if (localSink) {
+            rxTap.Install(sinkNode);
+        }
+    } else {
+        flowMonitor = flowHelper.InstallAll();
+    }
+
+    // Optional time series of per-flow deltas
+    std::unique_ptr<FlowMonitorSampler> sampler;
+    if (sampleIntervalMs > 0) {
+        bool binary = sampleFile.size() > 4 && sampleFile.compare(sampleFile.size() - 4, 4, ".bin") == 0;
+        std::string file = sampleFile;
+        if (distributed) {
+            std::ostringstream suffix;
+            suffix << ".rank" << rank;
+            file += suffix.str(); // One file per rank's monitor
+        }
+        std::string config;
+        for (int i = 0; i < argc; ++i) {
+            config += (i ? " " : "") + std::string(argv[i]); // The command line, for the FMS2 header
+        }
+        sampler.reset(new FlowMonitorSampler(flowMonitor, DynamicCast<Ipv4FlowClassifier>(flowHelper.GetClassifier()),
+                                             Seconds(sampleIntervalMs / 1000.0), file, binary, config));
+        sampler->Start(Seconds(sampleIntervalMs / 1000.0));
+    }
+
+    // Schedule periodic check of metrics (Q3 Verification). The incremental
+    // and distributed runs report after Simulator::Run() instead, outside the
+    // event loop.
+    if (!distributed && !incremental) {
+        Simulator::Schedule(Seconds(SIMULATION_TIME - 2.0), &CheckMetrics, flowMonitor, &flowHelper, bottleneckQdisc, &transport, &batch);
+    }
 
     // 8. Run Simulation
     Simulator::Stop(Seconds(SIMULATION_TIME));
-    Simulator::Run();
-    
-    flowMonitor->CheckForLostPackets();
+    stats.Run();
+
+    if (flowMonitor != 0) {
+        flowMonitor->CheckForLostPackets();
+    }
+    if (sampler) {
+        sampler->Flush();
+    }
+    if (incremental) {
+        ReportMetrics(rxClasses, bottleneckQdisc, &transport, &batch);
+    }
+#ifdef NS3_MPI
+    if (distributed) {
+        // Transmit side from this rank's monitor, receive side from the tap
+        TrafficClassStats txClasses[N_TRAFFIC_CLASSES];
+        CollectClassStats(flowMonitor, &flowHelper, txClasses);
+        for (uint32_t k = 0; k < N_TRAFFIC_CLASSES; ++k) {
+            rxClasses[k].txPackets = txClasses[k].txPackets;
+        }
+        uint64_t qdisc[2] = {0, 0};
+        for (const Ptr<QueueDisc>& q : uplinkQdiscs) {
+            qdisc[0] += q->GetStats().nTotalSentPackets;
+            qdisc[1] += q->GetStats().nTotalDroppedPackets;
+        }
+        ReduceClassStats(rxClasses, qdisc);
+        if (rank == 0) {
+            std::cout << "\n--- Q3: QoS Performance Verification (" << MpiInterface::GetSize() << " ranks) ---\n";
+            ReportClassStats(rxClasses, &batch);
+            std::cout << "\nAll Branch Uplink Queue Discs:\n";
+            std::cout << "  Sent:    " << qdisc[0] << " packets\n";
+            std::cout << "  Dropped: " << qdisc[1] << " packets (AQM + overflow)\n";
+        }
+    }
+#endif
+    stats.Report("qos-implementation");
     Simulator::Destroy();
+#ifdef NS3_MPI
+    if (distributed) {
+        MpiInterface::Disable();
+    }
+#endif
+    batch.WriteResults();
     return 0;
 }
@@ -0,0 +1,209 @@
+/*
+ * Route table snapshots, to warm-start sweeps over one topology.
+ *
+ * Save() writes the routes every node's routing protocols hold after route
+ * computation (Ipv4GlobalRouting after PopulateRoutingTables, the gateway
+ * routes of Ipv4StaticRouting or Ipv4TrieRouting after route synthesis) to a
+ * text file. Connected routes are left out: the stack recreates them when
+ * the addresses are assigned. The file starts with a fingerprint of the
+ * topology (the node count and every interface address and mask) and of a
+ * caller's key naming how the routes were computed.
+ *
+ * Load() rebuilds nothing: it checks the fingerprint against the topology
+ * the script has just built (WanTopologyHelper::Build is linear in the
+ * links) and bulk-adds the routes to each node's Ipv4StaticRouting, or
+ * another table with the same route API via Load<T>(), instead of computing
+ * them. A missing or stale file makes Load() return false, and the caller
+ * computes the routes and saves a fresh snapshot.
+ *
+ * Only routing is snapshotted. ns-3 objects have no serialization, so the
+ * node/device graph is rebuilt each run, and the simulator state after a
+ * warm-up (pending events, sockets, TCP and queue contents) cannot be
+ * restored at all.
+ *
+ *   if (!RouteSnapshot::Load(file, nodes, "global")) {
+ *       Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+ *       RouteSnapshot::Save(file, nodes, "global");
+ *   }
+ *
+ * POSIX only (mkstemp).
+ */
+
+#ifndef ROUTE_SNAPSHOT_H
+#define ROUTE_SNAPSHOT_H
+
+#include "ns3/core-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/network-module.h"
+#include "ipv4-trie-routing.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace ns3
+{
+
+class RouteSnapshot
+{
+public:
+    struct Route
+    {
+        uint32_t dest;
+        uint32_t mask;
+        uint32_t gateway;    // 0 = on-link
+        uint32_t interface;
+        uint32_t metric;
+    };
+
+    // FNV-1a over the key, the node count and every interface's addresses.
+    static uint64_t Fingerprint(NodeContainer nodes, const std::string& key)
+    {
+        uint64_t h = 14695981039346656037ull;
+        for (char c : key) {
+            Mix(h, static_cast<uint8_t>(c));
+        }
+        Mix(h, nodes.GetN());
+        for (uint32_t n = 0; n < nodes.GetN(); ++n) {
+            Ptr<Ipv4> ipv4 = nodes.Get(n)->GetObject<Ipv4>();
+            Mix(h, ipv4->GetNInterfaces());
+            for (uint32_t i = 0; i < ipv4->GetNInterfaces(); ++i) {
+                for (uint32_t a = 0; a < ipv4->GetNAddresses(i); ++a) {
+                    Mix(h, ipv4->GetAddress(i, a).GetLocal().Get());
+                    Mix(h, ipv4->GetAddress(i, a).GetMask().Get());
+                }
+            }
+        }
+        return h;
+    }
+
+    // Returns the number of routes written. The file appears complete or not
+    // at all (written to a unique temporary name, then renamed), so
+    // concurrent runs may Load() it, and replications that all missed it may
+    // all Save() it: the last rename wins, with the same routes.
+    static uint64_t Save(const std::string& file, NodeContainer nodes, const std::string& key = "")
+    {
+        std::vector<char> tmp(file.begin(), file.end());
+        const char suffix[] = ".XXXXXX";
+        tmp.insert(tmp.end(), suffix, suffix + sizeof(suffix)); // With the terminating NUL
+        int fd = mkstemp(tmp.data());
+        NS_ABORT_MSG_IF(fd < 0, "Cannot write route snapshot " << file);
+        fchmod(fd, 0644); // mkstemp() makes it private
+        close(fd);
+        std::ofstream os(tmp.data());
+        NS_ABORT_MSG_UNLESS(os, "Cannot write route snapshot " << tmp.data());
+        os << "ROUTES1 " << nodes.GetN() << " " << std::hex << Fingerprint(nodes, key) << std::dec << "\n";
+        uint64_t total = 0;
+        std::vector<Route> routes;
+        for (uint32_t n = 0; n < nodes.GetN(); ++n) {
+            routes.clear();
+            Collect(nodes.Get(n)->GetObject<Ipv4>()->GetRoutingProtocol(), routes);
+            os << "N " << n << " " << routes.size() << "\n";
+            for (const Route& r : routes) {
+                os << r.dest << " " << r.mask << " " << r.gateway << " " << r.interface << " " << r.metric << "\n";
+            }
+            total += routes.size();
+        }
+        os.close();
+        NS_ABORT_MSG_UNLESS(os, "Cannot write route snapshot " << tmp.data());
+        if (std::rename(tmp.data(), file.c_str()) != 0) {
+            // Another run may hold the name in a way rename() cannot replace;
+            // a snapshot in place is as good as ours
+            std::remove(tmp.data());
+            NS_ABORT_MSG_UNLESS(std::ifstream(file.c_str()).good(), "Cannot write route snapshot " << file);
+        }
+        return total;
+    }
+
+    // Installs the snapshot's routes into each node's T. Returns false, and
+    // installs nothing, if the file is missing or was saved for another
+    // topology or key.
+    template <class T = Ipv4StaticRouting>
+    static bool Load(const std::string& file, NodeContainer nodes, const std::string& key = "", uint64_t* loaded = 0)
+    {
+        std::ifstream is(file.c_str());
+        std::string magic;
+        uint32_t count = 0;
+        uint64_t fingerprint = 0;
+        if (!(is >> magic >> count >> std::hex >> fingerprint >> std::dec) || magic != "ROUTES1" ||
+            count != nodes.GetN() || fingerprint != Fingerprint(nodes, key)) {
+            return false;
+        }
+        uint64_t total = 0;
+        for (uint32_t n = 0; n < count; ++n) {
+            std::string tag;
+            uint32_t node = 0;
+            uint32_t size = 0;
+            NS_ABORT_MSG_UNLESS(is >> tag >> node >> size && tag == "N" && node == n, "Corrupt route snapshot " << file);
+            Ptr<T> rt = Ipv4RoutingHelper::GetRouting<T>(nodes.Get(n)->GetObject<Ipv4>()->GetRoutingProtocol());
+            NS_ABORT_MSG_UNLESS(rt != 0, "Node " << n << " has no " << T::GetTypeId().GetName());
+            for (uint32_t i = 0; i < size; ++i) {
+                Route r;
+                NS_ABORT_MSG_UNLESS(is >> r.dest >> r.mask >> r.gateway >> r.interface >> r.metric,
+                                    "Corrupt route snapshot " << file);
+                if (r.gateway == 0) {
+                    rt->AddNetworkRouteTo(Ipv4Address(r.dest), Ipv4Mask(r.mask), r.interface, r.metric);
+                } else {
+                    rt->AddNetworkRouteTo(Ipv4Address(r.dest), Ipv4Mask(r.mask), Ipv4Address(r.gateway), r.interface,
+                                          r.metric);
+                }
+            }
+            total += size;
+        }
+        if (loaded != 0) {
+            *loaded = total;
+        }
+        return true;
+    }
+
+private:
+    static void Mix(uint64_t& h, uint32_t v)
+    {
+        for (uint32_t i = 0; i < 4; ++i) {
+            h = (h ^ ((v >> (8 * i)) & 0xff)) * 1099511628211ull;
+        }
+    }
+
+    static void Add(std::vector<Route>& routes, const Ipv4RoutingTableEntry& e, uint32_t metric)
+    {
+        Route r = {e.GetDest().Get(), e.GetDestNetworkMask().Get(), e.GetGateway().Get(), e.GetInterface(), metric};
+        routes.push_back(r);
+    }
+
+    // Computed routes of 'proto' and, for a list, of each protocol in it.
+    static void Collect(Ptr<Ipv4RoutingProtocol> proto, std::vector<Route>& routes)
+    {
+        if (Ptr<Ipv4ListRouting> list = DynamicCast<Ipv4ListRouting>(proto)) {
+            for (uint32_t i = 0; i < list->GetNRoutingProtocols(); ++i) {
+                int16_t priority;
+                Collect(list->GetRoutingProtocol(i, priority), routes);
+            }
+        } else if (Ptr<Ipv4GlobalRouting> global = DynamicCast<Ipv4GlobalRouting>(proto)) {
+            for (uint32_t i = 0; i < global->GetNRoutes(); ++i) {
+                Add(routes, *global->GetRoute(i), 0);
+            }
+        } else if (Ptr<Ipv4StaticRouting> table = DynamicCast<Ipv4StaticRouting>(proto)) {
+            for (uint32_t i = 0; i < table->GetNRoutes(); ++i) {
+                Ipv4RoutingTableEntry e = table->GetRoute(i);
+                if (e.IsGateway()) {
+                    Add(routes, e, table->GetMetric(i));
+                }
+            }
+        } else if (Ptr<Ipv4TrieRouting> trie = DynamicCast<Ipv4TrieRouting>(proto)) {
+            for (uint32_t i = 0; i < trie->GetNRoutes(); ++i) {
+                Ipv4RoutingTableEntry e = trie->GetRoute(i);
+                if (e.IsGateway()) {
+                    Add(routes, e, trie->GetMetric(i));
+                }
+            }
+        }
+    }
+};
+
+} // namespace ns3
+
+#endif /* ROUTE_SNAPSHOT_H */
@@ -15,6 +15,34 @@
  *     - Interface 2: 10.1.2.1 (connected to n2)
  * - n2 is on network 10.1.2.0/24 (IP: 10.1.2.2)
  * - Static routes configured on n0 and n2 to reach each other through n1
+ *
+ * With --topology=hub-spoke|full-mesh|dual-homed|multi-tier the fixed
+ * 3-node network is replaced by a generated WAN of --branches sites (see
+ * wan-topology-helper.h); every branch then echoes to the first hub.
+ * Routes there come from --routing=synth (shortest paths, aggregated and
+ * summarized into each static table; see wan-route-synthesis.h) or
+ * --routing=global (Ipv4GlobalRoutingHelper), and --lookups times route
+ * lookups so the two can be compared. --table=trie swaps Ipv4StaticRouting
+ * for the longest-prefix-match trie in ipv4-trie-routing.h.
+ * --routeSnapshot=FILE saves the computed routes on the first run and loads
+ * them instead of computing them on later runs of the same topology
+ * (route-snapshot.h).
+ *
+ * --trace=off|counters|sampled|full selects the packet tracing (see
+ * packet-trace-helper.h); full, the default, captures every packet as
+ * EnablePcapAll did, sampled keeps 1 in --traceSample packets cut to
+ * --traceSnaplen bytes, and counters only writes per-device totals.
+ * --stats / --statsJson=FILE report run time, event rate and peak memory
+ * (run-stats.h).
+ *
+ * --anim=off|counters|packets selects the NetAnim output of the fixed
+ * network (the generated WAN is never animated). packets, the default,
+ * records every packet; counters records no packets, only each node's IPv4
+ * and queue counters every --animPoll seconds; off creates no
+ * AnimationInterface at all, so nothing is traced or formatted. Packets
+ * are recorded from --animStart to --animStop seconds (0 = end of the run),
+ * at most --animMaxPkts per XML file before a new file is started, and with
+ * their header metadata only if --animMetadata is set.
  */
 
 #include "ns3/applications-module.h"
@@ -24,18 +52,182 @@
 #include "ns3/netanim-module.h"
 #include "ns3/network-module.h"
 #include "ns3/point-to-point-module.h"
+#include "ipv4-trie-routing.h"
+#include "packet-trace-helper.h"
+#include "route-snapshot.h"
+#include "run-stats.h"
+#include "wan-route-synthesis.h"
+#include "wan-topology-helper.h"
+
+#include <chrono>
+#include <memory>
+#include <random>
 
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE("TwoNodesWithRouter");
 
+// Average cost of one RouteOutput() from a random node to a random link
+// address, through whatever routing protocols are installed.
+static void
+MeasureLookupCost(const WanTopologyHelper& wan, uint32_t lookups)
+{
+    std::mt19937 rng(1);
+    NodeContainer nodes = wan.GetNodes();
+    const std::vector<WanTopologyHelper::Link>& links = wan.GetLinks();
+    std::vector<Ptr<Ipv4RoutingProtocol>> protocols;
+    for (uint32_t i = 0; i < nodes.GetN(); ++i) {
+        protocols.push_back(nodes.Get(i)->GetObject<Ipv4>()->GetRoutingProtocol());
+    }
+
+    uint32_t misses = 0;
+    Ipv4Header header;
+    Socket::SocketErrno err;
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < lookups; ++i) {
+        const WanTopologyHelper::Link& l = links[rng() % links.size()];
+        header.SetDestination((rng() & 1) ? l.addrA : l.addrB);
+        if (protocols[rng() % protocols.size()]->RouteOutput(Ptr<Packet>(), header, 0, err) == 0) {
+            ++misses;
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "Route lookup: " << ns / lookups << " ns/lookup over " << lookups << " lookups ("
+              << misses << " without a route)\n";
+}
+
+// Echo from every branch of a generated WAN to the first hub.
+static void
+RunGeneratedWan(WanTopologyHelper& wan, const std::string& routing, const std::string& table,
+                bool aggregate, bool summarize, uint32_t lookups, const std::string& snapshot,
+                PacketTraceHelper& trace, RunStats& stats)
+{
+    if (table == "trie") {
+        Ipv4ListRoutingHelper list;
+        list.Add(Ipv4TrieRoutingHelper(), 0);
+        list.Add(Ipv4GlobalRoutingHelper(), -10);
+        wan.SetRoutingHelper(list);
+    } else if (table != "static") {
+        NS_ABORT_MSG("Unknown --table " << table << "; use static or trie");
+    }
+    wan.Build();
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t loaded = 0;
+    // The same topology routed another way must not reuse the snapshot
+    std::string key = routing == "synth" ? routing + (aggregate ? "+aggregate" : "") + (summarize ? "+summarize" : "")
+                                         : routing;
+    bool restored = false;
+    if (!snapshot.empty()) {
+        restored = table == "trie" ? RouteSnapshot::Load<Ipv4TrieRouting>(snapshot, wan.GetNodes(), key, &loaded)
+                                   : RouteSnapshot::Load<Ipv4StaticRouting>(snapshot, wan.GetNodes(), key, &loaded);
+    }
+    if (restored) {
+        std::cout << "Route snapshot: " << loaded << " routes loaded from " << snapshot << " in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() << " s\n";
+    } else if (routing == "synth") {
+        WanRouteSynthesizer synth;
+        synth.SetAggregate(aggregate);
+        synth.SetSummarize(summarize);
+        WanRouteSynthesizer::Stats st = table == "trie" ? synth.Install<Ipv4TrieRouting>(wan)
+                                                        : synth.Install<Ipv4StaticRouting>(wan);
+        std::cout << "Route synthesis: " << st.rawRoutes << " routes -> " << st.installedRoutes
+                  << " installed (" << static_cast<double>(st.installedRoutes) / wan.GetNodes().GetN()
+                  << " per node) in " << st.seconds << " s\n";
+    } else if (routing == "global") {
+        Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+        std::cout << "Global routing: populated in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() << " s\n";
+    } else {
+        NS_ABORT_MSG("Unknown --routing " << routing << "; use synth or global");
+    }
+    if (!snapshot.empty() && !restored) {
+        std::cout << "Route snapshot: " << RouteSnapshot::Save(snapshot, wan.GetNodes(), key) << " routes saved to "
+                  << snapshot << "\n";
+    }
+    if (lookups > 0) {
+        MeasureLookupCost(wan, lookups);
+    }
+
+    Ipv4Address hubAddress = wan.GetLinks()[0].addrA;
+    std::cout << "\n=== Generated WAN: " << wan.GetTopology() << ", "
+              << wan.GetBranches().GetN() << " branches, server " << hubAddress << " ===\n\n";
+
+    uint16_t port = 9;
+    UdpEchoServerHelper echoServer(port);
+    ApplicationContainer serverApps = echoServer.Install(wan.GetHubs().Get(0));
+    serverApps.Start(Seconds(1.0));
+    serverApps.Stop(Seconds(10.0));
+
+    UdpEchoClientHelper echoClient(hubAddress, port);
+    echoClient.SetAttribute("MaxPackets", UintegerValue(3));
+    echoClient.SetAttribute("Interval", TimeValue(Seconds(1.0)));
+    echoClient.SetAttribute("PacketSize", UintegerValue(1024));
+    ApplicationContainer clientApps = echoClient.Install(wan.GetBranches());
+    clientApps.Start(Seconds(2.0));
+    clientApps.Stop(Seconds(10.0));
+
+    NetDeviceContainer devices;
+    for (const WanTopologyHelper::Link& l : wan.GetLinks()) {
+        devices.Add(l.devA);
+        devices.Add(l.devB);
+    }
+    trace.Install(devices, "scratch/router-static-routing");
+
+    Simulator::Stop(Seconds(11.0));
+    stats.Run();
+    trace.Finish();
+    stats.Report("router-static-routing");
+    Simulator::Destroy();
+}
+
 int
 main(int argc, char* argv[])
 {
+    RunStats stats;
+    WanTopologyHelper wan;
+    std::string routing = "synth";
+    std::string table = "static";
+    bool aggregate = true;
+    bool summarize = true;
+    uint32_t lookups = 100000;
+    std::string snapshot;
+    PacketTraceHelper trace;
+    std::string animMode = "packets";
+    double animStart = 0.0;
+    double animStop = 0.0;
+    double animPoll = 1.0;
+    uint64_t animMaxPkts = 100000;
+    bool animMetadata = false;
+    CommandLine cmd(__FILE__);
+    wan.AddCommandLineOptions(cmd);
+    trace.AddCommandLineOptions(cmd);
+    stats.AddCommandLineOptions(cmd);
+    cmd.AddValue("routing", "Generated WAN routing: synth (static tables) or global", routing);
+    cmd.AddValue("table", "Generated WAN route table: static (Ipv4StaticRouting) or trie", table);
+    cmd.AddValue("aggregate", "Merge sibling prefixes with the same next hop", aggregate);
+    cmd.AddValue("summarize", "Replace the most common next hop by a default route", summarize);
+    cmd.AddValue("lookups", "Timed route lookups after setup (0 = skip)", lookups);
+    cmd.AddValue("routeSnapshot", "Load the generated WAN's routes from this file, or compute and save them there",
+                 snapshot);
+    cmd.AddValue("anim", "NetAnim output: off, counters (per-node counters only) or packets", animMode);
+    cmd.AddValue("animStart", "Start recording the animation at this time (s)", animStart);
+    cmd.AddValue("animStop", "Stop recording the animation at this time (s, 0 = end of the run)", animStop);
+    cmd.AddValue("animPoll", "Counter sampling interval with --anim=counters (s)", animPoll);
+    cmd.AddValue("animMaxPkts", "Packets per animation XML file before starting the next one", animMaxPkts);
+    cmd.AddValue("animMetadata", "Record packet header metadata in the animation", animMetadata);
+    cmd.Parse(argc, argv);
+    NS_ABORT_MSG_UNLESS(animMode == "off" || animMode == "counters" || animMode == "packets",
+                        "Unknown --anim=" << animMode);
+
     // Enable logging
     LogComponentEnable("UdpEchoClientApplication", LOG_LEVEL_INFO);
     LogComponentEnable("UdpEchoServerApplication", LOG_LEVEL_INFO);
 
+    if (wan.IsGenerated()) {
+        RunGeneratedWan(wan, routing, table, aggregate, summarize, lookups, snapshot, trace, stats);
+        return 0;
+    }
+
     // Create three nodes: n0 (client), n1 (router), n2 (server)
     NodeContainer nodes;
     nodes.Create(3);
@@ -155,34 +347,59 @@ main(int argc, char* argv[])
     clientApps.Stop(Seconds(10.0));
 
     // *** NetAnim Configuration ***
-    AnimationInterface anim("scratch/router-static-routing.xml");
-
-    // Node positions are already set via MobilityModel above
-    // NetAnim will automatically use the mobility model positions
-
-    // Set node descriptions
-    anim.UpdateNodeDescription(n0, "Client\n10.1.1.1");
-    anim.UpdateNodeDescription(n1, "Router\n10.1.1.2 | 10.1.2.1");
-    anim.UpdateNodeDescription(n2, "Server\n10.1.2.2");
-
-    // Set node colors
-    anim.UpdateNodeColor(n0, 0, 255, 0);   // Green for client
-    anim.UpdateNodeColor(n1, 255, 255, 0); // Yellow for router
-    anim.UpdateNodeColor(n2, 0, 0, 255);   // Blue for server
-
-    // Enable PCAP tracing on all devices for Wireshark analysis
-    p2p.EnablePcapAll("scratch/router-static-routing");
+    // Created only when requested: an AnimationInterface hooks the
+    // transmit/receive traces of every device as soon as it exists.
+    std::unique_ptr<AnimationInterface> anim;
+    if (animMode != "off") {
+        Time start = Seconds(animStart);
+        Time stop = Seconds(animStop > 0 ? animStop : 11.0);
+        anim.reset(new AnimationInterface("scratch/router-static-routing.xml"));
+        anim->SetStartTime(start);
+        anim->SetStopTime(stop);
+        anim->SetMaxPktsPerTraceFile(animMaxPkts);
+        anim->EnablePacketMetadata(animMetadata);
+        if (animMode == "counters") {
+            anim->SkipPacketTracing();
+            anim->EnableIpv4L3ProtocolCounters(start, stop, Seconds(animPoll));
+            anim->EnableQueueCounters(start, stop, Seconds(animPoll));
+        }
+
+        // Node positions are already set via MobilityModel above
+        // NetAnim will automatically use the mobility model positions
+
+        // Set node descriptions
+        anim->UpdateNodeDescription(n0, "Client\n10.1.1.1");
+        anim->UpdateNodeDescription(n1, "Router\n10.1.1.2 | 10.1.2.1");
+        anim->UpdateNodeDescription(n2, "Server\n10.1.2.2");
+
+        // Set node colors
+        anim->UpdateNodeColor(n0, 0, 255, 0);   // Green for client
+        anim->UpdateNodeColor(n1, 255, 255, 0); // Yellow for router
+        anim->UpdateNodeColor(n2, 0, 0, 255);   // Blue for server
+    }
+
+    // Packet tracing on all devices (PCAP for Wireshark unless --trace says otherwise)
+    NetDeviceContainer allDevices(link1Devices, link2Devices);
+    trace.Install(allDevices, "scratch/router-static-routing");
 
     // Run simulation
     Simulator::Stop(Seconds(11.0));
-    Simulator::Run();
+    stats.Run();
+    trace.Finish();
+    stats.Report("router-static-routing");
     Simulator::Destroy();
 
     std::cout << "\n=== Simulation Complete ===\n";
-    std::cout << "Animation trace saved to: scratch/router-static-routing.xml\n";
+    if (anim) {
+        std::cout << "Animation trace saved to: scratch/router-static-routing.xml\n";
+    }
     std::cout << "Routing tables saved to: scratch/router-static-routing.routes\n";
-    std::cout << "PCAP traces saved to: scratch/router-static-routing-*.pcap\n";
-    std::cout << "Open the XML file with NetAnim to visualize the simulation.\n";
+    if (trace.GetLevel() >= PacketTraceHelper::SAMPLED) {
+        std::cout << "PCAP traces saved to: scratch/router-static-routing-*.pcap\n";
+    }
+    if (anim) {
+        std::cout << "Open the XML file with NetAnim to visualize the simulation.\n";
+    }
 
     return 0;
 }
@@ -0,0 +1,235 @@
+/*
+ * Wall-clock, event-rate and memory instrumentation for the scenario scripts.
+ *
+ *   RunStats stats;                    // As early in main() as possible
+ *   stats.AddCommandLineOptions(cmd);
+ *   ...build the scenario...
+ *   stats.Run();                       // Instead of Simulator::Run()
+ *   stats.Report("qos-implementation");
+ *   Simulator::Destroy();
+ *
+ * --stats prints setup time, run time, events/s, simulated seconds per wall
+ * second and peak RSS at exit; --statsJson=FILE writes the same as JSON
+ * (FILE.rankN per rank after SetRank(), for distributed runs).
+ * --statsSample=S also samples Simulator::GetEventCount() and RSS every S
+ * simulated seconds, which shows where a run slows down (the JSON holds the
+ * samples, the printout the slowest and fastest interval).
+ *
+ * --eventScheduler=map|heap|list|calendar|priority|wheel picks the simulator's
+ * event queue (default map, ns-3's own default); 'wheel' is the
+ * TimingWheelScheduler of timing-wheel-scheduler.h. The choice is reported
+ * with the statistics so runs with different schedulers can be compared.
+ *
+ * Sampling reschedules itself, so the scenario must end with Simulator::Stop().
+ *
+ * Linux only for RSS (getrusage, /proc/self/statm).
+ */
+
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include "ns3/core-module.h"
+
+#include "timing-wheel-scheduler.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+namespace ns3
+{
+
+class RunStats
+{
+public:
+    RunStats()
+        : m_print(false),
+          m_scheduler("map"),
+          m_sampleSeconds(0),
+          m_start(Clock::now()),
+          m_runStart(m_start),
+          m_runEnd(m_start),
+          m_events(0),
+          m_simSeconds(0)
+    {
+    }
+
+    void AddCommandLineOptions(CommandLine& cmd)
+    {
+        cmd.AddValue("stats", "Print run time, event rate and peak memory at exit", m_print);
+        cmd.AddValue("statsJson", "Write the run statistics to this JSON file", m_json);
+        cmd.AddValue("statsSample", "Sample event count and RSS every N simulated seconds (0 = off)", m_sampleSeconds);
+        cmd.AddValue("eventScheduler", "Event queue: map, heap, list, calendar, priority or wheel", m_scheduler);
+    }
+
+    bool IsEnabled(void) const { return m_print || !m_json.empty(); }
+
+    // Distributed runs: each rank measures its own process, so it writes
+    // its own --statsJson file, FILE.rankN (as the flow monitor samples do).
+    void SetRank(uint32_t rank)
+    {
+        if (!m_json.empty()) {
+            std::ostringstream suffix;
+            suffix << ".rank" << rank;
+            m_json += suffix.str();
+        }
+    }
+
+    // Simulator::Run(), timed; everything before it counts as setup.
+    void Run(void)
+    {
+        // Events scheduled during setup move over to the new queue
+        Simulator::SetScheduler(SchedulerFactory(m_scheduler));
+        if (IsEnabled() && m_sampleSeconds > 0) {
+            Simulator::Schedule(Seconds(m_sampleSeconds), &RunStats::Sample, this);
+        }
+        m_runStart = Clock::now();
+        Simulator::Run();
+        m_runEnd = Clock::now();
+        m_events = Simulator::GetEventCount();
+        m_simSeconds = Simulator::Now().GetSeconds();
+    }
+
+    // Prints and/or writes the statistics. Call after Run(), before Simulator::Destroy().
+    void Report(const std::string& scenario) const
+    {
+        if (!IsEnabled()) {
+            return;
+        }
+        double setup = Elapsed(m_start, m_runStart);
+        double run = Elapsed(m_runStart, m_runEnd);
+        double eventRate = run > 0 ? m_events / run : 0.0;
+        double speed = run > 0 ? m_simSeconds / run : 0.0;
+        uint64_t peakKb = PeakRssKb();
+
+        if (m_print) {
+            std::cout << "\n--- Run statistics (" << scenario << ") ---\n" << std::fixed << std::setprecision(3)
+                      << "Scheduler:  " << m_scheduler << "\n"
+                      << "Setup:      " << setup << " s\n"
+                      << "Run:        " << run << " s for " << m_simSeconds << " simulated s ("
+                      << speed << " sim s / wall s)\n"
+                      << "Events:     " << m_events << " (" << std::setprecision(0) << eventRate << " /s)\n"
+                      << "Peak RSS:   " << std::setprecision(1) << peakKb / 1024.0 << " MB\n";
+            if (m_samples.size() > 1) {
+                double lo = 0;
+                double hi = 0;
+                for (uint32_t i = 1; i < m_samples.size(); ++i) {
+                    double r = IntervalRate(i);
+                    lo = i == 1 || r < lo ? r : lo;
+                    hi = i == 1 || r > hi ? r : hi;
+                }
+                std::cout << "Interval:   " << std::setprecision(0) << lo << " .. " << hi << " events/s over "
+                          << m_samples.size() << " samples\n";
+            }
+            std::cout << std::defaultfloat;
+        }
+
+        if (!m_json.empty()) {
+            std::ofstream out(m_json.c_str());
+            out << std::setprecision(9) << "{\n"
+                << "  \"scenario\": \"" << scenario << "\",\n"
+                << "  \"scheduler\": \"" << m_scheduler << "\",\n"
+                << "  \"setup_s\": " << setup << ",\n"
+                << "  \"run_s\": " << run << ",\n"
+                << "  \"simulated_s\": " << m_simSeconds << ",\n"
+                << "  \"events\": " << m_events << ",\n"
+                << "  \"events_per_s\": " << eventRate << ",\n"
+                << "  \"sim_s_per_wall_s\": " << speed << ",\n"
+                << "  \"peak_rss_kb\": " << peakKb << ",\n"
+                << "  \"samples\": [";
+            for (uint32_t i = 0; i < m_samples.size(); ++i) {
+                const Point& s = m_samples[i];
+                out << (i ? ",\n    " : "\n    ") << "{\"sim_s\": " << s.simSeconds << ", \"wall_s\": " << s.wallSeconds
+                    << ", \"events\": " << s.events << ", \"rss_kb\": " << s.rssKb << "}";
+            }
+            out << (m_samples.empty() ? "]\n" : "\n  ]\n") << "}\n";
+            if (m_print) {
+                std::cout << "Run statistics written to " << m_json << "\n";
+            }
+        }
+    }
+
+    // Factory for an --eventScheduler name; aborts on an unknown one.
+    static ObjectFactory SchedulerFactory(const std::string& name)
+    {
+        ObjectFactory factory;
+        if (name == "map") {
+            factory.SetTypeId("ns3::MapScheduler");
+        } else if (name == "heap") {
+            factory.SetTypeId("ns3::HeapScheduler");
+        } else if (name == "list") {
+            factory.SetTypeId("ns3::ListScheduler");
+        } else if (name == "calendar") {
+            factory.SetTypeId("ns3::CalendarScheduler");
+        } else if (name == "priority") {
+            factory.SetTypeId("ns3::PriorityQueueScheduler");
+        } else if (name == "wheel") {
+            factory.SetTypeId(TimingWheelScheduler::GetTypeId());
+        } else {
+            NS_FATAL_ERROR("Unknown --eventScheduler '" << name << "' (map, heap, list, calendar, priority, wheel)");
+        }
+        return factory;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Point
+    {
+        double simSeconds;
+        double wallSeconds;      // Since Run()
+        uint64_t events;
+        uint64_t rssKb;
+    };
+
+    static double Elapsed(Clock::time_point a, Clock::time_point b) { return std::chrono::duration<double>(b - a).count(); }
+
+    void Sample(void)
+    {
+        Point s = {Simulator::Now().GetSeconds(), Elapsed(m_runStart, Clock::now()), Simulator::GetEventCount(), RssKb()};
+        m_samples.push_back(s);
+        Simulator::Schedule(Seconds(m_sampleSeconds), &RunStats::Sample, this);
+    }
+
+    double IntervalRate(uint32_t i) const
+    {
+        double wall = m_samples[i].wallSeconds - m_samples[i - 1].wallSeconds;
+        return wall > 0 ? (m_samples[i].events - m_samples[i - 1].events) / wall : 0.0;
+    }
+
+    static uint64_t PeakRssKb(void)
+    {
+        struct rusage ru;
+        return getrusage(RUSAGE_SELF, &ru) == 0 ? static_cast<uint64_t>(ru.ru_maxrss) : 0; // kB on Linux
+    }
+
+    static uint64_t RssKb(void)
+    {
+        std::ifstream statm("/proc/self/statm");
+        uint64_t size = 0;
+        uint64_t resident = 0;
+        statm >> size >> resident;
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+    bool m_print;
+    std::string m_scheduler;
+    std::string m_json;
+    double m_sampleSeconds;
+    Clock::time_point m_start;
+    Clock::time_point m_runStart;
+    Clock::time_point m_runEnd;
+    uint64_t m_events;
+    double m_simSeconds;
+    std::vector<Point> m_samples;
+};
+
+} // namespace ns3
+
+#endif /* RUN_STATS_H */
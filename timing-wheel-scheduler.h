@@ -0,0 +1,197 @@
+/*
+ * TimingWheelScheduler: an ns-3 event scheduler built for the event mix of
+ * packet simulations, where almost every event lands within a few link
+ * delays of the current time.
+ *
+ * Time is cut into buckets of 2^BucketShift time steps. A wheel of
+ * 'Buckets' slots holds, unsorted, the events of the next Buckets buckets;
+ * events beyond that window wait in a binary heap and move into the wheel as
+ * it turns. Only the bucket being drained is sorted, so an insert is an
+ * append to a vector and a removal is a pop_back: O(1) amortized, with the
+ * events of one bucket contiguous in memory instead of spread over
+ * red-black tree nodes (MapScheduler).
+ *
+ * Events may only be inserted at or after the last removed one, as ns-3
+ * guarantees; an insert earlier than the bucket a PeekNext() advanced to is
+ * still handled (the wheel turns back), just not in O(1).
+ */
+
+#ifndef TIMING_WHEEL_SCHEDULER_H
+#define TIMING_WHEEL_SCHEDULER_H
+
+#include "ns3/core-module.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace ns3
+{
+
+class TimingWheelScheduler : public Scheduler
+{
+public:
+    static TypeId GetTypeId(void)
+    {
+        static TypeId tid = TypeId("ns3::TimingWheelScheduler")
+            .SetParent<Scheduler>()
+            .SetGroupName("Core")
+            .AddConstructor<TimingWheelScheduler>()
+            .AddAttribute("BucketShift", "log2 of the bucket width in time steps",
+                          UintegerValue(12),
+                          MakeUintegerAccessor(&TimingWheelScheduler::m_shift),
+                          MakeUintegerChecker<uint32_t>(0, 40))
+            .AddAttribute("Buckets", "Wheel slots (rounded up to a power of two)",
+                          UintegerValue(4096),
+                          MakeUintegerAccessor(&TimingWheelScheduler::m_nBuckets),
+                          MakeUintegerChecker<uint32_t>(1, 1u << 24));
+        return tid;
+    }
+
+    TimingWheelScheduler() : m_shift(12), m_nBuckets(4096), m_mask(0), m_current(0), m_inWheel(0), m_size(0) {}
+    virtual ~TimingWheelScheduler() {}
+
+    virtual void Insert(const Event& ev) override
+    {
+        if (m_wheel.empty()) {
+            uint32_t n = 1;
+            while (n < m_nBuckets) {
+                n <<= 1;
+            }
+            m_wheel.resize(n);
+            m_mask = n - 1;
+            m_current = BucketOf(ev);
+        }
+        ++m_size;
+        uint64_t b = BucketOf(ev);
+        if (b == m_current) {
+            // Keep the drained bucket sorted, earliest last
+            m_active.insert(std::upper_bound(m_active.begin(), m_active.end(), ev, Later), ev);
+        } else if (b < m_current) {
+            TurnBack(b);
+            m_active.push_back(ev);
+        } else if (b - m_current <= m_mask) {
+            m_wheel[b & m_mask].push_back(ev);
+            ++m_inWheel;
+        } else {
+            m_heap.push_back(ev);
+            std::push_heap(m_heap.begin(), m_heap.end(), Later);
+        }
+    }
+
+    virtual bool IsEmpty(void) const override { return m_size == 0; }
+
+    virtual Event PeekNext(void) const override
+    {
+        NS_ASSERT(!IsEmpty());
+        const_cast<TimingWheelScheduler*>(this)->Settle();
+        return m_active.back();
+    }
+
+    virtual Event RemoveNext(void) override
+    {
+        NS_ASSERT(!IsEmpty());
+        Settle();
+        Event ev = m_active.back();
+        m_active.pop_back();
+        --m_size;
+        return ev;
+    }
+
+    virtual void Remove(const Event& ev) override
+    {
+        if (Erase(m_active, ev)) {
+            --m_size;
+            return;
+        }
+        if (!m_wheel.empty() && Erase(m_wheel[BucketOf(ev) & m_mask], ev)) {
+            --m_inWheel;
+            --m_size;
+            return;
+        }
+        if (Erase(m_heap, ev)) {
+            std::make_heap(m_heap.begin(), m_heap.end(), Later);
+            --m_size;
+            return;
+        }
+        NS_ASSERT_MSG(false, "Removing an event the scheduler does not hold");
+    }
+
+private:
+    static bool Later(const Event& a, const Event& b)
+    {
+        return a.key.m_ts != b.key.m_ts ? a.key.m_ts > b.key.m_ts : a.key.m_uid > b.key.m_uid;
+    }
+
+    uint64_t BucketOf(const Event& ev) const { return ev.key.m_ts >> m_shift; }
+
+    static bool Erase(std::vector<Event>& v, const Event& ev)
+    {
+        for (std::vector<Event>::iterator i = v.begin(); i != v.end(); ++i) {
+            if (i->key.m_uid == ev.key.m_uid) {
+                v.erase(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Makes m_active hold the earliest bucket's events, earliest last.
+    void Settle(void)
+    {
+        while (m_active.empty()) {
+            if (m_inWheel == 0) {
+                m_current = BucketOf(m_heap.front()); // Nothing near: jump to the heap's earliest
+            } else {
+                ++m_current;
+            }
+            // The window now ends one bucket later
+            while (!m_heap.empty() && BucketOf(m_heap.front()) - m_current <= m_mask) {
+                m_wheel[BucketOf(m_heap.front()) & m_mask].push_back(m_heap.front());
+                ++m_inWheel;
+                std::pop_heap(m_heap.begin(), m_heap.end(), Later);
+                m_heap.pop_back();
+            }
+            std::vector<Event>& slot = m_wheel[m_current & m_mask];
+            if (slot.empty()) {
+                continue;
+            }
+            // After a TurnBack a slot can also hold events of the next lap
+            for (uint32_t i = 0; i < slot.size();) {
+                if (BucketOf(slot[i]) == m_current) {
+                    m_active.push_back(slot[i]);
+                    slot[i] = slot.back();
+                    slot.pop_back();
+                } else {
+                    ++i;
+                }
+            }
+            m_inWheel -= m_active.size();
+            std::sort(m_active.begin(), m_active.end(), Later);
+        }
+    }
+
+    // An event arrived before the bucket Settle() advanced to: the drained
+    // bucket goes back into the wheel and draining restarts at 'bucket'.
+    void TurnBack(uint64_t bucket)
+    {
+        std::vector<Event>& slot = m_wheel[m_current & m_mask];
+        slot.insert(slot.end(), m_active.begin(), m_active.end());
+        m_inWheel += m_active.size();
+        m_active.clear();
+        m_current = bucket;
+    }
+
+    uint32_t m_shift;
+    uint32_t m_nBuckets;
+    uint64_t m_mask;
+    uint64_t m_current;                   // Absolute bucket being drained
+    std::vector<Event> m_active;          // Its events, sorted, earliest last
+    std::vector<std::vector<Event> > m_wheel;
+    uint32_t m_inWheel;
+    std::vector<Event> m_heap;            // Beyond the window; min-heap on Later
+    uint32_t m_size;
+};
+
+} // namespace ns3
+
+#endif /* TIMING_WHEEL_SCHEDULER_H */
@@ -0,0 +1,568 @@
+/*
+ * DiffServ edge traffic conditioner: 5-tuple marking, then per-DSCP
+ * token-bucket policing and shaping, in front of a queue disc.
+ *
+ * TokenBucketMeter colors packets with the single-rate (srTCM, RFC 2697) or
+ * two-rate (trTCM, RFC 2698) three-color marker, color-blind. Buckets are not
+ * refilled by timers: each call credits the tokens earned since the last one,
+ * so a meter costs nothing between packets, whatever its rate.
+ *
+ * TrafficConditionerQueueDisc is a root queue disc with a single child (the
+ * scheduler; a FIFO if none is configured).
+ *
+ * Its "Marks" attribute sets the DSCP once, at the edge: hosts need not set
+ * it, and downstream hops (PbrRouting's DSCP table, DSCP-classifying queue
+ * discs) only read that one byte. PfifoFast reads the SocketPriorityTag
+ * instead, so any remark here (marking or yellow=) also resets that tag to
+ * the priority a socket derives from the new TOS (Socket::IpTos2Priority).
+ * Rules are ';'-separated, the first match wins, and fields left out are
+ * wildcards:
+ *
+ *   proto=udp dport=9 set=ef; dst=10.1.3.0/24 dport=5000-5100 set=af41; set=be
+ *
+ *   src, dst        A.B.C.D or A.B.C.D/len
+ *   proto           udp, tcp or an IP protocol number
+ *   sport, dport    N or N-M
+ *   dscp            the DSCP the packet arrives with
+ *   set             the DSCP it leaves with (same names as dscp=)
+ *
+ * Matching uses PbrClassifier (pbr-classifier.h), one hash probe per rule
+ * shape. The profiles below then see the new DSCP. "Profiles" lists
+ * one conditioning profile per DSCP, ';'-separated, each as key=value pairs:
+ *
+ *   dscp=ef mode=srtcm cir=1Mbps cbs=3000 ebs=6000 action=police yellow=af13
+ *   dscp=0 mode=trtcm cir=2Mbps cbs=3000 pir=4Mbps pbs=6000 action=shape limit=100
+ *
+ *   dscp    0..63, ef, be, csN or afXY
+ *   mode    srtcm (cir, cbs, ebs) or trtcm (cir, cbs, pir, pbs)
+ *   action  police: red packets are dropped on enqueue, yellow ones are
+ *           remarked to 'yellow' (default: passed unchanged);
+ *           shape: packets wait in a per-profile FIFO of 'limit' packets
+ *           until they are green, then leave ahead of the child
+ *
+ * Shaped packets are released in DoDequeue(), when the queue disc is asked
+ * for a packet anyway; only when nothing else is left to send is a single
+ * wake-up scheduled, for when the earliest held packet turns green. They
+ * leave straight from their FIFO rather than through the child: moving a
+ * packet between two of the root's own queues would count it as enqueued
+ * twice. A shaper's output is bounded by its rate, so it cannot starve
+ * the child.
+ * Bucket sizes are in bytes and should exceed the largest packet (IP header
+ * included): a bigger packet is never green under policing; a shaper lets it
+ * through on a full bucket and runs the bucket into debt.
+ *
+ * It must be the root queue disc, since the wake-up restarts it.
+ */
+
+#ifndef TRAFFIC_CONDITIONER_H
+#define TRAFFIC_CONDITIONER_H
+
+#include "ns3/core-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/network-module.h"
+#include "ns3/traffic-control-module.h"
+#include "pbr-classifier.h"
+#include "pbr-routing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+namespace ns3
+{
+
+// =================================================================
+// TokenBucketMeter: srTCM / trTCM with lazy refill
+// =================================================================
+class TokenBucketMeter
+{
+public:
+    enum Color { GREEN, YELLOW, RED };
+
+    TokenBucketMeter() : m_twoRate(false), m_cRate(0), m_pRate(0), m_cbs(0), m_xbs(0), m_tc(0), m_tx(0) {}
+
+    // RFC 2697: C bucket (cbs) at cir; its overflow fills the E bucket (ebs).
+    void SetSingleRate(DataRate cir, uint32_t cbs, uint32_t ebs)
+    {
+        Set(false, cir, cbs, cir, ebs);
+    }
+
+    // RFC 2698: P bucket (pbs) at pir, C bucket (cbs) at cir.
+    void SetTwoRate(DataRate cir, uint32_t cbs, DataRate pir, uint32_t pbs)
+    {
+        Set(true, cir, cbs, pir, pbs);
+    }
+
+    // Colors (and pays for) a packet of 'bytes' arriving at 'now'.
+    Color Meter(uint32_t bytes, Time now)
+    {
+        Refill(now);
+        if (m_twoRate) {
+            if (m_tx < bytes) {
+                return RED;
+            }
+            m_tx -= bytes;
+            if (m_tc < bytes) {
+                return YELLOW;
+            }
+            m_tc -= bytes;
+            return GREEN;
+        }
+        if (m_tc >= bytes) {
+            m_tc -= bytes;
+            return GREEN;
+        }
+        if (m_tx >= bytes) {
+            m_tx -= bytes;
+            return YELLOW;
+        }
+        return RED;
+    }
+
+    // How long until a packet of 'bytes' is green; zero if it is now. A
+    // packet bigger than a bucket only needs that bucket full.
+    Time GreenDelay(uint32_t bytes, Time now)
+    {
+        Refill(now);
+        double wait = std::max(0.0, (std::min<double>(bytes, m_cbs) - m_tc) / m_cRate);
+        if (m_twoRate) {
+            wait = std::max(wait, (std::min<double>(bytes, m_xbs) - m_tx) / m_pRate);
+        }
+        return NanoSeconds(static_cast<int64_t>(std::ceil(wait * 1e9)));
+    }
+
+    // Pays for a packet GreenDelay() cleared; the buckets may go into debt.
+    void ConsumeGreen(uint32_t bytes)
+    {
+        m_tc -= bytes;
+        if (m_twoRate) {
+            m_tx -= bytes;
+        }
+    }
+
+private:
+    void Set(bool twoRate, DataRate cir, uint32_t cbs, DataRate xir, uint32_t xbs)
+    {
+        m_twoRate = twoRate;
+        m_cRate = cir.GetBitRate() / 8.0;
+        m_pRate = xir.GetBitRate() / 8.0;
+        m_cbs = cbs;
+        m_xbs = xbs;
+        m_tc = cbs; // Both buckets start full
+        m_tx = xbs;
+        m_last = Simulator::Now();
+    }
+
+    void Refill(Time now)
+    {
+        double earned = (now - m_last).GetSeconds();
+        m_last = now;
+        if (earned <= 0) {
+            return;
+        }
+        if (m_twoRate) {
+            m_tc = std::min(m_cbs, m_tc + earned * m_cRate);
+            m_tx = std::min(m_xbs, m_tx + earned * m_pRate);
+            return;
+        }
+        double tc = m_tc + earned * m_cRate;
+        if (tc > m_cbs) {
+            m_tx = std::min(m_xbs, m_tx + tc - m_cbs); // C overflows into E
+            tc = m_cbs;
+        }
+        m_tc = tc;
+    }
+
+    bool m_twoRate;
+    double m_cRate;    // Bytes/s into C
+    double m_pRate;    // Bytes/s into P (trTCM)
+    double m_cbs;
+    double m_xbs;      // EBS (srTCM) or PBS (trTCM)
+    double m_tc;       // Tokens in C
+    double m_tx;       // Tokens in E or P
+    Time m_last;
+};
+
+// =================================================================
+// TrafficConditionerQueueDisc: mark, police / shape per DSCP, then the child
+// =================================================================
+class TrafficConditionerQueueDisc : public QueueDisc
+{
+public:
+    static constexpr const char* POLICED_DROP = "Policed (red)";
+
+    struct Counts
+    {
+        uint64_t green;
+        uint64_t yellow;
+        uint64_t red;
+        uint64_t delayed;  // Shaped packets that had to wait
+    };
+
+    static TypeId GetTypeId(void)
+    {
+        static TypeId tid = TypeId("ns3::TrafficConditionerQueueDisc")
+            .SetParent<QueueDisc>()
+            .SetGroupName("TrafficControl")
+            .AddConstructor<TrafficConditionerQueueDisc>()
+            .AddAttribute("Profiles", "';'-separated conditioning profiles, see traffic-conditioner.h",
+                          StringValue(""),
+                          MakeStringAccessor(&TrafficConditionerQueueDisc::m_profilesStr),
+                          MakeStringChecker())
+            .AddAttribute("Marks", "';'-separated DSCP marking rules, see traffic-conditioner.h",
+                          StringValue(""),
+                          MakeStringAccessor(&TrafficConditionerQueueDisc::m_marksStr),
+                          MakeStringChecker());
+        return tid;
+    }
+
+    TrafficConditionerQueueDisc() : QueueDisc(QueueDiscSizePolicy::NO_LIMITS), m_nMarked(0) {}
+    virtual ~TrafficConditionerQueueDisc() {}
+
+    uint32_t GetNProfiles(void) const { return m_profiles.size(); }
+    uint8_t GetProfileDscp(uint32_t i) const { return m_profiles[i].dscp; }
+    bool IsShaper(uint32_t i) const { return m_profiles[i].shape; }
+    const Counts& GetCounts(uint32_t i) const { return m_profiles[i].counts; }
+    uint32_t GetNMarkRules(void) const { return m_marks.GetNRules(); }
+    // Packets whose DSCP a marking rule changed.
+    uint64_t GetNMarked(void) const { return m_nMarked; }
+
+    // Parses a dscp= value: a number or ef, be, csN, afXY; -1 if invalid.
+    static int32_t ParseDscp(const std::string& s)
+    {
+        if (s == "ef") {
+            return 46;
+        }
+        if (s == "be" || s == "default") {
+            return 0;
+        }
+        if (s.size() == 3 && s.compare(0, 2, "cs") == 0 && s[2] >= '0' && s[2] <= '7') {
+            return (s[2] - '0') << 3;
+        }
+        if (s.size() == 4 && s.compare(0, 2, "af") == 0 && s[2] >= '1' && s[2] <= '4' && s[3] >= '1' && s[3] <= '3') {
+            return ((s[2] - '0') << 3) | ((s[3] - '0') << 1);
+        }
+        char* end = 0;
+        long v = std::strtol(s.c_str(), &end, 10);
+        return !s.empty() && *end == '\0' && v >= 0 && v < 64 ? static_cast<int32_t>(v) : -1;
+    }
+
+private:
+    struct Profile
+    {
+        uint8_t dscp;
+        bool shape;
+        int32_t yellowDscp;   // Remark yellow to this, or -1
+        uint32_t limit;       // Shaper queue, packets
+        uint32_t queue;       // Internal queue index (shapers)
+        bool headDelayed;     // The shaper's head packet has been held already
+        TokenBucketMeter meter;
+        Counts counts;
+    };
+
+    virtual void DoDispose(void) override
+    {
+        m_wakeUp.Cancel();
+        QueueDisc::DoDispose();
+    }
+
+    virtual bool DoEnqueue(Ptr<QueueDiscItem> item) override
+    {
+        if (m_marks.GetNRules() > 0) {
+            Mark(item);
+        }
+        uint8_t tos = 0;
+        int32_t p = item->GetUint8Value(QueueItem::IP_DSFIELD, tos) ? m_profileOf[tos >> 2] : -1;
+        if (p < 0) {
+            return GetChild()->Enqueue(item);
+        }
+        Profile& profile = m_profiles[p];
+        if (profile.shape) {
+            // Conformance is checked when packets leave; on overflow the
+            // internal queue drops (and traces) the packet.
+            return GetInternalQueue(profile.queue)->Enqueue(item);
+        }
+        TokenBucketMeter::Color color = profile.meter.Meter(item->GetSize(), Simulator::Now());
+        if (color == TokenBucketMeter::RED) {
+            ++profile.counts.red;
+            DropBeforeEnqueue(item, POLICED_DROP);
+            return false;
+        }
+        if (color == TokenBucketMeter::YELLOW) {
+            ++profile.counts.yellow;
+            if (profile.yellowDscp >= 0) {
+                Remark(item, profile.yellowDscp);
+            }
+        } else {
+            ++profile.counts.green;
+        }
+        return GetChild()->Enqueue(item);
+    }
+
+    virtual Ptr<QueueDiscItem> DoDequeue(void) override
+    {
+        // A shaped packet that is green by now goes first
+        Time now = Simulator::Now();
+        Time wait = Time::Max();
+        for (Profile& profile : m_profiles) {
+            if (!profile.shape) {
+                continue;
+            }
+            Ptr<InternalQueue> queue = GetInternalQueue(profile.queue);
+            Ptr<const QueueDiscItem> head = queue->Peek();
+            if (head == 0) {
+                continue;
+            }
+            Time delay = profile.meter.GreenDelay(head->GetSize(), now);
+            if (delay.IsStrictlyPositive()) {
+                profile.counts.delayed += profile.headDelayed ? 0 : 1;
+                profile.headDelayed = true;
+                wait = std::min(wait, delay);
+                continue;
+            }
+            profile.meter.ConsumeGreen(head->GetSize());
+            profile.headDelayed = false;
+            ++profile.counts.green;
+            return queue->Dequeue();
+        }
+        Ptr<QueueDiscItem> item = GetChild()->Dequeue();
+        if (item == 0 && wait != Time::Max() && !m_wakeUp.IsRunning()) {
+            m_wakeUp = Simulator::Schedule(wait, &QueueDisc::Run, this);
+        }
+        return item;
+    }
+
+    virtual bool CheckConfig(void) override
+    {
+        if (GetNQueueDiscClasses() == 0) {
+            Ptr<QueueDisc> qd = CreateObject<FifoQueueDisc>();
+            qd->Initialize();
+            Ptr<QueueDiscClass> qdc = CreateObject<QueueDiscClass>();
+            qdc->SetQueueDisc(qd);
+            AddQueueDiscClass(qdc);
+        }
+        NS_ABORT_MSG_UNLESS(GetNQueueDiscClasses() == 1, "TrafficConditionerQueueDisc takes a single child");
+        ParseMarks();
+        ParseProfiles();
+        for (Profile& profile : m_profiles) {
+            if (profile.shape) {
+                profile.queue = GetNInternalQueues();
+                AddInternalQueue(CreateObjectWithAttributes<DropTailQueue<QueueDiscItem> >(
+                    "MaxSize", QueueSizeValue(QueueSize(QueueSizeUnit::PACKETS, profile.limit))));
+            }
+        }
+        return true;
+    }
+
+    virtual void InitializeParams(void) override {}
+
+    Ptr<QueueDisc> GetChild(void) const { return GetQueueDiscClass(0)->GetQueueDisc(); }
+
+    // The header is still separate from the payload while it is queued, so
+    // a rewrite here is what goes on the wire and what the child classifies.
+    // The priority tag follows, as if the socket had set the new TOS.
+    static void Remark(Ptr<QueueDiscItem> item, uint8_t dscp)
+    {
+        Ptr<Ipv4QueueDiscItem> ipItem = DynamicCast<Ipv4QueueDiscItem>(item);
+        if (ipItem == 0) {
+            return;
+        }
+        Ipv4Header& header = const_cast<Ipv4Header&>(ipItem->GetHeader());
+        header.SetDscp(static_cast<Ipv4Header::DscpType>(dscp));
+        SocketPriorityTag priority;
+        item->GetPacket()->RemovePacketTag(priority);
+        priority.SetPriority(Socket::IpTos2Priority(header.GetTos()));
+        item->GetPacket()->AddPacketTag(priority);
+    }
+
+    void Mark(Ptr<QueueDiscItem> item)
+    {
+        Ptr<Ipv4QueueDiscItem> ipItem = DynamicCast<Ipv4QueueDiscItem>(item);
+        if (ipItem == 0) {
+            return;
+        }
+        // The item's packet starts with the L4 header
+        uint32_t dscp = m_marks.Lookup(PbrRouting::MakeFlowKey(ipItem->GetHeader(), item->GetPacket(), true));
+        if (dscp != PbrClassifier::NO_MATCH && dscp != ipItem->GetHeader().GetDscp()) {
+            Remark(item, dscp);
+            ++m_nMarked;
+        }
+    }
+
+    // "A.B.C.D" or "A.B.C.D/len" into address and mask.
+    static void ParsePrefix(const std::string& s, Ipv4Address& address, Ipv4Mask& mask)
+    {
+        size_t slash = s.find('/');
+        address = Ipv4Address(s.substr(0, slash).c_str());
+        mask = Ipv4Mask(slash == std::string::npos ? "/32" : s.substr(slash).c_str());
+    }
+
+    // "N" or "N-M" into a port range.
+    static void ParsePorts(const std::string& s, uint16_t& low, uint16_t& high)
+    {
+        size_t dash = s.find('-');
+        low = static_cast<uint16_t>(std::atoi(s.substr(0, dash).c_str()));
+        high = dash == std::string::npos ? low : static_cast<uint16_t>(std::atoi(s.substr(dash + 1).c_str()));
+        NS_ABORT_MSG_IF(high < low, "Bad port range " << s);
+    }
+
+    void ParseMarks(void)
+    {
+        std::istringstream all(m_marksStr);
+        for (std::string spec; std::getline(all, spec, ';');) {
+            std::istringstream fields(spec);
+            PbrRule rule; // All priorities equal: the earlier rule wins
+            int32_t set = -1;
+            bool any = false;
+            for (std::string kv; fields >> kv;) {
+                any = true;
+                size_t eq = kv.find('=');
+                NS_ABORT_MSG_IF(eq == std::string::npos, "Marking rule field without '=': " << kv);
+                std::string key = kv.substr(0, eq);
+                std::string value = kv.substr(eq + 1);
+                if (key == "src") {
+                    ParsePrefix(value, rule.srcAddress, rule.srcMask);
+                } else if (key == "dst") {
+                    ParsePrefix(value, rule.dstAddress, rule.dstMask);
+                } else if (key == "proto") {
+                    rule.protocol = value == "udp" ? 17 : value == "tcp" ? 6 : std::atoi(value.c_str());
+                } else if (key == "sport") {
+                    ParsePorts(value, rule.srcPortMin, rule.srcPortMax);
+                } else if (key == "dport") {
+                    ParsePorts(value, rule.dstPortMin, rule.dstPortMax);
+                } else if (key == "dscp") {
+                    rule.dscp = ParseDscp(value);
+                    NS_ABORT_MSG_IF(rule.dscp < 0, "Bad dscp= in marking rule '" << spec << "'");
+                } else if (key == "set") {
+                    set = ParseDscp(value);
+                } else {
+                    NS_ABORT_MSG("Unknown marking rule field '" << key << "'");
+                }
+            }
+            if (!any) {
+                continue;
+            }
+            NS_ABORT_MSG_IF(set < 0, "Marking rule needs a valid set=: '" << spec << "'");
+            m_marks.Add(rule, set);
+        }
+    }
+
+    void ParseProfiles(void)
+    {
+        std::fill(m_profileOf, m_profileOf + 64, -1);
+        std::istringstream all(m_profilesStr);
+        for (std::string spec; std::getline(all, spec, ';');) {
+            std::istringstream fields(spec);
+            std::string mode = "srtcm";
+            std::string action = "police";
+            DataRate cir;
+            DataRate pir;
+            uint32_t cbs = 0;
+            uint32_t xbs = 0;
+            Profile profile;
+            profile.dscp = 0;
+            profile.yellowDscp = -1;
+            profile.limit = 100;
+            profile.queue = 0;
+            profile.headDelayed = false;
+            profile.counts = Counts();
+            int32_t dscp = -2;
+            bool any = false;
+            for (std::string kv; fields >> kv;) {
+                any = true;
+                size_t eq = kv.find('=');
+                NS_ABORT_MSG_IF(eq == std::string::npos, "Conditioner profile field without '=': " << kv);
+                std::string key = kv.substr(0, eq);
+                std::string value = kv.substr(eq + 1);
+                if (key == "dscp") {
+                    dscp = ParseDscp(value);
+                } else if (key == "mode") {
+                    mode = value;
+                } else if (key == "action") {
+                    action = value;
+                } else if (key == "cir") {
+                    cir = DataRate(value);
+                } else if (key == "pir") {
+                    pir = DataRate(value);
+                } else if (key == "cbs") {
+                    cbs = std::atoi(value.c_str());
+                } else if (key == "ebs" || key == "pbs") {
+                    xbs = std::atoi(value.c_str());
+                } else if (key == "yellow") {
+                    profile.yellowDscp = ParseDscp(value);
+                    NS_ABORT_MSG_IF(profile.yellowDscp < 0, "Bad yellow= DSCP in '" << spec << "'");
+                } else if (key == "limit") {
+                    profile.limit = std::max(1, std::atoi(value.c_str()));
+                } else {
+                    NS_ABORT_MSG("Unknown conditioner profile field '" << key << "'");
+                }
+            }
+            if (!any) {
+                continue; // Empty item, e.g. a trailing ';'
+            }
+            NS_ABORT_MSG_IF(dscp < 0, "Conditioner profile needs a valid dscp=: '" << spec << "'");
+            NS_ABORT_MSG_IF(m_profileOf[dscp] >= 0, "Two conditioner profiles for DSCP " << dscp);
+            NS_ABORT_MSG_UNLESS(cir.GetBitRate() > 0 && cbs > 0, "Conditioner profile needs cir= and cbs=: '" << spec << "'");
+            NS_ABORT_MSG_UNLESS(action == "police" || action == "shape", "Unknown conditioner action " << action);
+            if (mode == "trtcm") {
+                NS_ABORT_MSG_UNLESS(pir >= cir, "trtcm needs pir= at least cir: '" << spec << "'");
+                profile.meter.SetTwoRate(cir, cbs, pir, xbs > 0 ? xbs : cbs);
+            } else {
+                NS_ABORT_MSG_UNLESS(mode == "srtcm", "Unknown conditioner mode " << mode);
+                profile.meter.SetSingleRate(cir, cbs, xbs);
+            }
+            profile.dscp = dscp;
+            profile.shape = action == "shape";
+            m_profileOf[dscp] = m_profiles.size();
+            m_profiles.push_back(profile);
+        }
+    }
+
+    std::string m_marksStr;
+    PbrClassifier m_marks;             // Rule action = DSCP to set
+    uint64_t m_nMarked;
+    std::string m_profilesStr;
+    std::vector<Profile> m_profiles;
+    int32_t m_profileOf[64];           // DSCP -> profile index, or -1
+    EventId m_wakeUp;                  // Run() when the earliest held packet turns green
+};
+
+// Replaces the root queue disc of 'device' with a conditioner over a
+// PfifoFast child (the default root, so priorities are kept).
+inline Ptr<TrafficConditionerQueueDisc> InstallTrafficConditioner(Ptr<NetDevice> device, const std::string& profiles,
+                                                                  const std::string& marks = "")
+{
+    TrafficControlHelper tcHelper;
+    uint16_t handle = tcHelper.SetRootQueueDisc(TrafficConditionerQueueDisc::GetTypeId().GetName(),
+                                                "Profiles", StringValue(profiles),
+                                                "Marks", StringValue(marks));
+    TrafficControlHelper::ClassIdList cid = tcHelper.AddQueueDiscClasses(handle, 1, "ns3::QueueDiscClass");
+    tcHelper.AddChildQueueDisc(handle, cid[0], "ns3::PfifoFastQueueDisc");
+    tcHelper.Uninstall(device);
+    return DynamicCast<TrafficConditionerQueueDisc>(tcHelper.Install(device).Get(0));
+}
+
+// One line per profile: DSCP, action and color counts.
+inline void PrintConditionerCounts(std::ostream& os, Ptr<TrafficConditionerQueueDisc> conditioner)
+{
+    if (conditioner->GetNMarkRules() > 0) {
+        os << "  Marked: " << conditioner->GetNMarked() << " packets by " << conditioner->GetNMarkRules()
+           << " rules\n";
+    }
+    for (uint32_t i = 0; i < conditioner->GetNProfiles(); ++i) {
+        const TrafficConditionerQueueDisc::Counts& c = conditioner->GetCounts(i);
+        os << "  DSCP " << static_cast<uint32_t>(conditioner->GetProfileDscp(i))
+           << (conditioner->IsShaper(i) ? " (shape): " : " (police): ") << c.green << " green, ";
+        if (conditioner->IsShaper(i)) {
+            os << c.delayed << " delayed\n";
+        } else {
+            os << c.yellow << " yellow, " << c.red << " red (dropped)\n";
+        }
+    }
+}
+
+} // namespace ns3
+
+#endif /* TRAFFIC_CONDITIONER_H */
@@ -0,0 +1,432 @@
+/*
+ * Traffic models for the scenario scripts, in place of constant-rate OnOff
+ * sources:
+ *
+ *   VoipApplication      G.711 (64 kb/s) or Opus (OpusBitrate) voice, one
+ *                        packet per Ptime (20 ms) plus a 12-byte RTP header;
+ *                        optional talkspurts (ITU-T P.59: on 1.004 s, off
+ *                        1.587 s on average, exponential), with no events
+ *                        at all during silences.
+ *   VbrVideoApplication  Frames at FrameRate following a GOP pattern
+ *                        ("IBBPBBPBBPBB"), I/P/B sizes in FrameRatios around
+ *                        the mean DataRate with log-normal variation; each
+ *                        frame leaves as a burst of PacketSize packets.
+ *   InstallBulkSend()    TCP bulk transfer (BulkSendApplication), unlimited.
+ *
+ * Payloads are cut from one template packet made at start. Each send still
+ * creates a Packet, but Packet::Copy() and CreateFragment() share the
+ * template's buffer (copy on write), so payload bytes are never allocated or
+ * copied per packet; only the headers added below write bytes of their own.
+ * With EnableSeqTsSizeHeader the first 16 payload bytes carry a
+ * SeqTsSizeHeader (in the place of RTP), as OnOff does.
+ *
+ *   TrafficModelHelper voip(VoipApplication::GetTypeId(), InetSocketAddress(sink, 9));
+ *   voip.SetAttribute("ToS", UintegerValue(0x2e << 2));
+ *   ApplicationContainer calls = voip.Install(sources, 25);   // 25 calls per node
+ *   stream += voip.AssignStreams(calls, stream);
+ */
+
+#ifndef TRAFFIC_MODELS_H
+#define TRAFFIC_MODELS_H
+
+#include "ns3/applications-module.h"
+#include "ns3/core-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/network-module.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ns3
+{
+
+// =================================================================
+// TrafficModelApplication: socket, template payload and send path
+// =================================================================
+class TrafficModelApplication : public Application
+{
+public:
+    static TypeId GetTypeId(void)
+    {
+        static TypeId tid = TypeId("ns3::TrafficModelApplication")
+            .SetParent<Application>()
+            .SetGroupName("Applications")
+            .AddAttribute("Remote", "Destination address and port",
+                          AddressValue(),
+                          MakeAddressAccessor(&TrafficModelApplication::m_remote),
+                          MakeAddressChecker())
+            .AddAttribute("ToS", "IP TOS byte of the packets (DSCP << 2)",
+                          UintegerValue(0),
+                          MakeUintegerAccessor(&TrafficModelApplication::m_tos),
+                          MakeUintegerChecker<uint8_t>())
+            .AddAttribute("EnableSeqTsSizeHeader", "Put a SeqTsSizeHeader at the start of every payload",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&TrafficModelApplication::m_seqTsSize),
+                          MakeBooleanChecker())
+            .AddTraceSource("Tx", "A packet is sent",
+                            MakeTraceSourceAccessor(&TrafficModelApplication::m_txTrace),
+                            "ns3::Packet::TracedCallback");
+        return tid;
+    }
+
+    TrafficModelApplication() : m_tos(0), m_seqTsSize(false), m_seq(0), m_totalBytes(0) {}
+    virtual ~TrafficModelApplication() {}
+
+    uint64_t GetTotalTx(void) const { return m_totalBytes; }
+
+    // Fixes the random variable streams; returns how many were used.
+    virtual int64_t AssignStreams(int64_t stream) { return 0; }
+
+protected:
+    virtual void DoDispose(void) override
+    {
+        m_socket = 0;
+        m_template = 0;
+        Application::DoDispose();
+    }
+
+    // Opens the UDP socket and makes the template for payloads up to 'maxPayload'.
+    void Open(uint32_t maxPayload)
+    {
+        m_socket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
+        m_socket->SetIpTos(m_tos);
+        if (InetSocketAddress::IsMatchingType(m_remote)) {
+            m_socket->Bind();
+        } else {
+            m_socket->Bind6();
+        }
+        m_socket->Connect(m_remote);
+        m_socket->ShutdownRecv();
+        m_template = Create<Packet>(maxPayload);
+    }
+
+    void Close(void)
+    {
+        if (m_socket != 0) {
+            m_socket->Close();
+            m_socket = 0;
+        }
+    }
+
+    // Sends 'size' payload bytes (at most the template's).
+    void SendPayload(uint32_t size)
+    {
+        Ptr<Packet> p = size == m_template->GetSize() ? m_template->Copy() : m_template->CreateFragment(0, size);
+        if (m_seqTsSize && size >= SeqTsSizeHeader().GetSerializedSize()) {
+            SeqTsSizeHeader header;
+            header.SetSeq(m_seq++);
+            header.SetSize(size);
+            p->RemoveAtStart(header.GetSerializedSize());
+            p->AddHeader(header);
+        }
+        m_txTrace(p);
+        m_socket->Send(p);
+        m_totalBytes += size;
+    }
+
+private:
+    Address m_remote;
+    uint8_t m_tos;
+    bool m_seqTsSize;
+    uint32_t m_seq;
+    uint64_t m_totalBytes;
+    Ptr<Socket> m_socket;
+    Ptr<Packet> m_template;
+    TracedCallback<Ptr<const Packet> > m_txTrace;
+};
+
+// =================================================================
+// VoipApplication: G.711 / Opus at a fixed packetization interval
+// =================================================================
+class VoipApplication : public TrafficModelApplication
+{
+public:
+    enum Codec { G711, OPUS };
+    static const uint32_t RTP_HEADER = 12;
+
+    static TypeId GetTypeId(void)
+    {
+        static TypeId tid = TypeId("ns3::VoipApplication")
+            .SetParent<TrafficModelApplication>()
+            .SetGroupName("Applications")
+            .AddConstructor<VoipApplication>()
+            .AddAttribute("Codec", "Voice codec",
+                          EnumValue(G711),
+                          MakeEnumAccessor(&VoipApplication::m_codec),
+                          MakeEnumChecker(G711, "G711", OPUS, "Opus"))
+            .AddAttribute("OpusBitrate", "Opus encoder bit rate",
+                          DataRateValue(DataRate("32kbps")),
+                          MakeDataRateAccessor(&VoipApplication::m_opusRate),
+                          MakeDataRateChecker())
+            .AddAttribute("Ptime", "Packetization interval",
+                          TimeValue(MilliSeconds(20)),
+                          MakeTimeAccessor(&VoipApplication::m_ptime),
+                          MakeTimeChecker())
+            .AddAttribute("VoiceActivity", "Send only during talkspurts (ITU-T P.59 on/off model)",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&VoipApplication::m_vad),
+                          MakeBooleanChecker());
+        return tid;
+    }
+
+    VoipApplication()
+    : m_codec(G711),
+      m_opusRate("32kbps"),
+      m_ptime(MilliSeconds(20)),
+      m_vad(false),
+      m_talking(true),
+      m_payload(0),
+      m_phase(CreateObject<UniformRandomVariable>()),
+      m_talk(CreateObjectWithAttributes<ExponentialRandomVariable>("Mean", DoubleValue(1.004))),
+      m_silence(CreateObjectWithAttributes<ExponentialRandomVariable>("Mean", DoubleValue(1.587)))
+    {}
+
+    // Codec bytes per packet plus the RTP header.
+    uint32_t GetPayloadSize(void) const
+    {
+        double bitRate = m_codec == G711 ? 64000.0 : static_cast<double>(m_opusRate.GetBitRate());
+        return static_cast<uint32_t>(std::ceil(bitRate / 8.0 * m_ptime.GetSeconds())) + RTP_HEADER;
+    }
+
+    virtual int64_t AssignStreams(int64_t stream) override
+    {
+        m_phase->SetStream(stream);
+        m_talk->SetStream(stream + 1);
+        m_silence->SetStream(stream + 2);
+        return 3;
+    }
+
+private:
+    virtual void StartApplication(void) override
+    {
+        m_payload = GetPayloadSize();
+        Open(m_payload);
+        m_talking = true;
+        // Calls on one node do not start in lockstep
+        Time phase = NanoSeconds(static_cast<int64_t>(m_phase->GetValue(0, m_ptime.GetNanoSeconds())));
+        m_sendEvent = Simulator::Schedule(phase, &VoipApplication::SendPacket, this);
+        if (m_vad) {
+            m_spurtEvent = Simulator::Schedule(phase + Seconds(m_talk->GetValue()), &VoipApplication::Toggle, this);
+        }
+    }
+
+    virtual void StopApplication(void) override
+    {
+        m_sendEvent.Cancel();
+        m_spurtEvent.Cancel();
+        Close();
+    }
+
+    void SendPacket(void)
+    {
+        SendPayload(m_payload);
+        m_sendEvent = Simulator::Schedule(m_ptime, &VoipApplication::SendPacket, this);
+    }
+
+    // Packets are only scheduled during a talkspurt: a silence costs this
+    // one event, however long it lasts.
+    void Toggle(void)
+    {
+        m_talking = !m_talking;
+        if (m_talking) {
+            m_sendEvent = Simulator::ScheduleNow(&VoipApplication::SendPacket, this);
+        } else {
+            m_sendEvent.Cancel();
+        }
+        double next = m_talking ? m_talk->GetValue() : m_silence->GetValue();
+        m_spurtEvent = Simulator::Schedule(Seconds(next), &VoipApplication::Toggle, this);
+    }
+
+    Codec m_codec;
+    DataRate m_opusRate;
+    Time m_ptime;
+    bool m_vad;
+    bool m_talking;
+    uint32_t m_payload;
+    Ptr<UniformRandomVariable> m_phase;
+    Ptr<ExponentialRandomVariable> m_talk;
+    Ptr<ExponentialRandomVariable> m_silence;
+    EventId m_sendEvent;
+    EventId m_spurtEvent;
+};
+
+// =================================================================
+// VbrVideoApplication: GOP-structured variable bit rate video
+// =================================================================
+class VbrVideoApplication : public TrafficModelApplication
+{
+public:
+    static TypeId GetTypeId(void)
+    {
+        static TypeId tid = TypeId("ns3::VbrVideoApplication")
+            .SetParent<TrafficModelApplication>()
+            .SetGroupName("Applications")
+            .AddConstructor<VbrVideoApplication>()
+            .AddAttribute("DataRate", "Mean bit rate (payload)",
+                          DataRateValue(DataRate("1.5Mbps")),
+                          MakeDataRateAccessor(&VbrVideoApplication::m_rate),
+                          MakeDataRateChecker())
+            .AddAttribute("FrameRate", "Frames per second",
+                          DoubleValue(25.0),
+                          MakeDoubleAccessor(&VbrVideoApplication::m_frameRate),
+                          MakeDoubleChecker<double>(1.0))
+            .AddAttribute("Gop", "Frame types of one group of pictures",
+                          StringValue("IBBPBBPBBPBB"),
+                          MakeStringAccessor(&VbrVideoApplication::m_gop),
+                          MakeStringChecker())
+            .AddAttribute("FrameRatios", "Relative mean size of I, P and B frames",
+                          StringValue("5 2 1"),
+                          MakeStringAccessor(&VbrVideoApplication::m_ratiosStr),
+                          MakeStringChecker())
+            .AddAttribute("Variation", "Sigma of the log-normal frame size factor (mean 1)",
+                          DoubleValue(0.2),
+                          MakeDoubleAccessor(&VbrVideoApplication::m_sigma),
+                          MakeDoubleChecker<double>(0.0))
+            .AddAttribute("PacketSize", "Payload bytes of a full packet of a frame",
+                          UintegerValue(1200),
+                          MakeUintegerAccessor(&VbrVideoApplication::m_packetSize),
+                          MakeUintegerChecker<uint32_t>(16, 65000));
+        return tid;
+    }
+
+    VbrVideoApplication()
+    : m_rate("1.5Mbps"),
+      m_frameRate(25.0),
+      m_gop("IBBPBBPBBPBB"),
+      m_ratiosStr("5 2 1"),
+      m_sigma(0.2),
+      m_packetSize(1200),
+      m_frame(0),
+      m_noise(CreateObject<NormalRandomVariable>())
+    {}
+
+    virtual int64_t AssignStreams(int64_t stream) override
+    {
+        m_noise->SetStream(stream);
+        return 1;
+    }
+
+private:
+    virtual void StartApplication(void) override
+    {
+        std::istringstream is(m_ratiosStr);
+        double ratio[3];
+        for (uint32_t t = 0; t < 3; ++t) {
+            NS_ABORT_MSG_UNLESS(is >> ratio[t] && ratio[t] > 0, "FrameRatios needs three positive values: " << m_ratiosStr);
+        }
+        NS_ABORT_MSG_IF(m_gop.empty() || m_gop.find_first_not_of("IPB") != std::string::npos,
+                        "Gop may only hold I, P and B: " << m_gop);
+        // Scale the ratios so one GOP averages the mean rate
+        double weight = 0;
+        for (char c : m_gop) {
+            weight += ratio[TypeOf(c)];
+        }
+        double gopBytes = m_rate.GetBitRate() / 8.0 / m_frameRate * m_gop.size();
+        for (uint32_t t = 0; t < 3; ++t) {
+            m_meanBytes[t] = ratio[t] * gopBytes / weight;
+        }
+        m_frame = 0;
+        Open(m_packetSize);
+        m_sendEvent = Simulator::ScheduleNow(&VbrVideoApplication::SendFrame, this);
+    }
+
+    virtual void StopApplication(void) override
+    {
+        m_sendEvent.Cancel();
+        Close();
+    }
+
+    static uint32_t TypeOf(char c) { return c == 'I' ? 0 : c == 'P' ? 1 : 2; }
+
+    void SendFrame(void)
+    {
+        // exp(N(-s^2/2, s)) has mean 1
+        double factor = std::exp(m_sigma * m_noise->GetValue() - m_sigma * m_sigma / 2);
+        uint32_t bytes = std::max<uint32_t>(1, static_cast<uint32_t>(m_meanBytes[TypeOf(m_gop[m_frame])] * factor));
+        m_frame = (m_frame + 1) % m_gop.size();
+        for (; bytes > m_packetSize; bytes -= m_packetSize) {
+            SendPayload(m_packetSize);
+        }
+        SendPayload(bytes);
+        m_sendEvent = Simulator::Schedule(Seconds(1.0 / m_frameRate), &VbrVideoApplication::SendFrame, this);
+    }
+
+    DataRate m_rate;
+    double m_frameRate;
+    std::string m_gop;
+    std::string m_ratiosStr;
+    double m_sigma;
+    uint32_t m_packetSize;
+    double m_meanBytes[3];      // I, P, B
+    uint32_t m_frame;           // Position in the GOP
+    Ptr<NormalRandomVariable> m_noise;
+    EventId m_sendEvent;
+};
+
+// =================================================================
+// TrafficModelHelper: installs any of the above
+// =================================================================
+class TrafficModelHelper
+{
+public:
+    TrafficModelHelper(TypeId tid, Address remote)
+    {
+        m_factory.SetTypeId(tid);
+        m_factory.Set("Remote", AddressValue(remote));
+    }
+
+    void SetAttribute(std::string name, const AttributeValue& value) { m_factory.Set(name, value); }
+
+    // 'perNode' independent instances (calls, streams) on every node.
+    ApplicationContainer Install(NodeContainer nodes, uint32_t perNode = 1) const
+    {
+        ApplicationContainer apps;
+        for (uint32_t i = 0; i < nodes.GetN(); ++i) {
+            for (uint32_t k = 0; k < perNode; ++k) {
+                Ptr<Application> app = m_factory.Create<Application>();
+                nodes.Get(i)->AddApplication(app);
+                apps.Add(app);
+            }
+        }
+        return apps;
+    }
+
+    // Fixes the streams of the random variables of 'apps', from 'stream' on,
+    // as the ns-3 application helpers do. Returns the number of streams used.
+    int64_t AssignStreams(ApplicationContainer apps, int64_t stream) const
+    {
+        int64_t first = stream;
+        for (uint32_t i = 0; i < apps.GetN(); ++i) {
+            Ptr<TrafficModelApplication> app = DynamicCast<TrafficModelApplication>(apps.Get(i));
+            if (app != 0) {
+                stream += app->AssignStreams(stream);
+            }
+        }
+        return stream - first;
+    }
+
+private:
+    ObjectFactory m_factory;
+};
+
+// Unlimited TCP bulk transfer from every node to 'remote', 'flows' per node.
+inline ApplicationContainer InstallBulkSend(NodeContainer nodes, InetSocketAddress remote, uint8_t tos,
+                                            uint32_t flows = 1, uint32_t sendSize = 1448)
+{
+    remote.SetTos(tos);
+    BulkSendHelper bulk("ns3::TcpSocketFactory", remote);
+    bulk.SetAttribute("MaxBytes", UintegerValue(0));
+    bulk.SetAttribute("SendSize", UintegerValue(sendSize));
+    ApplicationContainer apps;
+    for (uint32_t f = 0; f < flows; ++f) {
+        apps.Add(bulk.Install(nodes));
+    }
+    return apps;
+}
+
+} // namespace ns3
+
+#endif /* TRAFFIC_MODELS_H */
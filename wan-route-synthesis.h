@@ -0,0 +1,197 @@
+/*
+ * Static route synthesis for a WanTopologyHelper network.
+ *
+ * One BFS per node over the link graph (hop count, like the unit interface
+ * metric Ipv4GlobalRouting uses) gives the first hop towards every link's
+ * /30. Each node's routes are then optionally
+ *   - aggregated: sibling prefixes with the same next hop merge into their
+ *     parent, repeatedly, so a contiguous address block becomes one entry;
+ *   - summarized: the next hop carrying the most entries becomes the default
+ *     route and its entries are dropped (a single-homed branch ends up with
+ *     just a default route).
+ * and bulk-loaded into the node's Ipv4StaticRouting (or any table with the
+ * same route API, e.g. Ipv4TrieRouting, via Install<T>()). Tables are built one node
+ * at a time, so memory stays O(nodes + links) whatever the route count.
+ *
+ * Summarization changes behaviour for unknown destinations: they now follow
+ * the default route instead of being dropped at the source.
+ */
+
+#ifndef WAN_ROUTE_SYNTHESIS_H
+#define WAN_ROUTE_SYNTHESIS_H
+
+#include "ns3/internet-module.h"
+#include "wan-topology-helper.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace ns3
+{
+
+class WanRouteSynthesizer
+{
+public:
+    struct Stats
+    {
+        uint64_t rawRoutes;       // One per (node, remote link) pair
+        uint64_t installedRoutes; // After aggregation/summarization, incl. default routes
+        double seconds;           // Wall-clock time of Install()
+    };
+
+    WanRouteSynthesizer() : m_aggregate(true), m_summarize(true) {}
+
+    void SetAggregate(bool aggregate) { m_aggregate = aggregate; }
+    void SetSummarize(bool summarize) { m_summarize = summarize; }
+
+    template <class T = Ipv4StaticRouting>
+    Stats Install(const WanTopologyHelper& wan)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        Stats stats = {0, 0, 0.0};
+        const std::vector<WanTopologyHelper::Link>& links = wan.GetLinks();
+        NodeContainer nodes = wan.GetNodes();
+        uint32_t n = nodes.GetN();
+
+        std::vector<uint32_t> dist(n);
+        std::vector<uint32_t> firstHop(n);     // Link index leaving 'src'
+        std::vector<uint32_t> queue(n);
+        std::vector<Route> table;
+        std::vector<uint32_t> perLink(links.size(), 0); // Summarize() scratch
+
+        for (uint32_t src = 0; src < n; ++src) {
+            // BFS from src, carrying the first link taken out of src
+            std::fill(dist.begin(), dist.end(), UNREACHABLE);
+            dist[src] = 0;
+            uint32_t head = 0;
+            uint32_t tail = 0;
+            queue[tail++] = src;
+            while (head < tail) {
+                uint32_t u = queue[head++];
+                for (uint32_t l : wan.GetNodeLinks(u)) {
+                    uint32_t v = links[l].nodeA == u ? links[l].nodeB : links[l].nodeA;
+                    if (dist[v] == UNREACHABLE) {
+                        dist[v] = dist[u] + 1;
+                        firstHop[v] = u == src ? l : firstHop[u];
+                        queue[tail++] = v;
+                    }
+                }
+            }
+
+            // Each remote link is reached through its nearer endpoint
+            table.clear();
+            for (uint32_t l = 0; l < links.size(); ++l) {
+                const WanTopologyHelper::Link& link = links[l];
+                if (link.nodeA == src || link.nodeB == src) {
+                    continue; // Connected route
+                }
+                uint32_t via = dist[link.nodeA] <= dist[link.nodeB] ? link.nodeA : link.nodeB;
+                if (dist[via] == UNREACHABLE) {
+                    continue;
+                }
+                Route r;
+                r.prefix = link.network.Get();
+                r.len = 30;
+                r.link = firstHop[via];
+                table.push_back(r);
+            }
+            stats.rawRoutes += table.size();
+
+            if (m_aggregate) {
+                Aggregate(table);
+            }
+            uint32_t defaultLink = UNREACHABLE;
+            if (m_summarize) {
+                defaultLink = Summarize(table, perLink);
+            }
+
+            Ptr<Ipv4> ipv4 = nodes.Get(src)->GetObject<Ipv4>();
+            Ptr<T> rt = Ipv4RoutingHelper::GetRouting<T>(ipv4->GetRoutingProtocol());
+            NS_ABORT_MSG_UNLESS(rt != 0, "Node " << src << " has no " << T::GetTypeId().GetName());
+            for (const Route& r : table) {
+                rt->AddNetworkRouteTo(Ipv4Address(r.prefix), Ipv4Mask(MaskOf(r.len)),
+                                      wan.GetAddress(r.link, Peer(links[r.link], src)), IfOf(links[r.link], src));
+            }
+            if (defaultLink != UNREACHABLE) {
+                rt->SetDefaultRoute(wan.GetAddress(defaultLink, Peer(links[defaultLink], src)),
+                                    IfOf(links[defaultLink], src));
+            }
+            stats.installedRoutes += table.size() + (defaultLink != UNREACHABLE ? 1 : 0);
+        }
+
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        return stats;
+    }
+
+private:
+    static constexpr uint32_t UNREACHABLE = 0xffffffff;
+
+    struct Route
+    {
+        uint32_t prefix;
+        uint32_t len;
+        uint32_t link;   // Outgoing link index
+        bool operator<(const Route& o) const { return prefix < o.prefix; }
+    };
+
+    static uint32_t MaskOf(uint32_t len) { return len == 0 ? 0 : 0xffffffffu << (32 - len); }
+    static uint32_t Peer(const WanTopologyHelper::Link& l, uint32_t node) { return l.nodeA == node ? l.nodeB : l.nodeA; }
+    static uint32_t IfOf(const WanTopologyHelper::Link& l, uint32_t node) { return l.nodeA == node ? l.ifA : l.ifB; }
+
+    // Binary-counter style merge over the sorted, disjoint prefixes: whenever
+    // the two newest entries are siblings with the same next hop, replace
+    // them by their parent and try again one level up.
+    static void Aggregate(std::vector<Route>& table)
+    {
+        std::sort(table.begin(), table.end());
+        std::vector<Route> out;
+        out.reserve(table.size());
+        for (const Route& r : table) {
+            out.push_back(r);
+            while (out.size() >= 2) {
+                Route& hi = out[out.size() - 1];
+                Route& lo = out[out.size() - 2];
+                if (lo.len != hi.len || lo.link != hi.link || lo.len == 0) {
+                    break;
+                }
+                uint32_t bit = 1u << (32 - lo.len);
+                if ((lo.prefix & bit) != 0 || (lo.prefix | bit) != hi.prefix) {
+                    break;
+                }
+                lo.len -= 1;
+                out.pop_back();
+            }
+        }
+        table.swap(out);
+    }
+
+    // Prefixes are disjoint after synthesis, so the most common next hop can
+    // take over as the default route without shadowing any other entry.
+    static uint32_t Summarize(std::vector<Route>& table, std::vector<uint32_t>& perLink)
+    {
+        if (table.empty()) {
+            return UNREACHABLE;
+        }
+        uint32_t best = table[0].link;
+        for (const Route& r : table) {
+            if (++perLink[r.link] > perLink[best]) {
+                best = r.link;
+            }
+        }
+        for (const Route& r : table) {
+            perLink[r.link] = 0;
+        }
+        table.erase(std::remove_if(table.begin(), table.end(),
+                                   [best](const Route& r) { return r.link == best; }),
+                    table.end());
+        return best;
+    }
+
+    bool m_aggregate;
+    bool m_summarize;
+};
+
+} // namespace ns3
+
+#endif /* WAN_ROUTE_SYNTHESIS_H */
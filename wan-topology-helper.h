@@ -0,0 +1,228 @@
+/*
+ * Parameterized WAN topology generator shared by the exercise scripts.
+ *
+ * Builds hub-and-spoke, full-mesh, dual-homed-branch or multi-tier WANs with
+ * N branches out of point-to-point links. Every link gets a /30 carved from
+ * one address pool and is configured directly on the Ipv4 interfaces, so the
+ * cost per link is constant: unlike Ipv4AddressHelper, nothing checks each
+ * new address against the list of all addresses handed out so far.
+ *
+ * Node order: hubs, then aggregation nodes (multi-tier only), then branches.
+ */
+
+#ifndef WAN_TOPOLOGY_HELPER_H
+#define WAN_TOPOLOGY_HELPER_H
+
+#include "ns3/core-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/network-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/traffic-control-module.h"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace ns3
+{
+
+class WanTopologyHelper
+{
+public:
+    struct Link
+    {
+        uint32_t nodeA;          // Index into GetNodes(); the hub/upstream side
+        uint32_t nodeB;
+        uint32_t ifA;            // Ipv4 interface index on nodeA
+        uint32_t ifB;
+        Ptr<NetDevice> devA;
+        Ptr<NetDevice> devB;
+        Ipv4Address network;     // The link's /30
+        Ipv4Address addrA;
+        Ipv4Address addrB;
+        uint64_t rateBps;
+        Time delay;
+        bool core;               // Hub/aggregation link rather than a branch access link
+    };
+
+    WanTopologyHelper()
+    : m_topology("fixed"),
+      m_branches(4),
+      m_aggregation(0),
+      m_accessRate("5Mbps"),
+      m_accessDelay("10ms"),
+      m_coreRate("100Mbps"),
+      m_coreDelay("1ms"),
+      m_addressBase("10.128.0.0"),
+      m_systemCount(1),
+      m_nextNetwork(0)
+    {}
+
+    // Registers --topology, --branches, --aggregation, --accessRate, --accessDelay,
+    // --coreRate, --coreDelay and --addressBase on the script's command line.
+    void AddCommandLineOptions(CommandLine& cmd)
+    {
+        cmd.AddValue("topology", "fixed (script's own 3 nodes), hub-spoke, full-mesh, dual-homed or multi-tier", m_topology);
+        cmd.AddValue("branches", "Number of branch sites in a generated topology", m_branches);
+        cmd.AddValue("aggregation", "Aggregation nodes for multi-tier (0 = sqrt(branches))", m_aggregation);
+        cmd.AddValue("accessRate", "Data rate of branch access links", m_accessRate);
+        cmd.AddValue("accessDelay", "Delay of branch access links", m_accessDelay);
+        cmd.AddValue("coreRate", "Data rate of hub/aggregation links", m_coreRate);
+        cmd.AddValue("coreDelay", "Delay of hub/aggregation links", m_coreDelay);
+        cmd.AddValue("addressBase", "First address of the /30 link pool", m_addressBase);
+    }
+
+    // False when the script should keep its original hand-built topology.
+    bool IsGenerated(void) const { return m_topology != "fixed"; }
+    void SetTopology(const std::string& topology) { m_topology = topology; }
+    void SetBranches(uint32_t branches) { m_branches = branches; }
+    const std::string& GetTopology(void) const { return m_topology; }
+    // Spreads the branches over 'count' MPI ranks (node system ids) in
+    // contiguous blocks; hubs and aggregation nodes stay on rank 0, so every
+    // cut is a high-latency branch access link.
+    void SetSystemCount(uint32_t count) { m_systemCount = count > 0 ? count : 1; }
+    // Routing for the stack Build() installs (default: InternetStackHelper's).
+    void SetRoutingHelper(const Ipv4RoutingHelper& routing) { m_stack.SetRoutingHelper(routing); }
+
+    // Creates the nodes and links, installs the Internet stack and assigns
+    // addresses. Runs in time linear in the number of links.
+    void Build(void)
+    {
+        NS_ABORT_MSG_UNLESS(m_branches > 0, "A generated WAN needs at least one branch");
+        uint32_t hubs = m_topology == "dual-homed" ? 2 : 1;
+        uint32_t aggs = 0;
+        if (m_topology == "multi-tier") {
+            aggs = m_aggregation > 0 ? m_aggregation
+                                     : static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(m_branches))));
+        }
+
+        m_hubs.Create(hubs);
+        m_aggNodes.Create(aggs);
+        for (uint32_t b = 0; b < m_branches; ++b) {
+            m_branchNodes.Create(1, static_cast<uint32_t>(static_cast<uint64_t>(b) * m_systemCount / m_branches));
+        }
+        m_nodes.Add(m_hubs);
+        m_nodes.Add(m_aggNodes);
+        m_nodes.Add(m_branchNodes);
+        m_adjacency.assign(m_nodes.GetN(), std::vector<uint32_t>());
+
+        m_stack.Install(m_nodes);
+
+        uint32_t firstBranch = hubs + aggs;
+        if (m_topology == "hub-spoke") {
+            for (uint32_t b = 0; b < m_branches; ++b) {
+                AddLink(0, firstBranch + b, false);
+            }
+        } else if (m_topology == "full-mesh") {
+            // Every site pair: the link count itself is quadratic here. With
+            // no aggregation tier every link, the hub's included, is access.
+            for (uint32_t i = 0; i < m_nodes.GetN(); ++i) {
+                for (uint32_t j = i + 1; j < m_nodes.GetN(); ++j) {
+                    AddLink(i, j, false);
+                }
+            }
+        } else if (m_topology == "dual-homed") {
+            AddLink(0, 1, true);
+            for (uint32_t b = 0; b < m_branches; ++b) {
+                AddLink(0, firstBranch + b, false); // Primary
+                AddLink(1, firstBranch + b, false); // Secondary
+            }
+        } else if (m_topology == "multi-tier") {
+            // Each aggregation subtree gets a contiguous address block.
+            for (uint32_t a = 0; a < aggs; ++a) {
+                AddLink(0, hubs + a, true);
+                for (uint32_t b = a; b < m_branches; b += aggs) {
+                    AddLink(hubs + a, firstBranch + b, false);
+                }
+            }
+        } else {
+            NS_ABORT_MSG("Unknown topology " << m_topology);
+        }
+    }
+
+    NodeContainer GetNodes(void) const { return m_nodes; }
+    NodeContainer GetHubs(void) const { return m_hubs; }
+    NodeContainer GetAggregationNodes(void) const { return m_aggNodes; }
+    NodeContainer GetBranches(void) const { return m_branchNodes; }
+    uint32_t GetBranchIndex(uint32_t branch) const { return m_hubs.GetN() + m_aggNodes.GetN() + branch; }
+    const std::vector<Link>& GetLinks(void) const { return m_links; }
+    // Indices into GetLinks() of the links attached to a node, in build order.
+    const std::vector<uint32_t>& GetNodeLinks(uint32_t node) const { return m_adjacency[node]; }
+    // Address of 'node' on 'link'.
+    Ipv4Address GetAddress(uint32_t link, uint32_t node) const
+    {
+        return m_links[link].nodeA == node ? m_links[link].addrA : m_links[link].addrB;
+    }
+
+private:
+    void AddLink(uint32_t a, uint32_t b, bool core)
+    {
+        PointToPointHelper p2p;
+        p2p.SetDeviceAttribute("DataRate", StringValue(core ? m_coreRate : m_accessRate));
+        p2p.SetChannelAttribute("Delay", StringValue(core ? m_coreDelay : m_accessDelay));
+        NetDeviceContainer devs = p2p.Install(m_nodes.Get(a), m_nodes.Get(b));
+
+        NS_ABORT_MSG_UNLESS(m_nextNetwork < (1u << 20), "Address pool exhausted");
+        Link l;
+        l.nodeA = a;
+        l.nodeB = b;
+        l.devA = devs.Get(0);
+        l.devB = devs.Get(1);
+        l.network = Ipv4Address(Ipv4Address(m_addressBase.c_str()).Get() + 4 * m_nextNetwork++);
+        l.addrA = Ipv4Address(l.network.Get() + 1);
+        l.addrB = Ipv4Address(l.network.Get() + 2);
+        l.ifA = Configure(l.devA, l.addrA);
+        l.ifB = Configure(l.devB, l.addrB);
+        l.rateBps = DataRate(core ? m_coreRate : m_accessRate).GetBitRate();
+        l.delay = Time(core ? m_coreDelay : m_accessDelay);
+        l.core = core;
+
+        m_adjacency[a].push_back(static_cast<uint32_t>(m_links.size()));
+        m_adjacency[b].push_back(static_cast<uint32_t>(m_links.size()));
+        m_links.push_back(l);
+    }
+
+    // What Ipv4AddressHelper::Assign does for one device, minus the global
+    // uniqueness check: add the interface and address, bring it up, and give
+    // it the default root queue disc.
+    static uint32_t Configure(Ptr<NetDevice> dev, Ipv4Address addr)
+    {
+        Ptr<Ipv4> ipv4 = dev->GetNode()->GetObject<Ipv4>();
+        int32_t ifIndex = ipv4->GetInterfaceForDevice(dev);
+        if (ifIndex < 0) {
+            ifIndex = ipv4->AddInterface(dev);
+        }
+        ipv4->AddAddress(ifIndex, Ipv4InterfaceAddress(addr, Ipv4Mask("255.255.255.252")));
+        ipv4->SetMetric(ifIndex, 1);
+        ipv4->SetUp(ifIndex);
+
+        Ptr<TrafficControlLayer> tc = dev->GetNode()->GetObject<TrafficControlLayer>();
+        if (tc != 0 && tc->GetRootQueueDiscOnDevice(dev) == 0) {
+            TrafficControlHelper::Default().Install(dev);
+        }
+        return static_cast<uint32_t>(ifIndex);
+    }
+
+    std::string m_topology;
+    uint32_t m_branches;
+    uint32_t m_aggregation;
+    std::string m_accessRate;
+    std::string m_accessDelay;
+    std::string m_coreRate;
+    std::string m_coreDelay;
+    std::string m_addressBase;
+    uint32_t m_systemCount;
+    InternetStackHelper m_stack;
+
+    NodeContainer m_nodes;
+    NodeContainer m_hubs;
+    NodeContainer m_aggNodes;
+    NodeContainer m_branchNodes;
+    std::vector<Link> m_links;
+    std::vector<std::vector<uint32_t> > m_adjacency;
+    uint32_t m_nextNetwork;
+};
+
+} // namespace ns3
+
+#endif /* WAN_TOPOLOGY_HELPER_H */